@@ -0,0 +1,397 @@
+#include "AssetArchive.h"
+#include "AssetIndex.h"
+#include "ThreadPool.h"
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <lz4.h>
+#include <lz4hc.h>
+#include <zstd.h>
+#define XXH_INLINE_ALL
+#include <xxhash.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#define ASSET_ARCHIVE_MAGIC "GARC"
+#define ASSET_ARCHIVE_VERSION 2
+#define ASSET_ARCHIVE_ALIGNMENT 4096ull
+#define ASSET_ARCHIVE_BLOCK_SIZE (256ull * 1024)
+#define ARCHIVE_ZSTD_LEVEL 19
+
+//Layout: header, buckets, entries, paths, then the entry data each aligned to ASSET_ARCHIVE_ALIGNMENT.
+//A bucket holds the index of its entry plus one, 0 when it's empty. Compressed entries start with the
+//compressed size of each ASSET_ARCHIVE_BLOCK_SIZE block followed by the blocks
+struct ArchiveHeader
+{
+	char magic[4];
+	GLuint version;
+	GLuint entriesCount;
+	GLuint bucketsCount;
+	GLuint64 pathsSize;
+};
+
+static GLuint64 alignEntry(GLuint64 offset)
+{
+	return (offset + ASSET_ARCHIVE_ALIGNMENT - 1) & ~(ASSET_ARCHIVE_ALIGNMENT - 1);
+}
+
+//Uncompressed size of block index of an entry, only the last one is shorter
+static GLuint blockSize(GLuint64 size, GLuint index)
+{
+	return (GLuint)std::min<GLuint64>(ASSET_ARCHIVE_BLOCK_SIZE, size - index * ASSET_ARCHIVE_BLOCK_SIZE);
+}
+
+static GLboolean compressBlock(ArchiveCompression compression, const char *source, GLuint size, std::vector<char> &result)
+{
+	if (ARCHIVE_COMPRESSION_LZ4 == compression)
+	{
+		result.resize(LZ4_compressBound((GLint)size));
+		GLint written = LZ4_compress_HC(source, result.data(), (GLint)size, (GLint)result.size(), LZ4HC_CLEVEL_DEFAULT);
+		result.resize(written > 0 ? written : 0);
+	}
+	else
+	{
+		result.resize(ZSTD_compressBound(size));
+		size_t written = ZSTD_compress(result.data(), result.size(), source, size, ARCHIVE_ZSTD_LEVEL);
+		result.resize(ZSTD_isError(written) ? 0 : written);
+	}
+	return result.empty() ? GL_FALSE : GL_TRUE;
+}
+
+static GLboolean decompressBlock(ArchiveCompression compression, const GLubyte *source, GLuint size, GLubyte *destination, GLuint destinationSize)
+{
+	if (ARCHIVE_COMPRESSION_LZ4 == compression)
+		return (GLint)destinationSize == LZ4_decompress_safe((const char*)source, (char*)destination, (GLint)size, (GLint)destinationSize) ? GL_TRUE : GL_FALSE;
+	size_t written = ZSTD_decompress(destination, destinationSize, source, size);
+	return !ZSTD_isError(written) && destinationSize == written ? GL_TRUE : GL_FALSE;
+}
+
+AssetArchive::AssetArchive() : mData(nullptr), mSize(0), mEntriesCount(0), mBucketsCount(0), mBuckets(nullptr), mEntries(nullptr), mPaths(nullptr), mPathsSize(0), mFile(nullptr), mMapping(nullptr)
+{
+}
+
+AssetArchive::~AssetArchive()
+{
+	this->Close();
+}
+
+std::string AssetArchive::Normalize(const std::string &path)
+{
+	std::vector<std::string> segments;
+	std::string segment;
+	for (GLuint i = 0; i <= path.size(); i++)
+	{
+		if (i < path.size() && '/' != path[i] && '\\' != path[i])
+		{
+			segment += path[i];
+			continue;
+		}
+		//A relative path can't go above its start, those ".." are kept
+		if (".." == segment && !segments.empty() && ".." != segments.back())
+			segments.pop_back();
+		else if (!segment.empty() && "." != segment)
+			segments.push_back(segment);
+		segment.clear();
+	}
+	std::string result = !path.empty() && ('/' == path[0] || '\\' == path[0]) ? "\\" : "";
+	for (GLuint i = 0; i < segments.size(); i++)
+		result += (0 == i ? "" : "\\") + segments[i];
+	return result;
+}
+
+GLboolean AssetArchive::Build(const std::string &directory, const std::string &archivePath, ArchiveCompression compression)
+{
+	std::vector<std::string> files;
+	AssetIndex::ListFiles(directory, files, "");
+
+	std::vector<ArchiveEntry> entries(files.size());
+	std::string paths;
+	for (GLuint i = 0; i < files.size(); i++)
+	{
+		std::string path = Normalize(files[i].substr(directory.size() + 1));
+		std::memset(&entries[i], 0, sizeof(ArchiveEntry));
+		entries[i].hash = XXH3_64bits(path.data(), path.size());
+		entries[i].pathOffset = (GLuint)paths.size();
+		entries[i].pathLength = (GLuint)path.size();
+		paths += path;
+	}
+
+	//At most half the buckets are used so probes stay short
+	ArchiveHeader header;
+	std::memcpy(header.magic, ASSET_ARCHIVE_MAGIC, 4);
+	header.version = ASSET_ARCHIVE_VERSION;
+	header.entriesCount = (GLuint)entries.size();
+	header.bucketsCount = 1;
+	while (header.bucketsCount < header.entriesCount * 2)
+		header.bucketsCount *= 2;
+	header.pathsSize = paths.size();
+	std::vector<GLuint> buckets(header.bucketsCount, 0);
+	for (GLuint i = 0; i < entries.size(); i++)
+	{
+		GLuint bucket = (GLuint)(entries[i].hash & (header.bucketsCount - 1));
+		while (0 != buckets[bucket])
+			bucket = (bucket + 1) & (header.bucketsCount - 1);
+		buckets[bucket] = i + 1;
+	}
+
+	std::ofstream stream(archivePath, std::ios::out | std::ios::binary);
+	if (!stream.is_open())
+	{
+		std::cout << "ASSET_ARCHIVE::BUILD Message: Could not open " << archivePath << std::endl;
+		return GL_FALSE;
+	}
+	//The entries are written again once the offsets and stored sizes are known
+	stream.write((const char*)&header, sizeof(header));
+	stream.write((const char*)buckets.data(), buckets.size() * sizeof(GLuint));
+	GLuint64 entriesPosition = (GLuint64)stream.tellp();
+	stream.write((const char*)entries.data(), entries.size() * sizeof(ArchiveEntry));
+	stream.write(paths.data(), paths.size());
+
+	std::vector<char> data, padding;
+	std::vector<std::vector<char>> blocks;
+	GLuint64 offset = (GLuint64)stream.tellp();
+	for (GLuint i = 0; i < entries.size(); i++)
+	{
+		ArchiveEntry *entry = &entries[i];
+		std::ifstream file(files[i], std::ios::in | std::ios::binary | std::ios::ate);
+		if (!file.is_open())
+		{
+			std::cout << "ASSET_ARCHIVE::BUILD Message: Could not open " << files[i] << std::endl;
+			return GL_FALSE;
+		}
+		entry->size = (GLuint64)file.tellg();
+		data.resize((size_t)entry->size);
+		file.seekg(0);
+		file.read(data.data(), data.size());
+
+		entry->offset = alignEntry(offset);
+		padding.assign((size_t)(entry->offset - offset), 0);
+		stream.write(padding.data(), padding.size());
+		entry->compression = ARCHIVE_COMPRESSION_NONE;
+		entry->storedSize = entry->size;
+		if (ARCHIVE_COMPRESSION_NONE != compression && entry->size > 0)
+		{
+			entry->blocksCount = (GLuint)((entry->size + ASSET_ARCHIVE_BLOCK_SIZE - 1) / ASSET_ARCHIVE_BLOCK_SIZE);
+			blocks.assign(entry->blocksCount, std::vector<char>());
+			std::vector<GLboolean> compressed(entry->blocksCount, GL_FALSE);
+			std::function<void(GLuint)> compress = [&](GLuint b) { compressed[b] = compressBlock(compression, &data[(size_t)(b * ASSET_ARCHIVE_BLOCK_SIZE)], blockSize(entry->size, b), blocks[b]); };
+			if (nullptr != ThreadPool::GetPointerInstance())
+				ThreadPool::GetInstance().ParallelFor(entry->blocksCount, compress);
+			else
+			{
+				for (GLuint b = 0; b < entry->blocksCount; b++)
+					compress(b);
+			}
+			//A block the compressor fails on keeps the whole entry uncompressed
+			GLboolean valid = GL_TRUE;
+			GLuint64 storedSize = entry->blocksCount * sizeof(GLuint);
+			for (GLuint b = 0; b < entry->blocksCount; b++)
+			{
+				valid = valid && compressed[b];
+				storedSize += blocks[b].size();
+			}
+			if (valid && storedSize < entry->size)
+			{
+				entry->compression = compression;
+				entry->storedSize = storedSize;
+			}
+		}
+		if (ARCHIVE_COMPRESSION_NONE == entry->compression)
+		{
+			entry->blocksCount = 0;
+			stream.write(data.data(), data.size());
+		}
+		else
+		{
+			//Block sizes first, then the blocks back to back
+			for (GLuint b = 0; b < entry->blocksCount; b++)
+			{
+				GLuint size = (GLuint)blocks[b].size();
+				stream.write((const char*)&size, sizeof(size));
+			}
+			for (GLuint b = 0; b < entry->blocksCount; b++)
+				stream.write(blocks[b].data(), blocks[b].size());
+		}
+		offset = entry->offset + entry->storedSize;
+	}
+	stream.seekp(entriesPosition);
+	stream.write((const char*)entries.data(), entries.size() * sizeof(ArchiveEntry));
+	return stream.good() ? GL_TRUE : GL_FALSE;
+}
+
+GLboolean AssetArchive::Open(const std::string &archivePath)
+{
+	this->Close();
+#ifdef _WIN32
+	HANDLE file = CreateFileA(archivePath.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, NULL);
+	if (INVALID_HANDLE_VALUE == file)
+	{
+		std::cout << "ASSET_ARCHIVE::OPEN Message: Could not open " << archivePath << std::endl;
+		return GL_FALSE;
+	}
+	LARGE_INTEGER size;
+	GetFileSizeEx(file, &size);
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	const void *data = NULL == mapping ? nullptr : MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	this->mFile = file;
+	this->mMapping = mapping;
+	this->mSize = (GLuint64)size.QuadPart;
+#else
+	GLint descriptor = open(archivePath.c_str(), O_RDONLY);
+	if (0 > descriptor)
+	{
+		std::cout << "ASSET_ARCHIVE::OPEN Message: Could not open " << archivePath << std::endl;
+		return GL_FALSE;
+	}
+	struct stat status;
+	fstat(descriptor, &status);
+	void *data = mmap(nullptr, (size_t)status.st_size, PROT_READ, MAP_SHARED, descriptor, 0);
+	//The mapping stays valid once the descriptor is closed
+	close(descriptor);
+	data = MAP_FAILED == data ? nullptr : data;
+	this->mSize = (GLuint64)status.st_size;
+#endif
+	this->mData = (const GLubyte*)data;
+	if (nullptr == this->mData || this->mSize < sizeof(ArchiveHeader))
+	{
+		std::cout << "ASSET_ARCHIVE::OPEN Message: Could not map " << archivePath << std::endl;
+		this->Close();
+		return GL_FALSE;
+	}
+
+	const ArchiveHeader *header = (const ArchiveHeader*)this->mData;
+	GLuint64 indexSize = sizeof(ArchiveHeader) + (GLuint64)header->bucketsCount * sizeof(GLuint) + (GLuint64)header->entriesCount * sizeof(ArchiveEntry) + header->pathsSize;
+	if (0 != std::memcmp(header->magic, ASSET_ARCHIVE_MAGIC, 4) || ASSET_ARCHIVE_VERSION != header->version || indexSize > this->mSize || 0 == header->bucketsCount)
+	{
+		std::cout << "ASSET_ARCHIVE::OPEN Message: " << archivePath << " is not a valid archive." << std::endl;
+		this->Close();
+		return GL_FALSE;
+	}
+	this->mEntriesCount = header->entriesCount;
+	this->mBucketsCount = header->bucketsCount;
+	this->mBuckets = (const GLuint*)(this->mData + sizeof(ArchiveHeader));
+	this->mEntries = (const ArchiveEntry*)(this->mBuckets + this->mBucketsCount);
+	this->mPaths = (const char*)(this->mEntries + this->mEntriesCount);
+	this->mPathsSize = header->pathsSize;
+	return GL_TRUE;
+}
+
+void AssetArchive::Close()
+{
+#ifdef _WIN32
+	if (nullptr != this->mData)
+		UnmapViewOfFile(this->mData);
+	if (nullptr != this->mMapping)
+		CloseHandle((HANDLE)this->mMapping);
+	if (nullptr != this->mFile)
+		CloseHandle((HANDLE)this->mFile);
+#else
+	if (nullptr != this->mData)
+		munmap((void*)this->mData, (size_t)this->mSize);
+#endif
+	this->mData = nullptr;
+	this->mSize = 0;
+	this->mEntriesCount = 0;
+	this->mBucketsCount = 0;
+	this->mBuckets = nullptr;
+	this->mEntries = nullptr;
+	this->mPaths = nullptr;
+	this->mPathsSize = 0;
+	this->mFile = nullptr;
+	this->mMapping = nullptr;
+}
+
+const AssetArchive::ArchiveEntry *AssetArchive::findEntry(const std::string &path)
+{
+	if (nullptr == this->mData)
+		return nullptr;
+	std::string key = Normalize(path);
+	GLuint64 hash = XXH3_64bits(key.data(), key.size());
+	GLuint bucket = (GLuint)(hash & (this->mBucketsCount - 1));
+	for (GLuint probes = 0; probes < this->mBucketsCount && 0 != this->mBuckets[bucket]; probes++)
+	{
+		//The index comes from the file, entries and paths pointing outside their tables are skipped
+		if (this->mBuckets[bucket] > this->mEntriesCount)
+		{
+			bucket = (bucket + 1) & (this->mBucketsCount - 1);
+			continue;
+		}
+		const ArchiveEntry *entry = &this->mEntries[this->mBuckets[bucket] - 1];
+		GLboolean valid = (GLuint64)entry->pathOffset + entry->pathLength <= this->mPathsSize && entry->offset <= this->mSize && entry->storedSize <= this->mSize - entry->offset;
+		if (valid && hash == entry->hash && key.size() == entry->pathLength && 0 == std::memcmp(&this->mPaths[entry->pathOffset], key.data(), key.size()))
+			return entry;
+		bucket = (bucket + 1) & (this->mBucketsCount - 1);
+	}
+	return nullptr;
+}
+
+GLboolean AssetArchive::Find(const std::string &path, const GLubyte **data, GLuint64 *size)
+{
+	const ArchiveEntry *entry = this->findEntry(path);
+	if (nullptr == entry)
+		return GL_FALSE;
+	*data = ARCHIVE_COMPRESSION_NONE == entry->compression ? this->mData + entry->offset : nullptr;
+	*size = entry->size;
+	return GL_TRUE;
+}
+
+GLboolean AssetArchive::Read(const std::string &path, GLubyte *destination)
+{
+	const ArchiveEntry *entry = this->findEntry(path);
+	if (nullptr == entry)
+		return GL_FALSE;
+	const GLubyte *data = this->mData + entry->offset;
+	if (ARCHIVE_COMPRESSION_NONE == entry->compression)
+	{
+		std::memcpy(destination, data, (size_t)entry->size);
+		return GL_TRUE;
+	}
+
+	//The block sizes have to fit in the stored bytes and cover the whole entry
+	if ((GLuint64)entry->blocksCount * sizeof(GLuint) > entry->storedSize || entry->blocksCount != (entry->size + ASSET_ARCHIVE_BLOCK_SIZE - 1) / ASSET_ARCHIVE_BLOCK_SIZE)
+	{
+		std::cout << "ASSET_ARCHIVE::READ Message: The block table of " << path << " is corrupted." << std::endl;
+		return GL_FALSE;
+	}
+	const GLuint *sizes = (const GLuint*)data;
+	std::vector<GLuint64> offsets(entry->blocksCount + 1);
+	offsets[0] = entry->blocksCount * sizeof(GLuint);
+	for (GLuint b = 0; b < entry->blocksCount; b++)
+		offsets[b + 1] = offsets[b] + sizes[b];
+	if (offsets[entry->blocksCount] > entry->storedSize)
+	{
+		std::cout << "ASSET_ARCHIVE::READ Message: The blocks of " << path << " are larger than the entry." << std::endl;
+		return GL_FALSE;
+	}
+
+	std::vector<GLboolean> decompressed(entry->blocksCount, GL_FALSE);
+	std::function<void(GLuint)> decompress = [&](GLuint b)
+	{
+		decompressed[b] = decompressBlock((ArchiveCompression)entry->compression, &data[offsets[b]], sizes[b], &destination[b * ASSET_ARCHIVE_BLOCK_SIZE], blockSize(entry->size, b));
+	};
+	if (nullptr != ThreadPool::GetPointerInstance() && entry->blocksCount > 1)
+		ThreadPool::GetInstance().ParallelFor(entry->blocksCount, decompress);
+	else
+	{
+		for (GLuint b = 0; b < entry->blocksCount; b++)
+			decompress(b);
+	}
+	for (GLuint b = 0; b < entry->blocksCount; b++)
+	{
+		if (!decompressed[b])
+		{
+			std::cout << "ASSET_ARCHIVE::READ Message: Block " << b << " of " << path << " is corrupted." << std::endl;
+			return GL_FALSE;
+		}
+	}
+	return GL_TRUE;
+}
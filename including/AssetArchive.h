@@ -0,0 +1,67 @@
+#pragma once
+#include <glad\glad.h>
+#include <string>
+
+//Compression of the archive entries. Entries are split in independent blocks decompressed in parallel,
+//NONE suits fast local disks where decompressing costs more than the bytes it saves
+enum ArchiveCompression
+{
+	ARCHIVE_COMPRESSION_NONE,
+	ARCHIVE_COMPRESSION_LZ4,
+	ARCHIVE_COMPRESSION_ZSTD
+};
+
+/*Many asset files packed into one, opened once and memory mapped. The path index sits at the front of the file
+as an open addressing hash table and every entry starts on a 4K boundary so its bytes can be used in place*/
+class AssetArchive
+{
+public:
+	AssetArchive();
+	~AssetArchive();
+
+	//Packs every file under directory into archivePath, entries are named by their path relative to directory.
+	//Compressed entries that don't get smaller are stored as they are
+	static GLboolean Build(const std::string &directory, const std::string &archivePath, ArchiveCompression compression = ARCHIVE_COMPRESSION_NONE);
+
+	GLboolean Open(const std::string &archivePath);
+	void Close();
+	GLboolean IsOpen() { return nullptr != this->mData; }
+
+	//Points data to the bytes of the entry at path, valid until the archive is closed. Paths are compared normalized.
+	//data is null when the entry is compressed, size is always the uncompressed size
+	GLboolean Find(const std::string &path, const GLubyte **data, GLuint64 *size);
+	//Copies or decompresses the entry at path into destination, which needs the size given by Find. Blocks are decompressed
+	//in parallel on the ThreadPool when it's started, destination can be upload staging memory
+	GLboolean Read(const std::string &path, GLubyte *destination);
+
+	//Uses '\' as the only separator and drops empty and "." segments, ".." removes the segment before it
+	static std::string Normalize(const std::string &path);
+
+private:
+	struct ArchiveEntry
+	{
+		GLuint64 hash;
+		GLuint64 offset;
+		GLuint64 size;
+		//Bytes in the archive, the block sizes included when compressed
+		GLuint64 storedSize;
+		GLuint pathOffset;
+		GLuint pathLength;
+		GLuint compression;
+		GLuint blocksCount;
+	};
+
+	const GLubyte *mData;
+	GLuint64 mSize;
+	GLuint mEntriesCount;
+	GLuint mBucketsCount;
+	const GLuint *mBuckets;
+	const ArchiveEntry *mEntries;
+	const char *mPaths;
+	GLuint64 mPathsSize;
+	//Platform handles of the mapping
+	void *mFile;
+	void *mMapping;
+
+	const ArchiveEntry *findEntry(const std::string &path);
+};
@@ -0,0 +1,319 @@
+#include "AssetIndex.h"
+#include "ThreadPool.h"
+#include "Transform.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include <algorithm>
+#include <rapidjson\document.h>
+#define XXH_INLINE_ALL
+#include <xxhash.h>
+#ifdef _WIN32
+#include "dirent.h"
+#else
+#include <dirent.h>
+#endif
+
+#define ASSET_INDEX_MAGIC "GIDX"
+#define ASSET_INDEX_VERSION 1
+
+GLboolean AssetIndex::Build(const std::string &directory)
+{
+	std::vector<std::string> files;
+	ListFiles(directory, files);
+	this->entries.clear();
+	this->entries.resize(files.size());
+	for (GLuint i = 0; i < files.size(); i++)
+		this->entries[i].path = files[i];
+
+	std::vector<GLboolean> indexed(files.size(), GL_FALSE);
+	std::function<void(GLuint)> job = [this, &indexed](GLuint i) { indexed[i] = indexFile(&this->entries[i]); };
+	if (nullptr != ThreadPool::GetPointerInstance())
+		ThreadPool::GetInstance().ParallelFor((GLuint)files.size(), job);
+	else
+	{
+		for (GLuint i = 0; i < files.size(); i++)
+			job(i);
+	}
+
+	//Files that could not be parsed are left out
+	GLuint count = 0;
+	for (GLuint i = 0; i < this->entries.size(); i++)
+	{
+		if (indexed[i])
+			this->entries[count++] = std::move(this->entries[i]);
+	}
+	this->entries.resize(count);
+	return GL_TRUE;
+}
+
+GLboolean AssetIndex::Write(const std::string &indexPath)
+{
+	std::ofstream stream(indexPath, std::ios::out | std::ios::binary);
+	if (!stream.is_open())
+	{
+		std::cout << "ASSET_INDEX::WRITE Message: Could not open " << indexPath << std::endl;
+		return GL_FALSE;
+	}
+	GLuint version = ASSET_INDEX_VERSION;
+	GLuint count = (GLuint)this->entries.size();
+	stream.write(ASSET_INDEX_MAGIC, 4);
+	stream.write((const char*)&version, sizeof(version));
+	stream.write((const char*)&count, sizeof(count));
+	for (GLuint i = 0; i < count; i++)
+	{
+		AssetEntry *entry = &this->entries[i];
+		GLuint length = (GLuint)entry->path.size();
+		stream.write((const char*)&length, sizeof(length));
+		stream.write(entry->path.data(), length);
+		stream.write((const char*)&entry->sourceHash, sizeof(entry->sourceHash));
+		stream.write((const char*)&entry->scenesCount, sizeof(entry->scenesCount));
+		stream.write((const char*)&entry->nodesCount, sizeof(entry->nodesCount));
+		stream.write((const char*)&entry->meshesCount, sizeof(entry->meshesCount));
+		stream.write((const char*)&entry->materialsCount, sizeof(entry->materialsCount));
+		stream.write((const char*)&entry->verticesCount, sizeof(entry->verticesCount));
+		stream.write((const char*)&entry->indicesCount, sizeof(entry->indicesCount));
+		stream.write((const char*)entry->bounds.bounds, sizeof(entry->bounds.bounds));
+		for (GLuint j = 0; j < entry->nodesCount; j++)
+			stream.write((const char*)entry->nodeBounds[j].bounds, sizeof(entry->nodeBounds[j].bounds));
+	}
+	return stream.good() ? GL_TRUE : GL_FALSE;
+}
+
+GLboolean AssetIndex::Read(const std::string &indexPath)
+{
+	std::ifstream stream(indexPath, std::ios::in | std::ios::binary);
+	char magic[4];
+	GLuint version = 0, count = 0;
+	stream.read(magic, 4);
+	stream.read((char*)&version, sizeof(version));
+	stream.read((char*)&count, sizeof(count));
+	if (!stream.good() || 0 != std::memcmp(magic, ASSET_INDEX_MAGIC, 4) || ASSET_INDEX_VERSION != version)
+	{
+		std::cout << "ASSET_INDEX::READ Message: " << indexPath << " is not an asset index of this version." << std::endl;
+		return GL_FALSE;
+	}
+
+	this->entries.clear();
+	this->entries.resize(count);
+	for (GLuint i = 0; i < count && stream.good(); i++)
+	{
+		AssetEntry *entry = &this->entries[i];
+		GLuint length = 0;
+		stream.read((char*)&length, sizeof(length));
+		entry->path.resize(length);
+		stream.read(&entry->path[0], length);
+		stream.read((char*)&entry->sourceHash, sizeof(entry->sourceHash));
+		stream.read((char*)&entry->scenesCount, sizeof(entry->scenesCount));
+		stream.read((char*)&entry->nodesCount, sizeof(entry->nodesCount));
+		stream.read((char*)&entry->meshesCount, sizeof(entry->meshesCount));
+		stream.read((char*)&entry->materialsCount, sizeof(entry->materialsCount));
+		stream.read((char*)&entry->verticesCount, sizeof(entry->verticesCount));
+		stream.read((char*)&entry->indicesCount, sizeof(entry->indicesCount));
+		stream.read((char*)entry->bounds.bounds, sizeof(entry->bounds.bounds));
+		entry->nodeBounds.resize(entry->nodesCount);
+		for (GLuint j = 0; j < entry->nodesCount; j++)
+			stream.read((char*)entry->nodeBounds[j].bounds, sizeof(entry->nodeBounds[j].bounds));
+	}
+	if (!stream.good())
+	{
+		std::cout << "ASSET_INDEX::READ Message: " << indexPath << " is truncated." << std::endl;
+		this->entries.clear();
+		return GL_FALSE;
+	}
+	return GL_TRUE;
+}
+
+const AssetEntry *AssetIndex::Find(const std::string &path)
+{
+	for (GLuint i = 0; i < this->entries.size(); i++)
+	{
+		if (path == this->entries[i].path)
+			return &this->entries[i];
+	}
+	return nullptr;
+}
+
+std::vector<const AssetEntry*> AssetIndex::Query(const std::function<GLboolean(const AssetEntry&)> &predicate)
+{
+	std::vector<const AssetEntry*> result;
+	for (GLuint i = 0; i < this->entries.size(); i++)
+	{
+		if (predicate(this->entries[i]))
+			result.push_back(&this->entries[i]);
+	}
+	return result;
+}
+
+void AssetIndex::ListFiles(const std::string &directory, std::vector<std::string> &files, const std::string &extension)
+{
+	DIR *dir = opendir(directory.c_str());
+	if (nullptr == dir)
+		return;
+	struct dirent *entry;
+	while (nullptr != (entry = readdir(dir)))
+	{
+		std::string name = entry->d_name;
+		if ("." == name || ".." == name)
+			continue;
+		std::string path = directory + "\\" + name;
+		if (DT_DIR == entry->d_type)
+			ListFiles(path, files, extension);
+		else if (name.size() >= extension.size() && 0 == name.compare(name.size() - extension.size(), extension.size(), extension))
+			files.push_back(path);
+	}
+	closedir(dir);
+}
+
+static void hashFile(XXH3_state_t *state, const std::string &path)
+{
+	std::ifstream stream(path, std::ios::in | std::ios::binary);
+	std::vector<char> chunk(64 * 1024);
+	while (stream.good())
+	{
+		stream.read(chunk.data(), chunk.size());
+		XXH3_64bits_update(state, chunk.data(), (size_t)stream.gcount());
+	}
+}
+
+GLboolean AssetIndex::indexFile(AssetEntry *entry)
+{
+	std::ifstream stream(entry->path, std::ios::in | std::ios::binary);
+	std::stringstream content;
+	content << stream.rdbuf();
+	std::string file = content.str();
+
+	rapidjson::Document json;
+	json.Parse(file.c_str());
+	if (json.HasParseError() || !json.HasMember("nodes") || !json.HasMember("meshes") || !json.HasMember("accessors"))
+	{
+		std::cout << "ASSET_INDEX::PARSE Message: Could not index " << entry->path << std::endl;
+		return GL_FALSE;
+	}
+	std::string fileDir = entry->path.substr(0, entry->path.find_last_of('\\'));
+
+	XXH3_state_t *state = XXH3_createState();
+	XXH3_64bits_reset(state);
+	XXH3_64bits_update(state, file.data(), file.size());
+	if (json.HasMember("buffers"))
+	{
+		rapidjson::Value &buffers = json["buffers"];
+		for (GLuint i = 0; i < buffers.Size(); i++)
+		{
+			if (buffers[i].HasMember("uri"))
+				hashFile(state, fileDir + "\\" + buffers[i]["uri"].GetString());
+		}
+	}
+	entry->sourceHash = XXH3_64bits_digest(state);
+	XXH3_freeState(state);
+
+	rapidjson::Value &accessors = json["accessors"];
+	rapidjson::Value &meshes = json["meshes"];
+	rapidjson::Value &nodes = json["nodes"];
+	entry->scenesCount = json.HasMember("scenes") ? json["scenes"].Size() : 0;
+	entry->materialsCount = json.HasMember("materials") ? json["materials"].Size() : 0;
+	entry->meshesCount = meshes.Size();
+	entry->nodesCount = nodes.Size();
+
+	//Bounds of each mesh from the POSITION accessors' min and max
+	std::vector<Box> meshBounds(entry->meshesCount);
+	for (GLuint i = 0; i < entry->meshesCount; i++)
+	{
+		if (!meshes[i].HasMember("primitives"))
+			continue;
+		rapidjson::Value &primitives = meshes[i]["primitives"];
+		for (GLuint j = 0; j < primitives.Size(); j++)
+		{
+			if (primitives[j].HasMember("indices") && primitives[j]["indices"].GetUint() < accessors.Size())
+				entry->indicesCount += accessors[primitives[j]["indices"].GetUint()]["count"].GetUint();
+			if (!primitives[j].HasMember("attributes") || !primitives[j]["attributes"].HasMember("POSITION"))
+				continue;
+			GLuint position = primitives[j]["attributes"]["POSITION"].GetUint();
+			if (position >= accessors.Size())
+				continue;
+			rapidjson::Value &accessor = accessors[position];
+			entry->verticesCount += accessor["count"].GetUint();
+			if (!accessor.HasMember("min") || !accessor.HasMember("max"))
+				continue;
+			for (GLuint k = 0; k < 3; k++)
+			{
+				meshBounds[i].bounds[0][k] = std::min(meshBounds[i].bounds[0][k], accessor["min"][k].GetFloat());
+				meshBounds[i].bounds[1][k] = std::max(meshBounds[i].bounds[1][k], accessor["max"][k].GetFloat());
+			}
+		}
+	}
+
+	//Translation and scale of every node down from the roots, the same transforms the loader applies
+	std::vector<GLboolean> isChild(entry->nodesCount, GL_FALSE);
+	for (GLuint i = 0; i < entry->nodesCount; i++)
+	{
+		if (!nodes[i].HasMember("children"))
+			continue;
+		for (GLuint j = 0; j < nodes[i]["children"].Size(); j++)
+		{
+			if (nodes[i]["children"][j].GetUint() < entry->nodesCount)
+				isChild[nodes[i]["children"][j].GetUint()] = GL_TRUE;
+		}
+	}
+	std::vector<glm::mat4> worlds(entry->nodesCount, glm::mat4());
+	std::vector<GLuint> stack;
+	for (GLuint i = 0; i < entry->nodesCount; i++)
+	{
+		if (!isChild[i])
+			stack.push_back(i);
+	}
+	entry->nodeBounds.assign(entry->nodesCount, Box());
+	std::vector<GLboolean> visited(entry->nodesCount, GL_FALSE);
+	while (!stack.empty())
+	{
+		GLuint node = stack.back();
+		stack.pop_back();
+		if (visited[node])
+			continue;
+		visited[node] = GL_TRUE;
+		glm::mat4 local;
+		if (nodes[node].HasMember("matrix") && 16 == nodes[node]["matrix"].Size())
+		{
+			GLfloat *matrix = (GLfloat*)&local[0];
+			for (GLuint j = 0; j < 16; j++)
+				matrix[j] = nodes[node]["matrix"][j].GetFloat();
+		}
+		else
+		{
+			glm::vec3 translation(0.0f), scale(1.0f);
+			glm::quat rotation(1.0f, 0.0f, 0.0f, 0.0f);
+			if (nodes[node].HasMember("translation"))
+				translation = glm::vec3(nodes[node]["translation"][0].GetFloat(), nodes[node]["translation"][1].GetFloat(), nodes[node]["translation"][2].GetFloat());
+			if (nodes[node].HasMember("rotation"))
+				rotation = glm::normalize(glm::quat(nodes[node]["rotation"][3].GetFloat(), nodes[node]["rotation"][0].GetFloat(), nodes[node]["rotation"][1].GetFloat(), nodes[node]["rotation"][2].GetFloat()));
+			if (nodes[node].HasMember("scale"))
+				scale = glm::vec3(nodes[node]["scale"][0].GetFloat(), nodes[node]["scale"][1].GetFloat(), nodes[node]["scale"][2].GetFloat());
+			local = ComposeTRS(translation, rotation, scale);
+		}
+		//Parents write their world transform in the children's slots before they are popped
+		worlds[node] = worlds[node] * local;
+
+		if (nodes[node].HasMember("children"))
+		{
+			for (GLuint j = 0; j < nodes[node]["children"].Size(); j++)
+			{
+				GLuint child = nodes[node]["children"][j].GetUint();
+				if (child >= entry->nodesCount || visited[child])
+					continue;
+				worlds[child] = worlds[node];
+				stack.push_back(child);
+			}
+		}
+		if (!nodes[node].HasMember("mesh") || nodes[node]["mesh"].GetUint() >= entry->meshesCount)
+			continue;
+		Box *mesh = &meshBounds[nodes[node]["mesh"].GetUint()];
+		if (mesh->bounds[0].x > mesh->bounds[1].x)
+			continue;
+		Box *bounds = &entry->nodeBounds[node];
+		*bounds = TransformBox(*mesh, worlds[node]);
+		entry->bounds.bounds[0] = glm::min(entry->bounds.bounds[0], bounds->bounds[0]);
+		entry->bounds.bounds[1] = glm::max(entry->bounds.bounds[1], bounds->bounds[1]);
+	}
+	return GL_TRUE;
+}
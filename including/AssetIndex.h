@@ -0,0 +1,47 @@
+#pragma once
+#include <glad\glad.h>
+#include <string>
+#include <vector>
+#include <functional>
+
+#include "Box.h"
+
+//Metadata of one glTF file, enough to plan loads without parsing it
+struct AssetEntry
+{
+	std::string path;
+	//Hash of the .gltf and its buffers, changes whenever the file needs indexing again
+	GLuint64 sourceHash;
+	GLuint scenesCount;
+	GLuint nodesCount;
+	GLuint meshesCount;
+	GLuint materialsCount;
+	//Totals over the meshes of the file, instances are counted once
+	GLuint64 verticesCount;
+	GLuint64 indicesCount;
+	Box bounds;
+	//World space bounds of the mesh of every node, an empty box for nodes without mesh
+	std::vector<Box> nodeBounds;
+	AssetEntry() : sourceHash(0), scenesCount(0), nodesCount(0), meshesCount(0), materialsCount(0), verticesCount(0), indicesCount(0) {}
+};
+
+/*Index of every glTF file under a directory, stored in a single file*/
+class AssetIndex
+{
+public:
+	std::vector<AssetEntry> entries;
+
+	//Scans directory and its subdirectories for .gltf files, the files are indexed in parallel on the ThreadPool when it's started
+	GLboolean Build(const std::string &directory);
+	GLboolean Write(const std::string &indexPath);
+	GLboolean Read(const std::string &indexPath);
+
+	const AssetEntry *Find(const std::string &path);
+	std::vector<const AssetEntry*> Query(const std::function<GLboolean(const AssetEntry&)> &predicate);
+
+	//Appends the path of every file ending in extension under directory and its subdirectories, every file when extension is empty
+	static void ListFiles(const std::string &directory, std::vector<std::string> &files, const std::string &extension = ".gltf");
+
+private:
+	static GLboolean indexFile(AssetEntry *entry);
+};
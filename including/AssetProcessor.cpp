@@ -0,0 +1,361 @@
+#include "AssetProcessor.h"
+#include "AssetIndex.h"
+#include "GlbWriter.h"
+#include "Load.h"
+#include "MeshOptimize.h"
+#include "ThreadPool.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <mutex>
+#include <memory>
+
+#define MESHLETS_MAGIC "MSHL"
+#define MESHLETS_VERSION 1
+#define LOD_BASE_GRID 64
+
+static GLuint64 fileSize(const std::string &path)
+{
+	std::ifstream stream(path, std::ios::in | std::ios::binary | std::ios::ate);
+	return stream.is_open() ? (GLuint64)stream.tellg() : 0;
+}
+
+static std::string outputName(const std::string &path, const ProcessOptions &options)
+{
+	size_t slash = path.find_last_of("\\/");
+	std::string name = std::string::npos == slash ? path : path.substr(slash + 1);
+	size_t dot = name.find_last_of('.');
+	if (std::string::npos != dot)
+		name = name.substr(0, dot);
+	return options.outputDirectory + "\\" + name;
+}
+
+static GLfloat averageACMR(glTFFile *file)
+{
+	GLfloat misses = 0.0f;
+	GLuint64 triangles = 0;
+	for (GLuint i = 0; i < file->meshesCount; i++)
+	{
+		for (GLuint j = 0; j < file->meshes[i].primitivesCount; j++)
+		{
+			Primitive *primitive = &file->meshes[i].primitives[j];
+			misses += GetACMR(primitive) * (primitive->indicesCount / 3);
+			triangles += primitive->indicesCount / 3;
+		}
+	}
+	return 0 == triangles ? 0.0f : misses / triangles;
+}
+
+static void recomputeBounds(glTFFile *file)
+{
+	for (GLuint i = 0; i < file->meshesCount; i++)
+	{
+		Mesh *mesh = &file->meshes[i];
+		for (GLuint j = 0; j < mesh->primitivesCount; j++)
+		{
+			Primitive *primitive = &mesh->primitives[j];
+			Box box;
+			for (GLuint k = 0; k < primitive->verticesCount; k++)
+			{
+				box.bounds[0] = glm::min(box.bounds[0], primitive->vertices[k].position);
+				box.bounds[1] = glm::max(box.bounds[1], primitive->vertices[k].position);
+			}
+			mesh->boundingBoxes[j] = box;
+		}
+	}
+	for (GLuint i = 0; i < file->nodesCount; i++)
+	{
+		Node *node = &file->nodes[i];
+		if (!node->hasMesh || node->mesh >= file->meshesCount)
+			continue;
+		Mesh *mesh = &file->meshes[node->mesh];
+		node->localBoundingBox = Box();
+		for (GLuint j = 0; j < mesh->primitivesCount; j++)
+		{
+			node->localBoundingBox.bounds[0] = glm::min(node->localBoundingBox.bounds[0], mesh->boundingBoxes[j].bounds[0]);
+			node->localBoundingBox.bounds[1] = glm::max(node->localBoundingBox.bounds[1], mesh->boundingBoxes[j].bounds[1]);
+		}
+	}
+	file->setup();
+}
+
+static GLboolean writeMeshlets(glTFFile *file, const std::string &path, const ProcessOptions &options, GLuint64 &meshletsCount)
+{
+	std::ofstream stream(path, std::ios::out | std::ios::binary);
+	if (!stream.is_open())
+	{
+		std::cout << "ASSET_PROCESSOR::MESHLETS Message: Could not open " << path << std::endl;
+		return GL_FALSE;
+	}
+	GLuint version = MESHLETS_VERSION;
+	GLuint primitivesCount = 0;
+	for (GLuint i = 0; i < file->meshesCount; i++)
+		primitivesCount += file->meshes[i].primitivesCount;
+	stream.write(MESHLETS_MAGIC, 4);
+	stream.write((const char*)&version, sizeof(version));
+	stream.write((const char*)&primitivesCount, sizeof(primitivesCount));
+
+	std::vector<Meshlet> meshlets;
+	std::vector<GLuint> vertices;
+	std::vector<GLubyte> triangles;
+	//Primitives in mesh order, each one as its counts followed by the meshlets, their vertex indices and their local triangles
+	for (GLuint i = 0; i < file->meshesCount; i++)
+	{
+		for (GLuint j = 0; j < file->meshes[i].primitivesCount; j++)
+		{
+			BuildMeshlets(&file->meshes[i].primitives[j], options.meshletVertices, options.meshletTriangles, meshlets, vertices, triangles);
+			GLuint counts[3] = { (GLuint)meshlets.size(), (GLuint)vertices.size(), (GLuint)triangles.size() };
+			stream.write((const char*)counts, sizeof(counts));
+			for (GLuint k = 0; k < meshlets.size(); k++)
+			{
+				GLuint ranges[4] = { meshlets[k].vertexOffset, meshlets[k].triangleOffset, meshlets[k].verticesCount, meshlets[k].trianglesCount };
+				stream.write((const char*)ranges, sizeof(ranges));
+				stream.write((const char*)meshlets[k].bounds.bounds, sizeof(meshlets[k].bounds.bounds));
+			}
+			stream.write((const char*)vertices.data(), vertices.size() * sizeof(GLuint));
+			stream.write((const char*)triangles.data(), triangles.size());
+			meshletsCount += meshlets.size();
+		}
+	}
+	return stream.good() ? GL_TRUE : GL_FALSE;
+}
+
+//Swaps the indices of every primitive for a clustered simplification, writes the file and puts the full detail back
+static GLboolean writeLOD(glTFFile *file, const std::string &path, GLuint gridSize, const ProcessOptions &options, const GlbWriteOptions &writeOptions)
+{
+	std::vector<Vertex*> vertices;
+	std::vector<GLuint*> indices;
+	std::vector<GLuint> counts;
+	for (GLuint i = 0; i < file->meshesCount; i++)
+	{
+		for (GLuint j = 0; j < file->meshes[i].primitivesCount; j++)
+		{
+			Primitive *primitive = &file->meshes[i].primitives[j];
+			std::vector<GLuint> simplified = SimplifyClustered(primitive, gridSize);
+			vertices.push_back(primitive->vertices);
+			indices.push_back(primitive->indices);
+			counts.push_back(primitive->verticesCount);
+			counts.push_back(primitive->indicesCount);
+			Vertex *copy = new Vertex[primitive->verticesCount];
+			std::memcpy(copy, primitive->vertices, primitive->verticesCount * sizeof(Vertex));
+			primitive->vertices = copy;
+			primitive->indices = new GLuint[simplified.size()];
+			primitive->indicesCount = (GLuint)simplified.size();
+			std::memcpy(primitive->indices, simplified.data(), simplified.size() * sizeof(GLuint));
+			if (options.cache)
+				OptimizeVertexCache(primitive);
+			OptimizeVertexFetch(primitive);
+		}
+	}
+	GLboolean written = WriteGLB(file, path.c_str(), writeOptions);
+	GLuint k = 0;
+	for (GLuint i = 0; i < file->meshesCount; i++)
+	{
+		for (GLuint j = 0; j < file->meshes[i].primitivesCount; j++, k++)
+		{
+			Primitive *primitive = &file->meshes[i].primitives[j];
+			delete[] primitive->vertices;
+			delete[] primitive->indices;
+			primitive->vertices = vertices[k];
+			primitive->indices = indices[k];
+			primitive->verticesCount = counts[k * 2];
+			primitive->indicesCount = counts[k * 2 + 1];
+		}
+	}
+	return written;
+}
+
+ProcessReport ProcessFile(const std::string &path, const ProcessOptions &options, Loader *loader)
+{
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+	ProcessReport report;
+	report.path = path;
+
+	LoadOptions loadOptions;
+	loadOptions.upload = GL_FALSE;
+	loadOptions.share = GL_FALSE;
+	//Making a Loader sets up its reader, one is only made when the caller has none to lend
+	std::unique_ptr<Loader> owned;
+	if (nullptr == loader)
+	{
+		owned.reset(new Loader());
+		loader = owned.get();
+	}
+	glTFFile *file = loader->LoadFile(path.c_str(), loadOptions);
+	//The loader leaves the file empty when it can't be parsed
+	if (0 == file->nodesCount)
+	{
+		delete file;
+		return report;
+	}
+
+	report.inputBytes = fileSize(path);
+	for (GLuint i = 0; i < file->dependencies.size(); i++)
+	{
+		const std::string &dependency = file->dependencies[i];
+		GLboolean image = GL_FALSE;
+		for (GLuint j = 0; j < file->imagesCount && !image; j++)
+		{
+			const std::string &uri = file->images[j].uri;
+			image = !uri.empty() && dependency.size() > uri.size() && 0 == dependency.compare(dependency.size() - uri.size(), uri.size(), uri);
+		}
+		if (!image)
+			report.inputBytes += fileSize(dependency);
+	}
+
+	std::vector<Primitive*> primitives;
+	for (GLuint i = 0; i < file->meshesCount; i++)
+	{
+		for (GLuint j = 0; j < file->meshes[i].primitivesCount; j++)
+		{
+			primitives.push_back(&file->meshes[i].primitives[j]);
+			report.verticesBefore += file->meshes[i].primitives[j].verticesCount;
+		}
+	}
+	report.acmrBefore = averageACMR(file);
+
+	//The passes of a single file run on its primitives in parallel, the ThreadPool helps whichever file is waiting
+	std::function<void(GLuint)> optimize = [&](GLuint i)
+	{
+		if (options.weld)
+			WeldVertices(primitives[i], options.weldTolerances);
+		if (options.cache)
+		{
+			OptimizeVertexCache(primitives[i]);
+			OptimizeVertexFetch(primitives[i]);
+		}
+	};
+	ThreadPool::GetInstance().ParallelFor((GLuint)primitives.size(), optimize);
+
+	for (GLuint i = 0; i < primitives.size(); i++)
+		report.verticesAfter += primitives[i]->verticesCount;
+	report.acmrAfter = averageACMR(file);
+	if (options.bounds)
+		recomputeBounds(file);
+
+	std::string name = outputName(path, options);
+	//Every .glb is loaded back by the same Loader the runtime uses, a file it can't read fails here instead of in the viewer
+	GlbWriteOptions writeOptions;
+	writeOptions.quantize = options.quantize;
+	writeOptions.verify = loader;
+	report.processed = WriteGLB(file, (name + ".glb").c_str(), writeOptions);
+	report.outputBytes += fileSize(name + ".glb");
+	if (report.processed && options.meshlets)
+	{
+		report.processed = writeMeshlets(file, name + ".meshlets", options, report.meshletsCount);
+		report.outputBytes += fileSize(name + ".meshlets");
+	}
+	for (GLuint level = 1; report.processed && level <= options.lodLevels; level++)
+	{
+		GLuint gridSize = LOD_BASE_GRID >> (level - 1);
+		if (gridSize < 2)
+			break;
+		std::ostringstream lodName;
+		lodName << name << ".lod" << level << ".glb";
+		report.processed = writeLOD(file, lodName.str(), gridSize, options, writeOptions);
+		report.outputBytes += fileSize(lodName.str());
+	}
+	delete file;
+
+	std::chrono::duration<GLdouble, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+	report.milliseconds = elapsed.count();
+	return report;
+}
+
+static void printReport(const ProcessReport &report)
+{
+	if (!report.processed)
+	{
+		std::cout << report.path << ": failed" << std::endl;
+		return;
+	}
+	GLdouble saved = 0 == report.inputBytes ? 0.0 : 100.0 * ((GLdouble)report.inputBytes - (GLdouble)report.outputBytes) / report.inputBytes;
+	std::cout << report.path << ": " << report.inputBytes << " -> " << report.outputBytes << " bytes (" << std::fixed << std::setprecision(1) << saved << "% saved), "
+		<< report.verticesBefore << " -> " << report.verticesAfter << " vertices, ACMR " << std::setprecision(3) << report.acmrBefore << " -> " << report.acmrAfter;
+	if (report.meshletsCount > 0)
+		std::cout << ", " << report.meshletsCount << " meshlets";
+	std::cout << std::setprecision(1) << ", " << report.milliseconds << "ms" << std::endl;
+}
+
+int RunAssetProcessor(int argc, char **argv)
+{
+	if (argc < 3)
+	{
+		std::cout << "Usage: " << argv[0] << " <file.gltf | directory> <output directory> [-weld] [-cache] [-bounds] [-meshlets] [-quantize] [-lod levels] [-all]" << std::endl;
+		return 1;
+	}
+	std::string input = argv[1];
+	ProcessOptions options;
+	options.outputDirectory = argv[2];
+	for (GLint i = 3; i < argc; i++)
+	{
+		std::string flag = argv[i];
+		GLboolean all = "-all" == flag;
+		options.weld = options.weld || all || "-weld" == flag;
+		options.cache = options.cache || all || "-cache" == flag;
+		options.bounds = options.bounds || all || "-bounds" == flag;
+		options.meshlets = options.meshlets || all || "-meshlets" == flag;
+		options.quantize = options.quantize || all || "-quantize" == flag;
+		if (all)
+			options.lodLevels = 3;
+		if ("-lod" == flag && i + 1 < argc)
+			options.lodLevels = (GLuint)std::strtoul(argv[++i], nullptr, 10);
+	}
+
+	std::vector<std::string> files;
+	if (input.size() > 5 && 0 == input.compare(input.size() - 5, 5, ".gltf"))
+		files.push_back(input);
+	else
+		AssetIndex::ListFiles(input, files);
+	if (files.empty())
+	{
+		std::cout << "ASSET_PROCESSOR::INPUT Message: No .gltf files found in " << input << std::endl;
+		return 1;
+	}
+
+	if (ThreadPool::StartModule(NULL))
+		return 1;
+	std::vector<ProcessReport> reports(files.size());
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+	//Loaders are handed to the files being processed and returned after, so there is about one per thread
+	//and the scratch memory of a file is reused by the next
+	std::mutex loadersMutex;
+	std::vector<Loader*> loaders, idle;
+	ThreadPool::GetInstance().ParallelFor((GLuint)files.size(), [&](GLuint i)
+	{
+		Loader *loader;
+		{
+			std::lock_guard<std::mutex> lock(loadersMutex);
+			if (idle.empty())
+			{
+				loaders.push_back(new Loader());
+				idle.push_back(loaders.back());
+			}
+			loader = idle.back();
+			idle.pop_back();
+		}
+		reports[i] = ProcessFile(files[i], options, loader);
+		std::lock_guard<std::mutex> lock(loadersMutex);
+		idle.push_back(loader);
+	});
+	std::chrono::duration<GLdouble, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+	ThreadPool::CloseModule();
+	for (GLuint i = 0; i < loaders.size(); i++)
+		delete loaders[i];
+
+	GLuint failed = 0;
+	GLuint64 inputBytes = 0, outputBytes = 0;
+	for (GLuint i = 0; i < reports.size(); i++)
+	{
+		printReport(reports[i]);
+		failed += reports[i].processed ? 0 : 1;
+		inputBytes += reports[i].processed ? reports[i].inputBytes : 0;
+		outputBytes += reports[i].processed ? reports[i].outputBytes : 0;
+	}
+	std::cout << reports.size() - failed << " of " << reports.size() << " files processed, " << inputBytes << " -> " << outputBytes << " bytes in " << std::fixed << std::setprecision(1) << elapsed.count() << "ms" << std::endl;
+	return 0 == failed ? 0 : 1;
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <glad\glad.h>
+#include <string>
+
+#include "VertexWeld.h"
+
+class Loader;
+
+//Passes run on every processed file, in the order they are declared
+struct ProcessOptions
+{
+	GLboolean weld;
+	WeldTolerances weldTolerances;
+	//Reorders the triangles for the post transform cache and the vertices for fetch locality
+	GLboolean cache;
+	//Recomputes the primitive and node bounds from the final vertices
+	GLboolean bounds;
+	//Writes the meshlets of every primitive next to the output as name.meshlets
+	GLboolean meshlets;
+	GLuint meshletVertices;
+	GLuint meshletTriangles;
+	//Writes the output with KHR_mesh_quantization
+	GLboolean quantize;
+	//Simplified versions written as name.lod1.glb, name.lod2.glb... each one with half the grid resolution of the previous
+	GLuint lodLevels;
+	std::string outputDirectory;
+	ProcessOptions() : weld(GL_FALSE), cache(GL_FALSE), bounds(GL_FALSE), meshlets(GL_FALSE), meshletVertices(64), meshletTriangles(124), quantize(GL_FALSE), lodLevels(0), outputDirectory(".") {}
+};
+
+struct ProcessReport
+{
+	std::string path;
+	GLboolean processed;
+	//.gltf and buffers read, images are not counted since they are referenced by the output as they are
+	GLuint64 inputBytes;
+	//Every file written
+	GLuint64 outputBytes;
+	GLuint64 verticesBefore;
+	GLuint64 verticesAfter;
+	GLfloat acmrBefore;
+	GLfloat acmrAfter;
+	GLuint64 meshletsCount;
+	GLdouble milliseconds;
+	ProcessReport() : processed(GL_FALSE), inputBytes(0), outputBytes(0), verticesBefore(0), verticesAfter(0), acmrBefore(0.0f), acmrAfter(0.0f), meshletsCount(0), milliseconds(0.0) {}
+};
+
+//Loads path without touching GL, runs the passes and writes name.glb to options.outputDirectory.
+//loader keeps its scratch memory for the next file, a Loader is made for the call when it's null
+ProcessReport ProcessFile(const std::string &path, const ProcessOptions &options, Loader *loader = nullptr);
+
+//Command line entry point, no window or GL context is created:
+//including <file.gltf | directory> <output directory> [-weld] [-cache] [-bounds] [-meshlets] [-quantize] [-lod levels] [-all]
+//Files are processed in parallel on the ThreadPool and a report of the savings is printed for each one
+int RunAssetProcessor(int argc, char **argv);
@@ -0,0 +1,137 @@
+#include "AssetWatcher.h"
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <algorithm>
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+AssetWatcher::AssetWatcher() :
+	pollIntervalMs(250)
+{
+	this->mLastPoll = std::chrono::steady_clock::now();
+#ifdef __linux__
+	this->mNotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+}
+
+AssetWatcher::~AssetWatcher()
+{
+#ifdef __linux__
+	if (this->mNotify >= 0)
+		close(this->mNotify);
+#endif
+}
+
+void AssetWatcher::Watch(const std::string &path)
+{
+	std::map<std::string, WatchedFile>::iterator it = this->mFiles.find(path);
+	if (it != this->mFiles.end())
+	{
+		it->second.references++;
+		return;
+	}
+	WatchedFile file;
+	file.references = 1;
+	file.modified = modifiedTime(path);
+	this->mFiles[path] = file;
+
+#ifdef __linux__
+	//Editors usually save through a temporary file and a rename, so the directory is watched instead of the file
+	std::string directory = directoryOf(path);
+	if (this->mNotify >= 0 && this->mDirectories.find(directory) == this->mDirectories.end())
+		this->mDirectories[directory] = inotify_add_watch(this->mNotify, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+#endif
+}
+
+void AssetWatcher::Unwatch(const std::string &path)
+{
+	std::map<std::string, WatchedFile>::iterator it = this->mFiles.find(path);
+	if (it == this->mFiles.end() || --it->second.references > 0)
+		return;
+	this->mFiles.erase(it);
+
+#ifdef __linux__
+	std::string directory = directoryOf(path);
+	for (it = this->mFiles.begin(); it != this->mFiles.end(); it++)
+	{
+		if (directoryOf(it->first) == directory)
+			return;
+	}
+	std::map<std::string, GLint>::iterator dir = this->mDirectories.find(directory);
+	if (dir != this->mDirectories.end())
+	{
+		if (dir->second >= 0)
+			inotify_rm_watch(this->mNotify, dir->second);
+		this->mDirectories.erase(dir);
+	}
+#endif
+}
+
+std::vector<std::string> AssetWatcher::Poll()
+{
+	std::vector<std::string> changed;
+#ifdef __linux__
+	if (this->mNotify >= 0)
+	{
+		alignas(inotify_event) char events[4096];
+		ssize_t read;
+		while ((read = ::read(this->mNotify, events, sizeof(events))) > 0)
+		{
+			for (char *ptr = events; ptr < events + read; ptr += sizeof(inotify_event) + ((inotify_event*)ptr)->len)
+			{
+				inotify_event *event = (inotify_event*)ptr;
+				if (0 == event->len)
+					continue;
+				for (std::map<std::string, GLint>::iterator dir = this->mDirectories.begin(); dir != this->mDirectories.end(); dir++)
+				{
+					if (dir->second != event->wd)
+						continue;
+					std::string path = "." == dir->first ? event->name : dir->first + "/" + event->name;
+					//Watched paths may use either separator
+					for (std::map<std::string, WatchedFile>::iterator it = this->mFiles.begin(); it != this->mFiles.end(); it++)
+					{
+						std::string normalized = it->first;
+						std::replace(normalized.begin(), normalized.end(), '\\', '/');
+						if (normalized == path && std::find(changed.begin(), changed.end(), it->first) == changed.end())
+							changed.push_back(it->first);
+					}
+				}
+			}
+		}
+		return changed;
+	}
+#endif
+
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	if (std::chrono::duration_cast<std::chrono::milliseconds>(now - this->mLastPoll).count() < this->pollIntervalMs)
+		return changed;
+	this->mLastPoll = now;
+	for (std::map<std::string, WatchedFile>::iterator it = this->mFiles.begin(); it != this->mFiles.end(); it++)
+	{
+		GLint64 modified = modifiedTime(it->first);
+		if (modified != it->second.modified)
+		{
+			it->second.modified = modified;
+			changed.push_back(it->first);
+		}
+	}
+	return changed;
+}
+
+std::string AssetWatcher::directoryOf(const std::string &path)
+{
+	std::string normalized = path;
+	std::replace(normalized.begin(), normalized.end(), '\\', '/');
+	size_t separator = normalized.find_last_of('/');
+	return std::string::npos == separator ? "." : normalized.substr(0, separator);
+}
+
+GLint64 AssetWatcher::modifiedTime(const std::string &path)
+{
+	struct stat info;
+	if (0 != stat(path.c_str(), &info))
+		return -1;
+	return (GLint64)info.st_mtime;
+}
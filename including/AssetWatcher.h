@@ -0,0 +1,41 @@
+#pragma once
+#include <glad\glad.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+
+/*Reports files changed on disk. Uses inotify on Linux, elsewhere the modification times are polled*/
+class AssetWatcher
+{
+public:
+	//Minimum time between two scans of the modification times when inotify is not available
+	GLuint pollIntervalMs;
+
+	AssetWatcher();
+	~AssetWatcher();
+
+	void Watch(const std::string &path);
+	void Unwatch(const std::string &path);
+
+	//Returns the watched paths modified since the last call, each path once
+	std::vector<std::string> Poll();
+
+private:
+	struct WatchedFile
+	{
+		GLuint references;
+		GLint64 modified;
+	};
+
+	std::map<std::string, WatchedFile> mFiles;
+	std::chrono::steady_clock::time_point mLastPoll;
+#ifdef __linux__
+	GLint mNotify;
+	//Watch descriptor of every directory holding a watched file
+	std::map<std::string, GLint> mDirectories;
+#endif
+
+	static std::string directoryOf(const std::string &path);
+	static GLint64 modifiedTime(const std::string &path);
+};
@@ -0,0 +1,269 @@
+#include "AsyncReader.h"
+#include "ThreadPool.h"
+#include <fstream>
+#include <map>
+#include <deque>
+#include <algorithm>
+#include <cstdint>
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<liburing.h>)
+#define ASYNC_READER_IO_URING
+#include <liburing.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <iostream>
+#endif
+#endif
+
+#define ASYNC_READER_QUEUE_DEPTH 64
+//Larger reads are split, a single io_uring read is limited to 2GB
+#define ASYNC_READER_MAX_CHUNK (256ull * 1024 * 1024)
+
+AsyncReader::AsyncReader() : mRing(nullptr)
+{
+#ifdef ASYNC_READER_IO_URING
+	struct io_uring *ring = new struct io_uring;
+	//Kernels without io_uring, or with it disabled, fall back to the ThreadPool
+	if (0 == io_uring_queue_init(ASYNC_READER_QUEUE_DEPTH, ring, 0))
+		this->mRing = ring;
+	else
+		delete ring;
+#endif
+}
+
+AsyncReader::~AsyncReader()
+{
+#ifdef ASYNC_READER_IO_URING
+	if (nullptr != this->mRing)
+	{
+		io_uring_queue_exit((struct io_uring*)this->mRing);
+		delete (struct io_uring*)this->mRing;
+	}
+#endif
+}
+
+void AsyncReader::Read(std::vector<FileRead> &reads, const std::function<void(GLuint)> &completed)
+{
+	if (reads.empty())
+		return;
+	if (nullptr != this->mRing)
+		this->readIoUring(reads, completed);
+	else
+		this->readThreadPool(reads, completed);
+}
+
+void AsyncReader::readIoUring(std::vector<FileRead> &reads, const std::function<void(GLuint)> &completed)
+{
+#ifdef ASYNC_READER_IO_URING
+	struct io_uring *ring = (struct io_uring*)this->mRing;
+	GLuint count = (GLuint)reads.size();
+	GLuint finished = 0;
+
+	//Each file is opened once for the whole batch, reads of files that can't be opened complete right away
+	std::map<std::string, GLint> descriptors;
+	std::vector<GLint> files(count);
+	for (GLuint i = 0; i < count; i++)
+	{
+		std::map<std::string, GLint>::iterator found = descriptors.find(reads[i].path);
+		if (descriptors.end() == found)
+			found = descriptors.insert(std::make_pair(reads[i].path, (GLint)open(reads[i].path.c_str(), O_RDONLY))).first;
+		files[i] = found->second;
+		reads[i].read = 0;
+	}
+
+	GLuint next = 0, inFlight = 0;
+	std::deque<GLuint> resubmit;
+	//Reads the kernel may still be writing to
+	std::vector<GLboolean> submitted(count, GL_FALSE);
+	std::function<GLboolean(GLuint)> submit = [&](GLuint i)
+	{
+		struct io_uring_sqe *sqe = io_uring_get_sqe(ring);
+		if (nullptr == sqe)
+			return GL_FALSE;
+		GLuint64 chunk = std::min<GLuint64>(reads[i].size - reads[i].read, ASYNC_READER_MAX_CHUNK);
+		io_uring_prep_read(sqe, files[i], reads[i].destination + reads[i].read, (unsigned)chunk, reads[i].offset + reads[i].read);
+		io_uring_sqe_set_data(sqe, (void*)(uintptr_t)i);
+		submitted[i] = GL_TRUE;
+		inFlight++;
+		return GL_TRUE;
+	};
+	//Completions carrying count belong to cancel requests. Short reads continue only when resume is set
+	std::function<void(struct io_uring_cqe*, GLboolean)> reap = [&](struct io_uring_cqe *cqe, GLboolean resume)
+	{
+		GLuint i = (GLuint)(uintptr_t)io_uring_cqe_get_data(cqe);
+		GLint result = cqe->res;
+		io_uring_cqe_seen(ring, cqe);
+		if (i >= count)
+			return;
+		submitted[i] = GL_FALSE;
+		inFlight--;
+		if (result > 0)
+			reads[i].read += result;
+		if (resume && result > 0 && reads[i].read < reads[i].size)
+			resubmit.push_back(i);
+		else
+		{
+			completed(i);
+			finished++;
+		}
+	};
+	GLboolean failed = GL_FALSE;
+	while (finished < count)
+	{
+		//Short reads continue first, then new reads while the ring has room
+		while (!resubmit.empty() && inFlight < ASYNC_READER_QUEUE_DEPTH && submit(resubmit.front()))
+			resubmit.pop_front();
+		while (next < count && inFlight < ASYNC_READER_QUEUE_DEPTH)
+		{
+			if (0 > files[next] || 0 == reads[next].size)
+			{
+				completed(next++);
+				finished++;
+				continue;
+			}
+			if (!submit(next))
+				break;
+			next++;
+		}
+		if (0 == inFlight)
+			continue;
+		io_uring_submit(ring);
+
+		struct io_uring_cqe *cqe;
+		GLint waited;
+		//A signal interrupts the wait, not the reads
+		do
+			waited = io_uring_wait_cqe(ring, &cqe);
+		while (-EINTR == waited);
+		if (0 != waited)
+		{
+			failed = GL_TRUE;
+			break;
+		}
+		do
+			reap(cqe, GL_TRUE);
+		while (0 == io_uring_peek_cqe(ring, &cqe));
+	}
+
+	//The destinations belong to the caller once this returns, every read in flight is cancelled and reaped first.
+	//Reads that didn't finish complete short
+	if (failed)
+	{
+		std::cout << "ASYNC_READER::IO_URING Message: Waiting for reads failed, cancelling the " << inFlight << " in flight." << std::endl;
+		GLuint cancels = 0;
+		for (GLuint i = 0; i < count; i++)
+		{
+			if (!submitted[i])
+				continue;
+			struct io_uring_sqe *sqe = io_uring_get_sqe(ring);
+			if (nullptr == sqe)
+			{
+				io_uring_submit(ring);
+				sqe = io_uring_get_sqe(ring);
+			}
+			//Reads left without a cancel still complete on their own and are reaped below
+			if (nullptr == sqe)
+				break;
+			io_uring_prep_cancel(sqe, (void*)(uintptr_t)i, 0);
+			io_uring_sqe_set_data(sqe, (void*)(uintptr_t)count);
+			cancels++;
+		}
+		io_uring_submit(ring);
+		while (0 < inFlight || 0 < cancels)
+		{
+			struct io_uring_cqe *cqe;
+			if (0 != io_uring_wait_cqe(ring, &cqe))
+				continue;
+			if (count == (GLuint)(uintptr_t)io_uring_cqe_get_data(cqe))
+				cancels--;
+			reap(cqe, GL_FALSE);
+		}
+		for (GLuint i : resubmit)
+			completed(i);
+		for (; next < count; next++)
+			completed(next);
+	}
+
+	for (std::map<std::string, GLint>::iterator i = descriptors.begin(); i != descriptors.end(); i++)
+	{
+		if (0 <= i->second)
+			close(i->second);
+	}
+#else
+	this->readThreadPool(reads, completed);
+#endif
+}
+
+//Reads handed out to the ThreadPool fallback. Workers may pick their job after the batch is over, they must find it alive
+struct ThreadPoolReads
+{
+	std::vector<FileRead> *reads;
+	GLuint count;
+	std::atomic<GLuint> next;
+	std::deque<GLuint> landed;
+	std::mutex mutex;
+	std::condition_variable wake;
+};
+
+static GLboolean readNext(const std::shared_ptr<ThreadPoolReads> &batch)
+{
+	GLuint i = batch->next++;
+	if (i >= batch->count)
+		return GL_FALSE;
+	FileRead *read = &(*batch->reads)[i];
+	read->read = 0;
+	std::ifstream stream(read->path, std::ios::in | std::ios::binary);
+	if (stream.is_open())
+	{
+		stream.seekg(read->offset);
+		stream.read((char*)read->destination, read->size);
+		read->read = (GLuint64)stream.gcount();
+	}
+	{
+		std::lock_guard<std::mutex> lock(batch->mutex);
+		batch->landed.push_back(i);
+	}
+	batch->wake.notify_all();
+	return GL_TRUE;
+}
+
+//Reads one file and queues itself again behind the jobs enqueued meanwhile, so work started by the reads that
+//landed, like decodes, runs between reads instead of waiting for the whole batch
+static void readJob(std::shared_ptr<ThreadPoolReads> batch)
+{
+	if (readNext(batch))
+		ThreadPool::GetInstance().Enqueue([batch]() { readJob(batch); });
+}
+
+void AsyncReader::readThreadPool(std::vector<FileRead> &reads, const std::function<void(GLuint)> &completed)
+{
+	std::shared_ptr<ThreadPoolReads> batch = std::make_shared<ThreadPoolReads>();
+	batch->reads = &reads;
+	batch->count = (GLuint)reads.size();
+	batch->next = 0;
+	GLuint count = batch->count;
+
+	ThreadPool *pool = ThreadPool::GetPointerInstance();
+	GLuint helpers = nullptr == pool ? 0 : std::min(count - 1, pool->GetWorkersCount());
+	for (GLuint i = 0; i < helpers; i++)
+		pool->Enqueue([batch]() { readJob(batch); });
+
+	//The calling thread reads too when there's nothing to hand over, so a caller running on a worker can't starve the pool
+	GLuint finished = 0;
+	while (finished < count)
+	{
+		std::deque<GLuint> landed;
+		{
+			std::unique_lock<std::mutex> lock(batch->mutex);
+			landed.swap(batch->landed);
+		}
+		for (GLuint i = 0; i < landed.size(); i++)
+			completed(landed[i]);
+		finished += (GLuint)landed.size();
+		if (!landed.empty() || finished == count || readNext(batch))
+			continue;
+		std::unique_lock<std::mutex> lock(batch->mutex);
+		batch->wake.wait(lock, [&batch] { return !batch->landed.empty(); });
+	}
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <glad\glad.h>
+#include <string>
+#include <vector>
+#include <functional>
+
+struct FileRead
+{
+	std::string path;
+	GLuint64 offset;
+	GLuint64 size;
+	GLubyte *destination;
+	//Bytes read, less than size when the file is shorter or couldn't be opened
+	GLuint64 read;
+	FileRead() : offset(0), size(0), destination(nullptr), read(0) {}
+	FileRead(const std::string &path, GLuint64 offset, GLuint64 size, GLubyte *destination) : path(path), offset(offset), size(size), destination(destination), read(0) {}
+};
+
+/*Reads batches of file ranges with every read in flight at once. Uses io_uring on Linux when the kernel allows it,
+elsewhere the reads are spread over the ThreadPool. An instance must not be used by two threads at the same time*/
+class AsyncReader
+{
+public:
+	AsyncReader();
+	~AsyncReader();
+
+	//Submits every read and calls completed with the index of each one as it lands, in any order. completed runs on the
+	//calling thread, so it can hand the data to other work while the rest of the batch is still being read
+	void Read(std::vector<FileRead> &reads, const std::function<void(GLuint)> &completed);
+
+	GLboolean UsesIoUring() { return nullptr != this->mRing; }
+
+private:
+	//io_uring instance, null when it's not available
+	void *mRing;
+
+	void readIoUring(std::vector<FileRead> &reads, const std::function<void(GLuint)> &completed);
+	void readThreadPool(std::vector<FileRead> &reads, const std::function<void(GLuint)> &completed);
+};
@@ -1,60 +1,42 @@
 #include "Endian.h"
-
-GLshort shortSwap(GLshort value)
-{
-	return ((value & 0xFF) << 8) + ((value >> 8) & 0xFF);
-}
-
-inline GLshort shortNoSwap(GLshort value) { return value; }
-
-GLint intSwap(GLint value)
-{
-	return ((int)((value & 0xFF) << 24) +
-			(int)(((value >> 8) & 0xFF) << 16) +
-			(int)(((value >> 16) & 0xFF) << 8) +
-			(int)((value >> 24) & 0xFF));
-}
-
-inline GLint intNoSwap(GLint value) { return value; }
-
-GLfloat floatSwap(GLfloat value)
+#include <algorithm>
+
+#if defined(__SSSE3__) || defined(__AVX__)
+#define ENDIAN_SSSE3
+#include <tmmintrin.h>
+#elif defined(__VSX__)
+#define ENDIAN_VSX
+#include <altivec.h>
+#endif
+
+//Shuffle masks reversing every 2, 4 and 8 byte element of a 16 byte vector
+static const GLubyte swapMasks[3][16] =
 {
-	union 
-	{
-		GLfloat f;
-		GLubyte b[4];
-	} tmp, result;
-
-	tmp.f = value;
-	result.b[0] = tmp.b[3];
-	result.b[1] = tmp.b[2];
-	result.b[2] = tmp.b[1];
-	result.b[3] = tmp.b[0];
-	return result.f;
-}
+	{ 1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14 },
+	{ 3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12 },
+	{ 7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8 }
+};
 
-inline GLfloat floatNoSwap(GLfloat value) { return value; }
-
-void Endian::Init()
+void Endian::swapBytes(void *data, std::size_t count, std::size_t size)
 {
-	GLbyte endianTest[2] = { 0, 1 };
-	this->mIsBigEndian = 0 == *(GLshort*)endianTest;
-	if (this->mIsBigEndian)
-	{
-		this->bigShort		= shortNoSwap;
-		this->littleShort	= shortSwap;
-		this->bigInt		= intNoSwap;
-		this->littleInt		= intSwap;
-		this->bigFloat		= floatNoSwap;
-		this->littleFloat	= floatSwap;
-	}
-	else
+	GLubyte *bytes = (GLubyte*)data;
+	std::size_t total = count * size;
+	std::size_t i = 0;
+	const GLubyte *mask = swapMasks[2 == size ? 0 : (4 == size ? 1 : 2)];
+#if defined(ENDIAN_SSSE3)
+	__m128i shuffle = _mm_loadu_si128((const __m128i*)mask);
+	for (; i + 16 <= total; i += 16)
+		_mm_storeu_si128((__m128i*)&bytes[i], _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)&bytes[i]), shuffle));
+#elif defined(ENDIAN_VSX)
+	__vector unsigned char shuffle = vec_xl(0, mask);
+	for (; i + 16 <= total; i += 16)
 	{
-		this->bigShort		= shortSwap;
-		this->littleShort	= shortNoSwap;
-		this->bigInt		= intSwap;
-		this->littleInt		= intNoSwap;
-		this->bigFloat		= floatSwap;
-		this->littleFloat	= floatNoSwap;
+		__vector unsigned char block = vec_xl(0, &bytes[i]);
+		vec_xst(vec_perm(block, block, shuffle), 0, &bytes[i]);
 	}
-}
\ No newline at end of file
+#else
+	(void)mask;
+#endif
+	for (; i < total; i += size)
+		std::reverse(&bytes[i], &bytes[i + size]);
+}
@@ -1,19 +1,64 @@
 #pragma once
 #include <glad/glad.h>
+#include <bit>
+#include <span>
+#include <cstddef>
 
+//Byte order of the host is known at compile time, conversions to the native order compile to nothing
 class Endian
 {
 public:
+	static constexpr GLboolean IsBigEndian() { return std::endian::big == std::endian::native; }
 
-	GLshort(*bigShort) (GLshort s);
-	GLshort(*littleShort) (GLshort s);
-	GLint(*bigInt) (GLint i);
-	GLint(*littleInt) (GLint i);
-	GLfloat(*bigFloat) (GLfloat f);
-	GLfloat(*littleFloat) (GLfloat f);
+	//Value stored little endian, as glTF buffers are, in the native order
+	template<typename T>
+	static T Little(T value)
+	{
+		if constexpr (std::endian::little == std::endian::native)
+			return value;
+		else
+			return swap(value);
+	}
+
+	template<typename T>
+	static T Big(T value)
+	{
+		if constexpr (std::endian::big == std::endian::native)
+			return value;
+		else
+			return swap(value);
+	}
+
+	//Converts little endian values in place, T is a 2, 4 or 8 byte scalar
+	template<typename T>
+	static void ConvertLittle(std::span<T> values)
+	{
+		static_assert(2 == sizeof(T) || 4 == sizeof(T) || 8 == sizeof(T), "Only 2, 4 and 8 byte scalars can be converted");
+		if constexpr (std::endian::little != std::endian::native)
+			swapBytes(values.data(), values.size(), sizeof(T));
+	}
+
+	template<typename T>
+	static void ConvertBig(std::span<T> values)
+	{
+		static_assert(2 == sizeof(T) || 4 == sizeof(T) || 8 == sizeof(T), "Only 2, 4 and 8 byte scalars can be converted");
+		if constexpr (std::endian::big != std::endian::native)
+			swapBytes(values.data(), values.size(), sizeof(T));
+	}
 
-	void Init();
-	GLboolean IsBigEndian() { return this->mIsBigEndian; }
 private:
-	GLboolean mIsBigEndian;
+	template<typename T>
+	static T swap(T value)
+	{
+		if constexpr (1 == sizeof(T))
+			return value;
+		else
+		{
+			swapBytes(&value, 1, sizeof(T));
+			return value;
+		}
+	}
+
+	//Reverses the bytes of count elements of size bytes, with vector shuffles where the host has them
+	static void swapBytes(void *data, std::size_t count, std::size_t size);
 };
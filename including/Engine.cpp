@@ -1,7 +1,12 @@
 #include "Engine.h"
 #include "Tools.h"
+#include "ThreadPool.h"
+#include "TextureQueue.h"
+#include "GeometryRegistry.h"
 #include <iostream>
-#include <map>
+#include <cmath>
+#include <algorithm>
+#include <thread>
 
 Engine::Engine()
 {
@@ -35,6 +40,13 @@ ErrorCalls Engine::init(void* /*_init*/)
 	//glEnable(GL_CULL_FACE);
 	//glEnable(GL_MULTISAMPLE);
 
+	if (ThreadPool::StartModule(NULL) || TextureQueue::StartModule(NULL))
+	{
+		std::cout << "Failed to start the texture workers" << std::endl;
+		return ErrorCalls::FAILURE;
+	}
+	GeometryRegistry::StartModule(NULL);
+
 	this->mLoader = new Loader();
 	this->mCamera = new Camera(glm::vec3(0.0f, 0.0f, 3.0f));
 	ConsoleOn = false;
@@ -44,8 +56,26 @@ ErrorCalls Engine::init(void* /*_init*/)
 
 void Engine::release()
 {
+	//Suspended loads continue on the render thread, they are run to their end before the modules they use go
+	for (GLuint i = 0; i < this->mLoadTasks.size(); i++)
+		this->mLoadTasks[i].Cancel();
+	while (0 != LoadTask::GetRunningCount())
+	{
+		if (0 == this->mRenderThread.Process())
+			std::this_thread::yield();
+	}
+	//Files nobody took are deleted by jobs posted when their last handle goes
+	this->mLoadTasks.clear();
+	this->mRenderThread.Process();
 	FREE_MEMORY(mLoader);
 	FREE_MEMORY(mCamera);
+	//init can fail before the modules are started
+	if (nullptr != GeometryRegistry::GetPointerInstance())
+		GeometryRegistry::CloseModule();
+	if (nullptr != TextureQueue::GetPointerInstance())
+		TextureQueue::CloseModule();
+	if (nullptr != ThreadPool::GetPointerInstance())
+		ThreadPool::CloseModule();
 	glfwTerminate();
 }
 
@@ -263,6 +293,33 @@ void Engine::update(GLfloat deltaTime)
 		std::cout << mConsoleBuffer;
 		mConsoleBuffer.clear();
 	}
+	std::vector<std::string> changed = this->mWatcher.Poll();
+	std::vector<glTFFile*> reload;
+	for (GLuint i = 0; i < this->mWatchedFiles.size(); i++)
+	{
+		glTFFile *file = this->mWatchedFiles[i];
+		for (GLuint j = 0; j < changed.size(); j++)
+		{
+			if (changed[j] == file->path || std::find(file->dependencies.begin(), file->dependencies.end(), changed[j]) != file->dependencies.end())
+			{
+				reload.push_back(file);
+				break;
+			}
+		}
+	}
+	for (GLuint i = 0; i < reload.size(); i++)
+	{
+		//The dependencies may change with the reload
+		this->UnwatchAsset(reload[i]);
+		this->mLoader->Reload(reload[i]);
+		this->WatchAsset(reload[i]);
+	}
+	this->mRenderThread.Process();
+	this->mLoadTasks.erase(std::remove_if(this->mLoadTasks.begin(), this->mLoadTasks.end(), [](LoadTask &task) { return task.IsDone(); }), this->mLoadTasks.end());
+	//New textures and streamed levels share one upload budget per frame
+	GLuint uploaded = TextureQueue::GetInstance().ProcessUploads(this->textureUploadBudget);
+	GLfloat projectionScale = this->SCR_HEIGHT / (2.0f * std::tan(glm::radians(this->mCamera->Zoom) * 0.5f));
+	TextureQueue::GetInstance().StreamTextures(this->mCamera->Position, projectionScale, uploaded < this->textureUploadBudget ? this->textureUploadBudget - uploaded : 0);
 	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 }
@@ -274,31 +331,28 @@ void Engine::render()
 	
 }
 
-GLint Engine::registerBoundingBox(Box box)
+LoadTask Engine::LoadAsync(const std::string &path, const LoadOptions &options)
 {
-	objectsToColide.push_back(box);
-	return objectsToColide.size() - 1;
+	LoadTask task = ::LoadAsync(this->mLoader, path, options, this->mWorkers, this->mRenderThread);
+	this->mLoadTasks.push_back(task);
+	return task;
 }
 
-GLint Engine::CheckCollision(Ray ray)
+void Engine::WatchAsset(glTFFile *file)
 {
-	std::map<float, GLint> sorted;
-
-	for (GLuint i = 0; i < objectsToColide.size(); i++)
-	{
-		GLfloat distance = glm::length(this->mCamera->Position - ((objectsToColide[i].bounds[0] + objectsToColide[i].bounds[1]) / 2.0f));
-		sorted[distance] = i;
-	}
-
-	for (std::map<float, GLint>::iterator it = sorted.begin(); it != sorted.end(); ++it)
-	{
-		Box test = objectsToColide[it->second];
-		GLboolean collision = test.interect(ray);
-		if (collision)
-		{
-			return it->second;
-		}
-	}
+	this->mWatchedFiles.push_back(file);
+	this->mWatcher.Watch(file->path);
+	for (GLuint i = 0; i < file->dependencies.size(); i++)
+		this->mWatcher.Watch(file->dependencies[i]);
+}
 
-	return -1;
-}
\ No newline at end of file
+void Engine::UnwatchAsset(glTFFile *file)
+{
+	std::vector<glTFFile*>::iterator it = std::find(this->mWatchedFiles.begin(), this->mWatchedFiles.end(), file);
+	if (it == this->mWatchedFiles.end())
+		return;
+	this->mWatchedFiles.erase(it);
+	this->mWatcher.Unwatch(file->path);
+	for (GLuint i = 0; i < file->dependencies.size(); i++)
+		this->mWatcher.Unwatch(file->dependencies[i]);
+}
@@ -1,10 +1,12 @@
 #pragma once
 #include "Load.h"
+#include "LoadTask.h"
 #include <glad\glad.h>
 #include <GLFW\glfw3.h>
 #include <vector>
 #include "Camera.h"
 #include "Module.h"
+#include "AssetWatcher.h"
 /*Program*/
 class Engine : public Module<Engine>
 {
@@ -17,6 +19,11 @@ public:
 	};
 
 	Loader* mLoader;
+	//Executors for LoadAsync, the render thread one runs its continuations in update
+	WorkerExecutor mWorkers;
+	RenderThreadExecutor mRenderThread;
+	//Bytes of decoded textures and streamed mip levels uploaded per frame
+	GLuint textureUploadBudget = 16 * 1024 * 1024;
 
 	Engine();
 	~Engine();
@@ -31,8 +38,14 @@ public:
 	GLboolean keyPressed(int key);
 	GLboolean keyDown(int key);
 	GLboolean mouseButtonPressed(int button);
-	GLint registerBoundingBox(Box box);
-	GLint CheckCollision(Ray ray);
+
+	//Loads path with the engine's loader and executors, the continuations run in update. Loads still running
+	//when the engine is released are cancelled and run to their end first
+	LoadTask LoadAsync(const std::string &path, const LoadOptions &options = LoadOptions());
+
+	//Reloads file whenever it or one of its buffers or images changes on disk
+	void WatchAsset(glTFFile *file);
+	void UnwatchAsset(glTFFile *file);
 
 	void update(GLfloat deltaTime);
 
@@ -64,7 +77,10 @@ private:
 	GLboolean mousePrevState[GLFW_MOUSE_BUTTON_LAST];
 	bool firstMouse = true;
 	Camera *mCamera;
-	std::vector<Box> objectsToColide;
+	AssetWatcher mWatcher;
+	std::vector<glTFFile*> mWatchedFiles;
+	//Handles to the loads started with LoadAsync that haven't ended
+	std::vector<LoadTask> mLoadTasks;
 
 	GLboolean initiWindow();
 
@@ -54,7 +54,7 @@ GLboolean Game::init()
 		return GL_FALSE;
 	}*/
 	Engine::StartModule(NULL);
-	this->bamboo = Engine::GetInstance().mLoader->LoadFile("resources\\models\\bamboo.gltf");
+	this->bambooTask = Engine::GetInstance().LoadAsync("resources\\models\\bamboo.gltf");
 	/*struct dirent **dirp;
 	modelsCount = scandir("D:\\etc\\naturekit\\Models\\glTF format\\", &dirp, [](const struct dirent *dir) 
 	{
@@ -81,15 +81,16 @@ GLboolean Game::init()
 		}
 	}*/
 	//this->bamboo = this->mEngine->mLoader->LoadFile("resources\\models\\bamboo.gltf");
-	for (GLuint i = 0; i < this->bamboo->nodesCount; i++)
-	{
-		Engine::GetInstance().registerBoundingBox(this->bamboo->nodes[i].boundingBox);
-	}
 	basicShader = new Shader("resources/shaders/shader.vs", "resources/shaders/shader.fs");
 	simpleShader = new Shader("resources/shaders/simple.vs", "resources/shaders/simple.fs");
 	pbrShader = new Shader("resources/shaders/PBR.vs", "resources/shaders/PBR.fs");
 
 	pbrShader->use();
+	pbrShader->setInt("baseColorTexture", 0);
+	pbrShader->setInt("metallicRoughnessTexture", 1);
+	pbrShader->setInt("normalTexture", 2);
+	pbrShader->setInt("occlusionTexture", 3);
+	pbrShader->setInt("emissiveTexture", 4);
 	for (GLuint i = 0; i < 4; i++)
 	{
 		pbrShader->setVec3("lightPositions[" + std::to_string(i) + "]", lightPositions[i]);
@@ -144,6 +145,15 @@ void Game::update()
 	Engine::GetInstance().update(this->deltaTime);
 	projection = glm::perspective(glm::radians(Engine::GetInstance().GetCamera()->Zoom), Engine::GetInstance().GetAspectRatio(), Engine::GetInstance().GetNearPlane(), Engine::GetInstance().GetFarPlane());
 	view = Engine::GetInstance().GetCamera()->GetViewMatrix();
+	if (this->bambooTask.IsValid() && this->bambooTask.IsDone())
+	{
+		this->bamboo = this->bambooTask.Take();
+		this->bambooTask = LoadTask();
+		if (nullptr != this->bamboo)
+			Engine::GetInstance().WatchAsset(this->bamboo);
+	}
+	if (nullptr != this->bamboo)
+		this->bamboo->UpdateTransforms();
 }
 
 void Game::render()
@@ -159,11 +169,13 @@ void Game::render()
 	pbrShader->setMat4("projection", this->projection);
 	pbrShader->setMat4("view", this->view);
 	pbrShader->setVec3("camPos", Engine::GetInstance().GetCamera()->Position);
-	this->bamboo->draw(0, pbrShader);
+	if (nullptr != this->bamboo)
+		this->bamboo->Submit(this->renderQueue, 0, pbrShader);
 	for (GLuint i = 0; i < modelsCount; i++)
 	{
-		this->models[i]->draw(0, pbrShader);
+		this->models[i]->Submit(this->renderQueue, 0, pbrShader);
 	}
+	this->renderQueue.Flush(Engine::GetInstance().GetCamera()->Position);
 
 	glBindVertexArray(planeVAO);
 	basicShader->use();
@@ -178,6 +190,11 @@ void Game::release()
 {
 
 	FREE_MEMORY(basicShader);
+	//A load still running is cancelled and its file deleted when the engine is released
+	this->bambooTask.Cancel();
+	this->bambooTask = LoadTask();
+	if (nullptr != this->bamboo)
+		Engine::GetInstance().UnwatchAsset(this->bamboo);
 	FREE_MEMORY(bamboo);
 	FREE_MEMORY(pbrShader);
 	FREE_MEMORY(simpleShader);
@@ -196,10 +213,19 @@ void Game::processInput()
 
 		Ray ray = this->CastRay(x, y);
 
-		GLint index = Engine::GetInstance().CheckCollision(ray);
+		//Node bounds follow the transforms, reloads included
+		GLint index = nullptr == this->bamboo ? -1 : this->bamboo->Pick(ray, Engine::GetInstance().GetCamera()->Position);
 
 		std::cout << index << std::endl;
 	}
+	if (Engine::GetInstance().keyPressed(GLFW_KEY_F3))
+		this->printRenderStats();
+}
+
+void Game::printRenderStats()
+{
+	std::cout << "RENDER::QUEUE Message: " << this->renderQueue.GetDrawsCount() << " draws, " << this->renderQueue.GetStateChanges() << " state changes, "
+		<< this->renderQueue.GetStateChangesAvoided() << " avoided, " << this->renderQueue.GetTotalStateChangesAvoided() << " avoided in total." << std::endl;
 }
 
 Ray Game::CastRay(GLfloat x, GLfloat y)
@@ -28,15 +28,20 @@ private:
 
 	glm::mat4 projection;
 	glm::mat4 view;
-	glTFFile **models, *bamboo;
+	glTFFile **models, *bamboo = nullptr;
+	//Loads bamboo, it's drawn once the task is done
+	LoadTask bambooTask;
 	glTFFile *selectedItem;
 	GLuint modelsCount = 0;
 	Shader *basicShader, *simpleShader, *pbrShader;
 	GLuint planeVAO, triangleVAO;
+	RenderQueue renderQueue;
 
 	void update();
 
 	void processInput();
+	//Draws and state changes of the last frame, printed with F3
+	void printRenderStats();
 
 	void render();
 
@@ -0,0 +1,227 @@
+#include "GeometryRegistry.h"
+#include <cstring>
+#define XXH_INLINE_ALL
+#include <xxhash.h>
+
+GeometryRegistry::GeometryRegistry() :
+	mSavedBytes(0)
+{
+}
+
+GeometryRegistry::~GeometryRegistry()
+{
+}
+
+ErrorCalls GeometryRegistry::init(void* /*_init*/)
+{
+	return ErrorCalls::SUCCESS;
+}
+
+void GeometryRegistry::release()
+{
+	//Files still alive keep pointing to the data, they must be deleted before the registry
+	for (std::unordered_map<GLuint64, SharedGeometry>::iterator it = this->mGeometries.begin(); it != this->mGeometries.end(); it++)
+	{
+		delete[] it->second.vertices;
+		delete[] it->second.indices;
+		if (0 != it->second.VAO)
+		{
+			glDeleteVertexArrays(1, &it->second.VAO);
+			glDeleteBuffers(1, &it->second.VBO);
+			glDeleteBuffers(1, &it->second.EBO);
+		}
+	}
+	this->mGeometries.clear();
+}
+
+GLboolean GeometryRegistry::Share(Primitive *primitive, GLboolean upload)
+{
+	GLuint64 key = hash(primitive);
+	std::unordered_map<GLuint64, SharedGeometry>::iterator it = this->mGeometries.find(key);
+	if (it == this->mGeometries.end())
+	{
+		SharedGeometry geometry;
+		geometry.vertices = primitive->vertices;
+		geometry.indices = primitive->indices;
+		geometry.verticesCount = primitive->verticesCount;
+		geometry.indicesCount = primitive->indicesCount;
+		geometry.VAO = geometry.VBO = geometry.EBO = 0;
+		geometry.references = geometry.vertexUsers = geometry.indexUsers = 1;
+		geometry.verticesCheck[0] = geometry.verticesCheck[1] = geometry.indicesCheck[0] = geometry.indicesCheck[1] = 0;
+		this->mGeometries[key] = geometry;
+		primitive->hash = key;
+		if (upload)
+			this->Upload(primitive);
+		return GL_FALSE;
+	}
+
+	SharedGeometry *geometry = &it->second;
+	//Hash collisions keep their own copy
+	if (!matches(geometry, primitive))
+	{
+		if (upload)
+			primitive->upload();
+		return GL_FALSE;
+	}
+
+	//Arrays dropped by the retention of earlier loads are taken back from this primitive
+	if (nullptr == geometry->vertices)
+		geometry->vertices = primitive->vertices;
+	else
+		delete[] primitive->vertices;
+	if (nullptr == geometry->indices)
+		geometry->indices = primitive->indices;
+	else
+		delete[] primitive->indices;
+	primitive->vertices = geometry->vertices;
+	primitive->indices = geometry->indices;
+	primitive->hash = key;
+	geometry->references++;
+	geometry->vertexUsers++;
+	geometry->indexUsers++;
+	this->mSavedBytes += bytes(primitive);
+	if (upload)
+		this->Upload(primitive);
+	return GL_TRUE;
+}
+
+void GeometryRegistry::Release(Primitive *primitive)
+{
+	std::unordered_map<GLuint64, SharedGeometry>::iterator it = this->mGeometries.find(primitive->hash);
+	if (it != this->mGeometries.end())
+	{
+		SharedGeometry *geometry = &it->second;
+		this->releaseArrays(geometry, primitive, GL_TRUE, GL_TRUE);
+		if (0 == --geometry->references)
+		{
+			if (0 != geometry->VAO)
+			{
+				glDeleteVertexArrays(1, &geometry->VAO);
+				glDeleteBuffers(1, &geometry->VBO);
+				glDeleteBuffers(1, &geometry->EBO);
+			}
+			this->mGeometries.erase(it);
+		}
+		else
+			this->mSavedBytes -= bytes(primitive);
+	}
+	primitive->vertices = nullptr;
+	primitive->indices = nullptr;
+	primitive->verticesCount = primitive->indicesCount = 0;
+	primitive->VAO = primitive->VBO = primitive->EBO = 0;
+	primitive->hash = 0;
+}
+
+void GeometryRegistry::Upload(Primitive *primitive)
+{
+	std::unordered_map<GLuint64, SharedGeometry>::iterator it = this->mGeometries.find(primitive->hash);
+	if (it == this->mGeometries.end())
+		return;
+	SharedGeometry *geometry = &it->second;
+	if (0 == geometry->VAO)
+	{
+		primitive->uploadBuffers();
+		geometry->VAO = primitive->VAO;
+		geometry->VBO = primitive->VBO;
+		geometry->EBO = primitive->EBO;
+		return;
+	}
+	//Buffers the primitive had before it was shared would be lost
+	if (0 != primitive->VAO && primitive->VAO != geometry->VAO)
+		primitive->releaseBuffers();
+	primitive->VAO = geometry->VAO;
+	primitive->VBO = geometry->VBO;
+	primitive->EBO = geometry->EBO;
+}
+
+void GeometryRegistry::Retain(Primitive *primitive, GeometryRetention retention)
+{
+	std::unordered_map<GLuint64, SharedGeometry>::iterator it = this->mGeometries.find(primitive->hash);
+	if (GEOMETRY_KEEP_ALL == retention || it == this->mGeometries.end())
+		return;
+	this->releaseArrays(&it->second, primitive, GL_TRUE, GEOMETRY_DROP_AFTER_UPLOAD == retention);
+}
+
+GLuint64 GeometryRegistry::GetMemoryBytes()
+{
+	GLuint64 total = 0;
+	for (std::unordered_map<GLuint64, SharedGeometry>::iterator it = this->mGeometries.begin(); it != this->mGeometries.end(); it++)
+	{
+		if (nullptr != it->second.vertices)
+			total += it->second.verticesCount * sizeof(Vertex);
+		if (nullptr != it->second.indices)
+			total += it->second.indicesCount * sizeof(GLuint);
+	}
+	return total;
+}
+
+void GeometryRegistry::releaseArrays(SharedGeometry *geometry, Primitive *primitive, GLboolean vertices, GLboolean indices)
+{
+	if (vertices && nullptr != primitive->vertices)
+	{
+		if (0 == --geometry->vertexUsers)
+		{
+			check(geometry->vertices, geometry->verticesCount * sizeof(Vertex), geometry->verticesCheck);
+			delete[] geometry->vertices;
+			geometry->vertices = nullptr;
+		}
+		primitive->vertices = nullptr;
+	}
+	if (indices && nullptr != primitive->indices)
+	{
+		if (0 == --geometry->indexUsers)
+		{
+			check(geometry->indices, geometry->indicesCount * sizeof(GLuint), geometry->indicesCheck);
+			delete[] geometry->indices;
+			geometry->indices = nullptr;
+		}
+		primitive->indices = nullptr;
+	}
+}
+
+GLuint64 GeometryRegistry::hash(const Primitive *primitive)
+{
+	GLuint64 seed = XXH3_64bits(primitive->vertices, primitive->verticesCount * sizeof(Vertex));
+	GLuint64 key = XXH3_64bits_withSeed(primitive->indices, primitive->indicesCount * sizeof(GLuint), seed);
+	//0 marks primitives that own their data
+	return 0 == key ? 1 : key;
+}
+
+GLboolean GeometryRegistry::matches(const SharedGeometry *geometry, const Primitive *primitive)
+{
+	if (geometry->verticesCount != primitive->verticesCount || geometry->indicesCount != primitive->indicesCount)
+		return GL_FALSE;
+	//Arrays dropped by retention are compared through the 128 bit hash kept when they were freed
+	GLuint64 result[2];
+	if (nullptr != geometry->vertices)
+	{
+		if (0 != std::memcmp(geometry->vertices, primitive->vertices, primitive->verticesCount * sizeof(Vertex)))
+			return GL_FALSE;
+	}
+	else
+	{
+		check(primitive->vertices, primitive->verticesCount * sizeof(Vertex), result);
+		if (result[0] != geometry->verticesCheck[0] || result[1] != geometry->verticesCheck[1])
+			return GL_FALSE;
+	}
+	if (nullptr != geometry->indices)
+	{
+		if (0 != std::memcmp(geometry->indices, primitive->indices, primitive->indicesCount * sizeof(GLuint)))
+			return GL_FALSE;
+	}
+	else
+	{
+		check(primitive->indices, primitive->indicesCount * sizeof(GLuint), result);
+		if (result[0] != geometry->indicesCheck[0] || result[1] != geometry->indicesCheck[1])
+			return GL_FALSE;
+	}
+	return GL_TRUE;
+}
+
+void GeometryRegistry::check(const void *data, GLuint64 size, GLuint64 *result)
+{
+	//Seeded so it doesn't share its input with the key
+	XXH128_hash_t digest = XXH3_128bits_withSeed(data, size, 0x9E3779B97F4A7C15ull);
+	result[0] = digest.low64;
+	result[1] = digest.high64;
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <glad\glad.h>
+#include <unordered_map>
+
+#include "Module.h"
+#include "Types.h"
+
+/*Shares the vertices, indices and GL buffers of identical primitives across every loaded file*/
+class GeometryRegistry : public Module<GeometryRegistry>
+{
+public:
+	GeometryRegistry();
+	~GeometryRegistry();
+
+	ErrorCalls init(void* _init);
+	void release();
+
+	//Render thread only. Hashes the data of primitive, when the same data is already registered the primitive's
+	//arrays are freed and it points to the shared copy, otherwise its data becomes the shared copy.
+	//Returns GL_TRUE when an existing copy was reused
+	GLboolean Share(Primitive *primitive, GLboolean upload);
+	//Drops the primitive's reference, the shared data is freed with the last one. Leaves the primitive empty
+	void Release(Primitive *primitive);
+	//Creates the GL buffers of the shared copy on first use and hands them to primitive
+	void Upload(Primitive *primitive);
+	//Stops primitive from using the CPU arrays retention drops, they are freed once no primitive uses them
+	void Retain(Primitive *primitive, GeometryRetention retention);
+
+	GLuint GetSharedCount() { return (GLuint)this->mGeometries.size(); }
+	//Bytes of vertices and indices not duplicated thanks to sharing
+	GLuint64 GetSavedBytes() { return this->mSavedBytes; }
+	//Bytes of vertices and indices held on the CPU by the shared copies
+	GLuint64 GetMemoryBytes();
+
+private:
+	struct SharedGeometry
+	{
+		Vertex *vertices;
+		GLuint *indices;
+		GLuint verticesCount;
+		GLuint indicesCount;
+		GLuint VAO, VBO, EBO;
+		GLuint references;
+		//Primitives still reading vertices and indices, the arrays are freed when they reach 0
+		GLuint vertexUsers;
+		GLuint indexUsers;
+		//128 bit hashes of the arrays taken when they are freed, so later matches are still checked against
+		//something independent of the 64 bit key
+		GLuint64 verticesCheck[2];
+		GLuint64 indicesCheck[2];
+	};
+
+	std::unordered_map<GLuint64, SharedGeometry> mGeometries;
+	GLuint64 mSavedBytes;
+
+	static GLuint64 hash(const Primitive *primitive);
+	static GLboolean matches(const SharedGeometry *geometry, const Primitive *primitive);
+	static void check(const void *data, GLuint64 size, GLuint64 *result);
+	void releaseArrays(SharedGeometry *geometry, Primitive *primitive, GLboolean vertices, GLboolean indices);
+	static GLuint64 bytes(const Primitive *primitive) { return primitive->verticesCount * sizeof(Vertex) + primitive->indicesCount * sizeof(GLuint); }
+};
@@ -0,0 +1,571 @@
+#include "GlbWriter.h"
+#include "Load.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <limits>
+#include <filesystem>
+
+//Byte layout of a primitive inside the binary chunk
+struct PrimitiveLayout
+{
+	GLenum indexType;
+	GLboolean quantizeTexCoords;
+	//indices, position, normal, tangent, texture coordinates
+	GLuint64 offsets[5];
+	GLuint64 sizes[5];
+	GLuint strides[5];
+};
+
+static GLuint64 align4(GLuint64 value)
+{
+	return (value + 3) & ~3ull;
+}
+
+static void writeUint32(std::ofstream &stream, GLuint value)
+{
+	GLubyte bytes[4] = { (GLubyte)value, (GLubyte)(value >> 8), (GLubyte)(value >> 16), (GLubyte)(value >> 24) };
+	stream.write((const char*)bytes, 4);
+}
+
+static void writeString(std::ostringstream &json, const std::string &value)
+{
+	json << '"';
+	for (GLuint i = 0; i < value.size(); i++)
+	{
+		if ('"' == value[i] || '\\' == value[i])
+			json << '\\';
+		json << value[i];
+	}
+	json << '"';
+}
+
+static void writeFloats(std::ostringstream &json, const GLfloat *values, GLuint count)
+{
+	json << '[';
+	for (GLuint i = 0; i < count; i++)
+		json << (i > 0 ? "," : "") << values[i];
+	json << ']';
+}
+
+static GLbyte toSnorm8(GLfloat value)
+{
+	value = value < -1.0f ? -1.0f : (value > 1.0f ? 1.0f : value);
+	return (GLbyte)std::round(value * 127.0f);
+}
+
+static GLboolean closeTo(const GLfloat *a, const GLfloat *b, GLuint count, GLfloat tolerance)
+{
+	for (GLuint c = 0; c < count; c++)
+	{
+		if (std::abs(a[c] - b[c]) > tolerance)
+			return GL_FALSE;
+	}
+	return GL_TRUE;
+}
+
+//Compares file with what the Loader makes of the .glb written from it. Meshes without primitives aren't written.
+//Returns an empty string when they match
+static std::string compareLoaded(glTFFile *file, glTFFile *loaded, const GlbWriteOptions &options)
+{
+	if (0 == loaded->nodesCount)
+		return "it could not be loaded";
+	if (loaded->nodesCount != file->nodesCount || loaded->materialsCount != file->materialsCount)
+		return "its nodes or materials differ";
+	//Floats are written with all their digits, everything but quantized attributes comes back exactly
+	for (GLuint i = 0; i < file->materialsCount; i++)
+	{
+		Material *material = &file->materials[i], *loadedMaterial = &loaded->materials[i];
+		if (!closeTo(&loadedMaterial->color.r, &material->color.r, 4, 0.0f) || loadedMaterial->metallic != material->metallic || loadedMaterial->roughness != material->roughness
+			|| !closeTo(&loadedMaterial->emissive.r, &material->emissive.r, 3, 0.0f) || loadedMaterial->blend != material->blend
+			|| loadedMaterial->baseColorTexture != material->baseColorTexture || loadedMaterial->metallicRoughnessTexture != material->metallicRoughnessTexture
+			|| loadedMaterial->normalTexture != material->normalTexture || loadedMaterial->occlusionTexture != material->occlusionTexture || loadedMaterial->emissiveTexture != material->emissiveTexture)
+			return "its materials differ";
+	}
+	//Meshes are renumbered without the empty ones
+	std::vector<GLint> meshIndices(file->meshesCount, -1);
+	for (GLuint i = 0, written = 0; i < file->meshesCount; i++)
+	{
+		if (0 != file->meshes[i].primitivesCount)
+			meshIndices[i] = written++;
+	}
+	for (GLuint i = 0; i < file->nodesCount; i++)
+	{
+		Node *node = &file->nodes[i], *loadedNode = &loaded->nodes[i];
+		GLint mesh = node->hasMesh && node->mesh < file->meshesCount ? meshIndices[node->mesh] : -1;
+		GLint loadedMesh = loadedNode->hasMesh ? (GLint)loadedNode->mesh : -1;
+		if (loadedNode->hasMatrix != node->hasMatrix || loadedMesh != mesh || loadedNode->childrenCount != node->childrenCount
+			|| (0 != node->childrenCount && 0 != std::memcmp(loadedNode->children, node->children, node->childrenCount * sizeof(GLuint))))
+			return "its node hierarchy differs";
+		if (node->hasMatrix ? !closeTo((const GLfloat*)&loadedNode->matrix[0], (const GLfloat*)&node->matrix[0], 16, 0.0f)
+			: !closeTo(&loadedNode->translation.x, &node->translation.x, 3, 0.0f) || !closeTo((const GLfloat*)&loadedNode->rotation, (const GLfloat*)&node->rotation, 4, 0.0f) || !closeTo(&loadedNode->scale.x, &node->scale.x, 3, 0.0f))
+			return "its node transforms differ";
+	}
+	//Rounding to the nearest step leaves at most half of one, a whole step also covers the float error
+	GLfloat snormTolerance = options.quantize ? 1.0f / 127.0f : 0.0f;
+	GLfloat unormTolerance = options.quantize ? 1.0f / 65535.0f : 0.0f;
+	GLuint meshIndex = 0;
+	for (GLuint i = 0; i < file->meshesCount; i++)
+	{
+		Mesh *mesh = &file->meshes[i];
+		if (0 == mesh->primitivesCount)
+			continue;
+		if (meshIndex >= loaded->meshesCount || loaded->meshes[meshIndex].primitivesCount != mesh->primitivesCount)
+			return "its meshes differ";
+		for (GLuint j = 0; j < mesh->primitivesCount; j++)
+		{
+			Primitive *primitive = &mesh->primitives[j];
+			Primitive *loadedPrimitive = &loaded->meshes[meshIndex].primitives[j];
+			if (loadedPrimitive->verticesCount != primitive->verticesCount || loadedPrimitive->indicesCount != primitive->indicesCount || loadedPrimitive->material != primitive->material)
+				return "the sizes or materials of its primitives differ";
+			if (nullptr == loadedPrimitive->vertices || nullptr == loadedPrimitive->indices)
+				return "its primitives have no vertices";
+			if (0 != std::memcmp(loadedPrimitive->indices, primitive->indices, primitive->indicesCount * sizeof(GLuint)))
+				return "its indices differ";
+			for (GLuint k = 0; k < primitive->verticesCount; k++)
+			{
+				Vertex *vertex = &primitive->vertices[k], *loadedVertex = &loadedPrimitive->vertices[k];
+				if (!closeTo(&loadedVertex->position.x, &vertex->position.x, 3, 0.0f) || !closeTo(&loadedVertex->normal.x, &vertex->normal.x, 3, snormTolerance)
+					|| !closeTo(&loadedVertex->tangent.x, &vertex->tangent.x, 4, snormTolerance) || !closeTo(&loadedVertex->texCoord0.x, &vertex->texCoord0.x, 2, unormTolerance))
+					return "its vertices differ";
+			}
+		}
+		meshIndex++;
+	}
+	return meshIndex == loaded->meshesCount ? "" : "its meshes differ";
+}
+
+static void writeNames(std::ostringstream &json, const std::vector<const char*> &names)
+{
+	json << '[';
+	for (GLuint i = 0; i < names.size(); i++)
+		json << (0 == i ? "" : ",") << '"' << names[i] << '"';
+	json << ']';
+}
+
+//target is 0 for views that aren't vertex or index data
+static void writeBufferView(std::ostringstream &json, GLboolean &first, GLuint64 offset, GLuint64 size, GLuint stride, GLenum target)
+{
+	json << (first ? "" : ",") << "{\"buffer\":0,\"byteOffset\":" << offset << ",\"byteLength\":" << size;
+	if (0 != stride)
+		json << ",\"byteStride\":" << stride;
+	if (0 != target)
+		json << ",\"target\":" << target;
+	json << '}';
+	first = GL_FALSE;
+}
+
+//uri is relative to the file it was loaded from, the written one has to be relative to the output
+static std::string rebaseUri(const std::string &uri, const std::string &sourcePath, const char *outputPath)
+{
+	if (0 == uri.compare(0, 5, "data:") || std::string::npos != uri.find("://"))
+		return uri;
+	std::filesystem::path image = std::filesystem::absolute(std::filesystem::path(sourcePath).parent_path() / uri).lexically_normal();
+	std::filesystem::path output = std::filesystem::absolute(std::filesystem::path(outputPath).parent_path()).lexically_normal();
+	std::filesystem::path relative = image.lexically_relative(output);
+	//Paths on different roots have no relative form
+	return (relative.empty() ? image : relative).generic_string();
+}
+
+GLboolean WriteGLB(glTFFile *file, const char *path, const GlbWriteOptions &options)
+{
+	std::vector<Primitive*> primitives;
+	//Meshes left empty by a partial load are not written, the rest are renumbered
+	std::vector<GLint> meshIndices(file->meshesCount, -1);
+	GLint meshesWritten = 0;
+	for (GLuint i = 0; i < file->meshesCount; i++)
+	{
+		if (0 == file->meshes[i].primitivesCount)
+			continue;
+		meshIndices[i] = meshesWritten++;
+		for (GLuint j = 0; j < file->meshes[i].primitivesCount; j++)
+		{
+			Primitive *primitive = &file->meshes[i].primitives[j];
+			if (nullptr == primitive->vertices || nullptr == primitive->indices)
+			{
+				std::cout << "GLB_WRITER::PRIMITIVES Message: " << file->path << " was loaded without its vertices on the CPU." << std::endl;
+				return GL_FALSE;
+			}
+			primitives.push_back(primitive);
+		}
+	}
+
+	std::vector<PrimitiveLayout> layouts(primitives.size());
+	GLuint64 binSize = 0;
+	GLboolean quantized = GL_FALSE;
+	for (GLuint i = 0; i < primitives.size(); i++)
+	{
+		Primitive *primitive = primitives[i];
+		PrimitiveLayout *layout = &layouts[i];
+		layout->indexType = primitive->verticesCount <= 0xFFFF ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+		layout->quantizeTexCoords = options.quantize;
+		for (GLuint k = 0; k < primitive->verticesCount && layout->quantizeTexCoords; k++)
+		{
+			glm::vec2 uv = primitive->vertices[k].texCoord0;
+			layout->quantizeTexCoords = uv.x >= 0.0f && uv.x <= 1.0f && uv.y >= 0.0f && uv.y <= 1.0f;
+		}
+		//Quantized attributes keep vertex strides aligned to 4 bytes
+		layout->strides[0] = 0;
+		layout->strides[1] = 12;
+		layout->strides[2] = options.quantize ? 4 : 12;
+		layout->strides[3] = options.quantize ? 4 : 16;
+		layout->strides[4] = layout->quantizeTexCoords ? 4 : 8;
+		layout->sizes[0] = (GLuint64)primitive->indicesCount * (GL_UNSIGNED_SHORT == layout->indexType ? 2 : 4);
+		for (GLuint a = 1; a < 5; a++)
+			layout->sizes[a] = (GLuint64)primitive->verticesCount * layout->strides[a];
+		for (GLuint a = 0; a < 5; a++)
+		{
+			layout->offsets[a] = binSize;
+			binSize = align4(binSize + layout->sizes[a]);
+		}
+		quantized = quantized || options.quantize;
+	}
+
+	//Embedded images follow the primitives in the binary chunk, one view each
+	std::vector<GLint> imageViews(file->imagesCount, -1);
+	std::vector<GLuint64> imageOffsets(file->imagesCount, 0);
+	GLuint viewsCount = (GLuint)primitives.size() * 5;
+	for (GLuint i = 0; i < file->imagesCount; i++)
+	{
+		Image *image = &file->images[i];
+		if (0 > image->view)
+			continue;
+		if (image->data.empty() || image->mimeType.empty())
+		{
+			std::cout << "GLB_WRITER::IMAGES Message: Embedded image " << i << " of " << file->path << " has no " << (image->data.empty() ? "data, the file was loaded with upload." : "mimeType.") << std::endl;
+			return GL_FALSE;
+		}
+		imageViews[i] = viewsCount++;
+		imageOffsets[i] = binSize;
+		binSize = align4(binSize + image->data.size());
+	}
+
+	std::vector<const char*> extensionsUsed, extensionsRequired;
+	if (quantized)
+	{
+		extensionsUsed.push_back("KHR_mesh_quantization");
+		extensionsRequired.push_back("KHR_mesh_quantization");
+	}
+	for (GLuint i = 0; i < file->texturesCount; i++)
+	{
+		if (!file->textures[i].basisu)
+			continue;
+		if (extensionsUsed.end() == std::find(extensionsUsed.begin(), extensionsUsed.end(), std::string("KHR_texture_basisu")))
+			extensionsUsed.push_back("KHR_texture_basisu");
+		//Without a fallback other loaders have nothing to show
+		if (0 > file->textures[i].fallbackSource && extensionsRequired.end() == std::find(extensionsRequired.begin(), extensionsRequired.end(), std::string("KHR_texture_basisu")))
+			extensionsRequired.push_back("KHR_texture_basisu");
+	}
+
+	std::ostringstream json;
+	json.precision(9);
+	json << "{\"asset\":{\"version\":\"2.0\",\"generator\":\"glTFLoader\"}";
+	if (!extensionsUsed.empty())
+	{
+		json << ",\"extensionsUsed\":";
+		writeNames(json, extensionsUsed);
+	}
+	if (!extensionsRequired.empty())
+	{
+		json << ",\"extensionsRequired\":";
+		writeNames(json, extensionsRequired);
+	}
+	json << ",\"buffers\":[{\"byteLength\":" << binSize << "}]";
+
+	json << ",\"bufferViews\":[";
+	GLboolean first = GL_TRUE;
+	for (GLuint i = 0; i < layouts.size(); i++)
+	{
+		writeBufferView(json, first, layouts[i].offsets[0], layouts[i].sizes[0], 0, GL_ELEMENT_ARRAY_BUFFER);
+		for (GLuint a = 1; a < 5; a++)
+			writeBufferView(json, first, layouts[i].offsets[a], layouts[i].sizes[a], layouts[i].strides[a], GL_ARRAY_BUFFER);
+	}
+	for (GLuint i = 0; i < file->imagesCount; i++)
+	{
+		if (0 <= imageViews[i])
+			writeBufferView(json, first, imageOffsets[i], file->images[i].data.size(), 0, 0);
+	}
+	json << ']';
+
+	//Accessors follow the views one to one, 5 per primitive
+	json << ",\"accessors\":[";
+	for (GLuint i = 0; i < primitives.size(); i++)
+	{
+		Primitive *primitive = primitives[i];
+		PrimitiveLayout *layout = &layouts[i];
+		glm::vec3 min(std::numeric_limits<GLfloat>::max()), max(-std::numeric_limits<GLfloat>::max());
+		for (GLuint k = 0; k < primitive->verticesCount; k++)
+		{
+			min = glm::min(min, primitive->vertices[k].position);
+			max = glm::max(max, primitive->vertices[k].position);
+		}
+		GLuint view = i * 5;
+		json << (0 == i ? "" : ",") << "{\"bufferView\":" << view << ",\"componentType\":" << layout->indexType << ",\"count\":" << primitive->indicesCount << ",\"type\":\"SCALAR\"}";
+		json << ",{\"bufferView\":" << view + 1 << ",\"componentType\":" << GL_FLOAT << ",\"count\":" << primitive->verticesCount << ",\"type\":\"VEC3\",\"min\":";
+		writeFloats(json, &min.x, 3);
+		json << ",\"max\":";
+		writeFloats(json, &max.x, 3);
+		json << '}';
+		json << ",{\"bufferView\":" << view + 2 << ",\"componentType\":" << (options.quantize ? GL_BYTE : GL_FLOAT) << (options.quantize ? ",\"normalized\":true" : "") << ",\"count\":" << primitive->verticesCount << ",\"type\":\"VEC3\"}";
+		json << ",{\"bufferView\":" << view + 3 << ",\"componentType\":" << (options.quantize ? GL_BYTE : GL_FLOAT) << (options.quantize ? ",\"normalized\":true" : "") << ",\"count\":" << primitive->verticesCount << ",\"type\":\"VEC4\"}";
+		json << ",{\"bufferView\":" << view + 4 << ",\"componentType\":" << (layout->quantizeTexCoords ? GL_UNSIGNED_SHORT : GL_FLOAT) << (layout->quantizeTexCoords ? ",\"normalized\":true" : "") << ",\"count\":" << primitive->verticesCount << ",\"type\":\"VEC2\"}";
+	}
+	json << ']';
+
+	json << ",\"meshes\":[";
+	GLuint primitive = 0;
+	for (GLuint i = 0; i < file->meshesCount; i++)
+	{
+		if (0 > meshIndices[i])
+			continue;
+		json << (0 == meshIndices[i] ? "" : ",") << "{\"primitives\":[";
+		for (GLuint j = 0; j < file->meshes[i].primitivesCount; j++, primitive++)
+		{
+			GLuint accessor = primitive * 5;
+			json << (0 == j ? "" : ",") << "{\"attributes\":{\"POSITION\":" << accessor + 1 << ",\"NORMAL\":" << accessor + 2 << ",\"TANGENT\":" << accessor + 3 << ",\"TEXCOORD_0\":" << accessor + 4
+				<< "},\"indices\":" << accessor;
+			if (file->meshes[i].primitives[j].material < file->materialsCount)
+				json << ",\"material\":" << file->meshes[i].primitives[j].material;
+			json << '}';
+		}
+		json << "]}";
+	}
+	json << ']';
+
+	if (file->materialsCount > 0)
+	{
+		json << ",\"materials\":[";
+		for (GLuint i = 0; i < file->materialsCount; i++)
+		{
+			Material *material = &file->materials[i];
+			json << (0 == i ? "" : ",") << "{\"pbrMetallicRoughness\":{\"baseColorFactor\":";
+			writeFloats(json, &material->color.r, 4);
+			json << ",\"metallicFactor\":" << material->metallic << ",\"roughnessFactor\":" << material->roughness;
+			if (0 <= material->baseColorTexture)
+				json << ",\"baseColorTexture\":{\"index\":" << material->baseColorTexture << '}';
+			if (0 <= material->metallicRoughnessTexture)
+				json << ",\"metallicRoughnessTexture\":{\"index\":" << material->metallicRoughnessTexture << '}';
+			json << "},\"emissiveFactor\":";
+			writeFloats(json, &material->emissive.r, 3);
+			if (0 <= material->normalTexture)
+				json << ",\"normalTexture\":{\"index\":" << material->normalTexture << '}';
+			if (0 <= material->occlusionTexture)
+				json << ",\"occlusionTexture\":{\"index\":" << material->occlusionTexture << '}';
+			if (0 <= material->emissiveTexture)
+				json << ",\"emissiveTexture\":{\"index\":" << material->emissiveTexture << '}';
+			if (material->blend)
+				json << ",\"alphaMode\":\"BLEND\"";
+			json << '}';
+		}
+		json << ']';
+	}
+
+	if (file->samplersCount > 0)
+	{
+		json << ",\"samplers\":[";
+		for (GLuint i = 0; i < file->samplersCount; i++)
+		{
+			Sampler *sampler = &file->samplers[i];
+			json << (0 == i ? "" : ",") << "{\"magFilter\":" << sampler->magFilter << ",\"minFilter\":" << sampler->minFilter << ",\"wrapS\":" << sampler->wrapS << ",\"wrapT\":" << sampler->wrapT << '}';
+		}
+		json << ']';
+	}
+
+	if (file->imagesCount > 0)
+	{
+		json << ",\"images\":[";
+		for (GLuint i = 0; i < file->imagesCount; i++)
+		{
+			Image *image = &file->images[i];
+			if (0 <= imageViews[i])
+				json << (0 == i ? "" : ",") << "{\"bufferView\":" << imageViews[i];
+			else
+			{
+				json << (0 == i ? "" : ",") << "{\"uri\":";
+				writeString(json, rebaseUri(image->uri, file->path, path));
+			}
+			if (!image->mimeType.empty())
+			{
+				json << ",\"mimeType\":";
+				writeString(json, image->mimeType);
+			}
+			json << '}';
+		}
+		json << ']';
+	}
+
+	if (file->texturesCount > 0)
+	{
+		json << ",\"textures\":[";
+		for (GLuint i = 0; i < file->texturesCount; i++)
+		{
+			Texture *texture = &file->textures[i];
+			//The loader decodes the basisu source, the plain one is written back as the fallback
+			GLint source = texture->basisu ? texture->fallbackSource : texture->source;
+			const char *separator = "";
+			json << (0 == i ? "" : ",") << '{';
+			if (0 <= source)
+			{
+				json << "\"source\":" << source;
+				separator = ",";
+			}
+			if (0 <= texture->sampler)
+			{
+				json << separator << "\"sampler\":" << texture->sampler;
+				separator = ",";
+			}
+			if (texture->basisu)
+				json << separator << "\"extensions\":{\"KHR_texture_basisu\":{\"source\":" << texture->source << "}}";
+			json << '}';
+		}
+		json << ']';
+	}
+
+	json << ",\"nodes\":[";
+	for (GLuint i = 0; i < file->nodesCount; i++)
+	{
+		Node *node = &file->nodes[i];
+		if (node->hasMatrix)
+		{
+			json << (0 == i ? "" : ",") << "{\"matrix\":";
+			writeFloats(json, (const GLfloat*)&node->matrix[0], 16);
+		}
+		else
+		{
+			json << (0 == i ? "" : ",") << "{\"translation\":";
+			writeFloats(json, &node->translation.x, 3);
+			//glm keeps w first, glTF last
+			GLfloat rotation[4] = { node->rotation.x, node->rotation.y, node->rotation.z, node->rotation.w };
+			json << ",\"rotation\":";
+			writeFloats(json, rotation, 4);
+			json << ",\"scale\":";
+			writeFloats(json, &node->scale.x, 3);
+		}
+		if (!node->name.empty())
+		{
+			json << ",\"name\":";
+			writeString(json, node->name);
+		}
+		if (node->hasMesh && node->mesh < file->meshesCount && 0 <= meshIndices[node->mesh])
+			json << ",\"mesh\":" << meshIndices[node->mesh];
+		if (node->childrenCount > 0)
+		{
+			json << ",\"children\":[";
+			for (GLuint j = 0; j < node->childrenCount; j++)
+				json << (0 == j ? "" : ",") << node->children[j];
+			json << ']';
+		}
+		json << '}';
+	}
+	json << ']';
+
+	json << ",\"scene\":0,\"scenes\":[";
+	for (GLuint i = 0; i < file->scenesCount; i++)
+	{
+		json << (0 == i ? "" : ",") << "{\"nodes\":[";
+		for (GLuint j = 0; j < file->scenes[i].nodesCount; j++)
+			json << (0 == j ? "" : ",") << file->scenes[i].nodes[j];
+		json << "]}";
+	}
+	json << "]}";
+
+	std::string jsonChunk = json.str();
+	//Chunks are padded to 4 bytes, JSON with spaces and binary with zeros
+	jsonChunk.append((size_t)(align4(jsonChunk.size()) - jsonChunk.size()), ' ');
+
+	std::ofstream stream(path, std::ios::out | std::ios::binary);
+	if (!stream.is_open())
+	{
+		std::cout << "GLB_WRITER::FILE Message: Could not open " << path << std::endl;
+		return GL_FALSE;
+	}
+	writeUint32(stream, GLB_MAGIC);
+	writeUint32(stream, GLB_VERSION);
+	writeUint32(stream, (GLuint)(12 + 8 + jsonChunk.size() + 8 + binSize));
+	writeUint32(stream, (GLuint)jsonChunk.size());
+	writeUint32(stream, GLB_CHUNK_JSON);
+	stream.write(jsonChunk.data(), jsonChunk.size());
+	writeUint32(stream, (GLuint)binSize);
+	writeUint32(stream, GLB_CHUNK_BIN);
+
+	//One attribute at a time goes through the staging buffer, the binary chunk is never whole in memory
+	std::vector<GLubyte> staging;
+	GLuint64 written = 0;
+	for (GLuint i = 0; i < primitives.size(); i++)
+	{
+		Primitive *source = primitives[i];
+		PrimitiveLayout *layout = &layouts[i];
+		for (GLuint a = 0; a < 5; a++)
+		{
+			staging.assign((size_t)layout->sizes[a], 0);
+			GLubyte *data = staging.data();
+			for (GLuint k = 0; 0 == a && k < source->indicesCount; k++)
+			{
+				if (GL_UNSIGNED_SHORT == layout->indexType)
+					((GLushort*)data)[k] = (GLushort)source->indices[k];
+				else
+					((GLuint*)data)[k] = source->indices[k];
+			}
+			for (GLuint k = 0; 0 != a && k < source->verticesCount; k++)
+			{
+				Vertex *vertex = &source->vertices[k];
+				GLubyte *element = &data[k * layout->strides[a]];
+				if (1 == a)
+					std::memcpy(element, &vertex->position, 12);
+				else if (2 == a && options.quantize)
+					for (GLuint c = 0; c < 3; c++)
+						((GLbyte*)element)[c] = toSnorm8(vertex->normal[c]);
+				else if (2 == a)
+					std::memcpy(element, &vertex->normal, 12);
+				else if (3 == a && options.quantize)
+					for (GLuint c = 0; c < 4; c++)
+						((GLbyte*)element)[c] = toSnorm8(vertex->tangent[c]);
+				else if (3 == a)
+					std::memcpy(element, &vertex->tangent, 16);
+				else if (layout->quantizeTexCoords)
+					for (GLuint c = 0; c < 2; c++)
+						((GLushort*)element)[c] = (GLushort)(vertex->texCoord0[c] * 65535.0f + 0.5f);
+				else
+					std::memcpy(element, &vertex->texCoord0, 8);
+			}
+			stream.write((const char*)data, staging.size());
+			written += staging.size();
+			GLuint64 padding = align4(written) - written;
+			stream.write("\0\0\0", padding);
+			written += padding;
+		}
+	}
+	for (GLuint i = 0; i < file->imagesCount; i++)
+	{
+		if (0 > imageViews[i])
+			continue;
+		const std::vector<GLubyte> &data = file->images[i].data;
+		stream.write((const char*)data.data(), data.size());
+		written += data.size();
+		GLuint64 padding = align4(written) - written;
+		stream.write("\0\0\0", padding);
+		written += padding;
+	}
+	stream.close();
+	if (!stream.good())
+		return GL_FALSE;
+	if (nullptr == options.verify)
+		return GL_TRUE;
+
+	LoadOptions loadOptions;
+	loadOptions.upload = GL_FALSE;
+	loadOptions.share = GL_FALSE;
+	glTFFile *loaded = options.verify->LoadFile(path, loadOptions);
+	std::string mismatch = compareLoaded(file, loaded, options);
+	delete loaded;
+	if (!mismatch.empty())
+	{
+		std::cout << "GLB_WRITER::VERIFY Message: " << path << " does not load back as it was written, " << mismatch << "." << std::endl;
+		return GL_FALSE;
+	}
+	return GL_TRUE;
+}
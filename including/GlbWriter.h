@@ -0,0 +1,28 @@
+#pragma once
+#include <glad\glad.h>
+
+#include "Types.h"
+
+//Binary glTF container, written by WriteGLB and read back by the Loader
+#define GLB_MAGIC 0x46546C67
+#define GLB_VERSION 2
+#define GLB_CHUNK_JSON 0x4E4F534A
+#define GLB_CHUNK_BIN 0x004E4942
+
+class Loader;
+
+struct GlbWriteOptions
+{
+	//Stores normals and tangents as normalized bytes and texture coordinates in [0, 1] as normalized shorts, using KHR_mesh_quantization
+	GLboolean quantize;
+	//Loads the written file back with this Loader and checks it holds the same nodes, geometry and materials, nullptr skips it.
+	//Quantized attributes may differ by a step of their integer type
+	Loader *verify;
+	GlbWriteOptions() : quantize(GL_FALSE), verify(nullptr) {}
+};
+
+//Writes file as a binary glTF. The JSON is built first from the sizes alone and the primitives are then streamed
+//into the binary chunk one at a time. Every primitive needs its vertices and indices on the CPU (GEOMETRY_KEEP_ALL).
+//Image uris are rewritten relative to path. Embedded images are copied into the binary chunk and need their bytes kept
+//by a load without upload. KHR_texture_basisu sources are written back with their fallback.
+GLboolean WriteGLB(glTFFile *file, const char *path, const GlbWriteOptions &options = GlbWriteOptions());
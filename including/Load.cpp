@@ -2,56 +2,502 @@
 #include <fstream>
 #include <string>
 #include <limits>
+#include <cstring>
+#include <cctype>
+#include <chrono>
+#include <algorithm>
+#include <sys/types.h>
+#include <sys/stat.h>
 
 #include <rapidjson\document.h>
 #include <rapidjson\error\en.h>
 
 #include "Load.h"
 #include "Endian.h"
+#include "GlbWriter.h"
+#include "TextureQueue.h"
+#include "GeometryRegistry.h"
+#include "ThreadPool.h"
+#include <mutex>
+#include <condition_variable>
+#include <memory>
 
-glTFFile* Loader::LoadFile(const char *filePath)
+#define JSON_POOL_MIN_SIZE (64 * 1024)
+
+GLuint64 Buffer::Map(GLuint64 offset, GLuint64 size, const GLubyte **result)
+{
+	if (nullptr == this->stream)
+	{
+		*result = &this->data[offset];
+		return offset >= this->size ? 0 : std::min(size, this->size - offset);
+	}
+	if (offset >= this->size)
+		return 0;
+
+	//Slides the window when the start or as much of the request as it can hold isn't resident
+	GLuint64 wanted = std::min(size, this->windowCapacity);
+	if (offset < this->windowOffset || offset + wanted > this->windowOffset + this->windowSize)
+	{
+		this->windowOffset = offset;
+		this->windowSize = std::min(this->windowCapacity, this->size - offset);
+		this->stream->clear();
+		this->stream->seekg(offset);
+		this->stream->read((char *)this->data, this->windowSize);
+	}
+	*result = &this->data[offset - this->windowOffset];
+	return std::min(size, this->windowOffset + this->windowSize - offset);
+}
+
+//Calls read(element, k) for the first limit elements of accessor, fewer when it is shorter. The limit is the size
+//of the array read writes to. Streamed buffers are decoded a window at a time
+template<typename Read>
+static void forEachElement(Buffer *buffers, BufferView *views, Accessor *accessor, GLuint limit, Read read)
+{
+	BufferView *view = &views[accessor->view];
+	Buffer *buffer = &buffers[view->buffer];
+	GLuint64 stride = 0 != view->stride ? view->stride : accessor->size;
+	GLuint total = std::min(accessor->count, limit);
+	GLuint k = 0;
+	while (k < total)
+	{
+		//The last element only needs its own bytes, not a whole stride
+		GLuint64 offset = view->offset + accessor->offset + stride * k;
+		GLuint64 size = stride * (total - k - 1) + accessor->size;
+		const GLubyte *data;
+		GLuint64 available = buffer->Map(offset, size, &data);
+		if (available < accessor->size)
+		{
+			std::cout << "LOADER::GLTF::ACCESSORS Message: Accessor reads past the end of its buffer." << std::endl;
+			return;
+		}
+		GLuint count = std::min((GLuint)((available - accessor->size) / stride + 1), total - k);
+		for (GLuint i = 0; i < count; i++, k++)
+			read(&data[i * stride], k);
+	}
+}
+
+//Integer component widened to a float, normalized ones are mapped as glTF defines it
+static GLfloat componentValue(GLfloat value, GLuint componentType, GLboolean normalized)
+{
+	if (!normalized)
+		return value;
+	switch (componentType)
+	{
+	case GL_BYTE:
+		return std::max(value / 127.0f, -1.0f);
+	case GL_UNSIGNED_BYTE:
+		return value / 255.0f;
+	case GL_SHORT:
+		return std::max(value / 32767.0f, -1.0f);
+	case GL_UNSIGNED_SHORT:
+		return value / 65535.0f;
+	}
+	return value;
+}
+
+//count components of an attribute element as floats, KHR_mesh_quantization stores them as integers, normalized or not.
+//Floats are copied still little endian and converted with the whole vertex array, the others are stored the same way
+static void readComponents(const GLubyte *element, const Accessor *accessor, GLuint count, GLfloat *result)
+{
+	if (GL_FLOAT == accessor->componentType)
+	{
+		std::memcpy(result, element, count * sizeof(GLfloat));
+		return;
+	}
+	for (GLuint c = 0; c < count; c++)
+	{
+		GLfloat value = 0.0f;
+		GLshort signedShort;
+		GLushort unsignedShort;
+		switch (accessor->componentType)
+		{
+		case GL_BYTE:
+			value = ((const GLbyte*)element)[c];
+			break;
+		case GL_UNSIGNED_BYTE:
+			value = element[c];
+			break;
+		case GL_SHORT:
+			std::memcpy(&signedShort, element + c * 2, 2);
+			value = Endian::Little(signedShort);
+			break;
+		case GL_UNSIGNED_SHORT:
+			std::memcpy(&unsignedShort, element + c * 2, 2);
+			value = Endian::Little(unsignedShort);
+			break;
+		}
+		result[c] = Endian::Little(componentValue(value, accessor->componentType, accessor->normalized));
+	}
+}
+
+//Binary glTF holds a JSON chunk and an optional BIN chunk. The JSON is terminated in place, over the header of the chunk
+//after it or at the end of the text, so it parses in situ like a .gltf. Text without the GLB magic is JSON as a whole
+static GLboolean splitGLB(std::string &file, GLchar **json, const GLubyte **bin, GLuint64 *binSize)
+{
+	*json = &file[0];
+	*bin = nullptr;
+	*binSize = 0;
+	GLuint header[3];
+	if (file.size() < sizeof(header))
+		return GL_TRUE;
+	std::memcpy(header, file.data(), sizeof(header));
+	if (GLB_MAGIC != Endian::Little(header[0]))
+		return GL_TRUE;
+	if (GLB_VERSION != Endian::Little(header[1]))
+	{
+		std::cout << "LOADER::GLB::VERSION Message: Version not supported" << std::endl;
+		return GL_FALSE;
+	}
+
+	GLuint64 length = std::min<GLuint64>(Endian::Little(header[2]), file.size());
+	GLuint64 offset = sizeof(header), jsonEnd = 0;
+	GLboolean hasJson = GL_FALSE;
+	while (offset + 8 <= length)
+	{
+		GLuint chunk[2];
+		std::memcpy(chunk, &file[(size_t)offset], sizeof(chunk));
+		GLuint64 chunkLength = Endian::Little(chunk[0]);
+		GLuint type = Endian::Little(chunk[1]);
+		GLuint64 start = offset + 8;
+		if (start + chunkLength > length)
+		{
+			std::cout << "LOADER::GLB::CHUNKS Message: Chunk runs past the end of the file." << std::endl;
+			return GL_FALSE;
+		}
+		//The first chunk is the JSON, a BIN chunk can only follow it. Unknown chunks are skipped
+		if (GLB_CHUNK_JSON == type && !hasJson)
+		{
+			*json = &file[(size_t)start];
+			jsonEnd = start + chunkLength;
+			hasJson = GL_TRUE;
+		}
+		else if (GLB_CHUNK_BIN == type && hasJson && nullptr == *bin)
+		{
+			*bin = (const GLubyte*)&file[(size_t)start];
+			*binSize = chunkLength;
+		}
+		offset = start + ((chunkLength + 3) & ~3ull);
+	}
+	if (!hasJson)
+	{
+		std::cout << "LOADER::GLB::CHUNKS Message: Could not find the JSON chunk." << std::endl;
+		return GL_FALSE;
+	}
+	file[(size_t)jsonEnd] = '\0';
+	return GL_TRUE;
+}
+
+//Path of a file referenced by uri, uris are percent encoded
+static std::string uriPath(const std::string &fileDir, const std::string &uri)
+{
+	std::string path = fileDir + "\\";
+	for (GLuint i = 0; i < uri.size(); i++)
+	{
+		if ('%' == uri[i] && i + 2 < uri.size() && std::isxdigit((GLubyte)uri[i + 1]) && std::isxdigit((GLubyte)uri[i + 2]))
+		{
+			path += (char)std::stoi(uri.substr(i + 1, 2), nullptr, 16);
+			i += 2;
+		}
+		else
+			path += uri[i];
+	}
+	return path;
+}
+
+//Copies the bytes of view into data, returns how many could be read
+static GLuint64 copyView(Buffer *buffers, BufferView *view, GLubyte *data)
+{
+	GLuint64 copied = 0;
+	while (copied < view->size)
+	{
+		const GLubyte *chunk;
+		GLuint64 available = buffers[view->buffer].Map(view->offset + copied, view->size - copied, &chunk);
+		if (0 == available)
+			break;
+		std::memcpy(&data[copied], chunk, (size_t)available);
+		copied += available;
+	}
+	return copied;
+}
+
+//Marks the nodes selected by options with their subtrees, the meshes they reach and the accessors and materials those use
+static void selectMeshes(rapidjson::Document &json, const LoadOptions &options, std::vector<GLboolean> &nodes, std::vector<GLboolean> &meshes, std::vector<GLboolean> &accessors, std::vector<GLboolean> &materials)
+{
+	rapidjson::Value &jsonNodes = json["nodes"];
+	rapidjson::Value &jsonMeshes = json["meshes"];
+	GLuint nodesCount = jsonNodes.Size();
+	GLboolean filtered = !options.nodeNames.empty() || !options.nodeIndices.empty() || options.nodeFilter;
+	meshes.assign(jsonMeshes.Size(), GL_FALSE);
+	accessors.assign(json["accessors"].Size(), GL_FALSE);
+	materials.assign(json.HasMember("materials") ? json["materials"].Size() : 0, GL_FALSE);
+
+	//Nodes of the selected scene, or every node
+	std::vector<GLboolean> candidates(nodesCount, GL_FALSE);
+	std::vector<GLuint> stack;
+	if (0 <= options.scene && (GLuint)options.scene < json["scenes"].Size())
+	{
+		rapidjson::Value &sceneNodes = json["scenes"][(GLuint)options.scene]["nodes"];
+		for (GLuint i = 0; i < sceneNodes.Size(); i++)
+			stack.push_back(sceneNodes[i].GetUint());
+		while (!stack.empty())
+		{
+			GLuint node = stack.back();
+			stack.pop_back();
+			if (node >= nodesCount || candidates[node])
+				continue;
+			candidates[node] = GL_TRUE;
+			if (jsonNodes[node].HasMember("children"))
+			{
+				rapidjson::Value &children = jsonNodes[node]["children"];
+				for (GLuint i = 0; i < children.Size(); i++)
+					stack.push_back(children[i].GetUint());
+			}
+		}
+	}
+	else
+		candidates.assign(nodesCount, GL_TRUE);
+
+	for (GLuint i = 0; i < nodesCount; i++)
+	{
+		if (!candidates[i])
+			continue;
+		if (filtered)
+		{
+			std::string name = jsonNodes[i].HasMember("name") ? jsonNodes[i]["name"].GetString() : "";
+			if (std::find(options.nodeIndices.begin(), options.nodeIndices.end(), i) == options.nodeIndices.end() &&
+				std::find(options.nodeNames.begin(), options.nodeNames.end(), name) == options.nodeNames.end() &&
+				!(options.nodeFilter && options.nodeFilter(i, name)))
+				continue;
+		}
+		stack.push_back(i);
+	}
+
+	//The selected nodes bring their whole subtree
+	nodes.assign(nodesCount, GL_FALSE);
+	while (!stack.empty())
+	{
+		GLuint node = stack.back();
+		stack.pop_back();
+		if (node >= nodesCount || nodes[node])
+			continue;
+		nodes[node] = GL_TRUE;
+		if (jsonNodes[node].HasMember("children"))
+		{
+			rapidjson::Value &children = jsonNodes[node]["children"];
+			for (GLuint i = 0; i < children.Size(); i++)
+				stack.push_back(children[i].GetUint());
+		}
+		if (!jsonNodes[node].HasMember("mesh") || jsonNodes[node]["mesh"].GetUint() >= meshes.size())
+			continue;
+		GLuint mesh = jsonNodes[node]["mesh"].GetUint();
+		if (meshes[mesh])
+			continue;
+		meshes[mesh] = GL_TRUE;
+		if (!jsonMeshes[mesh].HasMember("primitives"))
+			continue;
+		rapidjson::Value &primitives = jsonMeshes[mesh]["primitives"];
+		for (GLuint i = 0; i < primitives.Size(); i++)
+		{
+			if (primitives[i].HasMember("attributes"))
+			{
+				rapidjson::Value &attributes = primitives[i]["attributes"];
+				for (rapidjson::Value::MemberIterator it = attributes.MemberBegin(); it != attributes.MemberEnd(); it++)
+				{
+					if (it->value.GetUint() < accessors.size())
+						accessors[it->value.GetUint()] = GL_TRUE;
+				}
+			}
+			if (primitives[i].HasMember("indices") && primitives[i]["indices"].GetUint() < accessors.size())
+				accessors[primitives[i]["indices"].GetUint()] = GL_TRUE;
+			if (primitives[i].HasMember("material") && primitives[i]["material"].GetUint() < materials.size())
+				materials[primitives[i]["material"].GetUint()] = GL_TRUE;
+		}
+	}
+}
+
+Loader::Loader() : mJsonPoolWanted(JSON_POOL_MIN_SIZE), mViews(nullptr), mViewsCapacity(0), mAccessors(nullptr), mAccessorsCapacity(0)
+{
+}
+
+Loader::~Loader()
+{
+	this->Trim();
+}
+
+//Decodes are claimed once, by a worker as soon as their buffers land or by FinishLoad
+struct DecodeBatch
+{
+	std::mutex mutex;
+	std::condition_variable done;
+	std::vector<GLboolean> claimed;
+	GLuint finished;
+};
+
+struct PrimitiveSource
+{
+	Primitive *primitive;
+	GLuint attributes[4];
+	GLuint indices;
+	GLuint material;
+	//Buffers still being read
+	GLuint pending;
+};
+
+//What a load keeps between BeginLoad and FinishLoad. The document lives in the Loader's scratch storage
+struct PendingLoad
+{
+	LoadOptions options;
+	glTFFile *result;
+	std::string fileDir;
+	std::unique_ptr<rapidjson::MemoryPoolAllocator<>> jsonAllocator;
+	std::unique_ptr<rapidjson::Document> json;
+	Buffer *buffers;
+	GLuint buffersCount;
+	BufferView *views;
+	GLuint viewsCount;
+	Accessor *accessors;
+	Mesh *meshes;
+	std::vector<PrimitiveSource> sources;
+	std::vector<GLboolean> usedNodes;
+	std::vector<GLboolean> usedTextures;
+	GLboolean viewUpload;
+	GLboolean streamed;
+	std::shared_ptr<DecodeBatch> batch;
+	std::function<void(GLuint)> decodeClaimed;
+	std::function<void(GLuint)> decode;
+	PendingLoad(const LoadOptions &options, glTFFile *result) : options(options), result(result), buffers(nullptr), buffersCount(0), views(nullptr), viewsCount(0), accessors(nullptr), meshes(nullptr), viewUpload(GL_FALSE), streamed(GL_FALSE) {}
+};
+
+void Loader::Trim()
+{
+	std::string().swap(this->mText);
+	std::vector<GLchar>().swap(this->mJsonPool);
+	this->mJsonPoolWanted = JSON_POOL_MIN_SIZE;
+	delete[] this->mViews;
+	this->mViews = nullptr;
+	this->mViewsCapacity = 0;
+	delete[] this->mAccessors;
+	this->mAccessors = nullptr;
+	this->mAccessorsCapacity = 0;
+}
+
+GLuint64 Loader::GetScratchBytes()
+{
+	GLuint64 bytes = this->mText.capacity() + this->mJsonPool.capacity();
+	bytes += this->mViewsCapacity * sizeof(BufferView);
+	for (GLuint i = 0; i < this->mAccessorsCapacity; i++)
+		bytes += sizeof(Accessor) + this->mAccessors[i].capacity * 2;
+	return bytes;
+}
+
+glTFFile* Loader::LoadFile(const char *filePath, const LoadOptions &options)
 {
 	glTFFile* result = new glTFFile;
-	Endian endian;
-	Buffer* buffers;
-	BufferView* views;
-	Accessor* accessors;
+	this->load(filePath, options, result);
+	return result;
+}
+
+GLboolean Loader::load(const char *filePath, const LoadOptions &options, glTFFile *result)
+{
+	PendingLoad *pending = this->BeginLoad(filePath, options, result);
+	return nullptr != pending && this->FinishLoad(pending);
+}
+
+PendingLoad *Loader::BeginLoad(const char *filePath, const LoadOptions &loadOptions, glTFFile *result)
+{
+	std::unique_ptr<PendingLoad> pending(new PendingLoad(loadOptions, result));
+	const LoadOptions &options = pending->options;
+	Buffer *&buffers = pending->buffers;
+	BufferView *&views = pending->views;
+	Accessor *&accessors = pending->accessors;
 	Material *materials;
-	GLuint buffersCount, viewsCount, accessorsCount;
-	rapidjson::Document json;
+	GLuint &buffersCount = pending->buffersCount;
+	GLuint &viewsCount = pending->viewsCount;
+	GLuint accessorsCount;
 	std::ifstream fileStream;
-	std::string file, line, fileDir;
+	std::string &file = this->mText;
+	std::string &fileDir = pending->fileDir;
 
-	endian.Init();
 	fileDir = filePath;
 	fileDir = fileDir.substr(0, fileDir.find_last_of('\\'));
+	result->path = filePath;
+	result->retention = options.upload ? options.retention : GEOMETRY_KEEP_ALL;
+	//Kept for Reload, without what only mattered to this load
+	delete result->loadOptions;
+	result->loadOptions = new LoadOptions(options);
+	result->loadOptions->progress = nullptr;
+	result->loadOptions->cancellation = CancellationToken();
+	result->loadOptions->deferUpload = GL_FALSE;
 
-	fileStream.open(filePath);
-	while (std::getline(fileStream, line))
+	AssetArchive *archive;
+	std::string entry;
+	const GLubyte *archived;
+	GLuint64 archivedSize;
+	if (this->findInArchives(filePath, &archive, &entry, &archived, &archivedSize))
 	{
-		file += line;
-		file.push_back('\n');
+		file.resize((size_t)archivedSize);
+		if (nullptr != archived)
+			std::memcpy(&file[0], archived, (size_t)archivedSize);
+		else if (!archive->Read(entry, (GLubyte*)&file[0]))
+		{
+			std::cout << "LOADER::GLTF::ARCHIVE Message: Could not read " << filePath << " from its archive." << std::endl;
+			return nullptr;
+		}
+	}
+	else
+	{
+		file.clear();
+		fileStream.open(filePath, std::ios::binary);
+		if (fileStream.is_open())
+		{
+			fileStream.seekg(0, std::ios::end);
+			file.resize((size_t)fileStream.tellg());
+			fileStream.seekg(0, std::ios::beg);
+			fileStream.read(&file[0], file.size());
+			fileStream.close();
+		}
 	}
-	fileStream.close();
 
-	json.Parse(file.c_str());
+	//The values live in the pool and the strings in the text, both are kept for the next load
+	if (this->mJsonPool.size() < this->mJsonPoolWanted)
+	{
+		this->mJsonPool.clear();
+		this->mJsonPool.resize((size_t)this->mJsonPoolWanted);
+	}
+	pending->jsonAllocator.reset(new rapidjson::MemoryPoolAllocator<>(this->mJsonPool.data(), this->mJsonPool.size()));
+	pending->json.reset(new rapidjson::Document(pending->jsonAllocator.get()));
+	rapidjson::MemoryPoolAllocator<> &jsonAllocator = *pending->jsonAllocator;
+	rapidjson::Document &json = *pending->json;
+	//The BIN chunk of a .glb stays in the text, the buffer without uri points into it until the load ends
+	GLchar *jsonText;
+	const GLubyte *binChunk;
+	GLuint64 binChunkSize;
+	if (!splitGLB(file, &jsonText, &binChunk, &binChunkSize))
+	{
+		std::cout << "LOADER::GLB::PARSER_ERROR Message: " << filePath << " is not a valid binary glTF." << std::endl;
+		return nullptr;
+	}
+	json.ParseInsitu(jsonText);
+	GLuint64 jsonBytes = jsonAllocator.Size();
+	if (jsonBytes > this->mJsonPool.size())
+		this->mJsonPoolWanted = jsonBytes + jsonBytes / 8;
 	if (json.HasParseError())
 	{
 		std::cout << "LOADER::GLTF::PARSER_ERROR Message: " << rapidjson::GetParseError_En(json.GetParseError()) << std::endl;
-		return result;
+		return nullptr;
 	}
 
 	if (!json.HasMember("asset"))
 	{
 		std::cout << "LOADER::GLTF::GRAMMAR_ERROR Message: Could not find asset node." << std::endl;
-		return result;
+		return nullptr;
 	}
 	
 	rapidjson::Value& value = json["asset"];
 	if (!value.HasMember("version"))
 	{
 		std::cout << "LOADER::GLTF::GRAMMAR_ERROR Message: Could not find asset.version node." << std::endl;
-		return result;
+		return nullptr;
 	}
 	
 	std::string version = value["version"].GetString();
@@ -62,79 +508,90 @@ glTFFile* Loader::LoadFile(const char *filePath)
 	if ("2" != major)
 	{
 		std::cout << "LOADER::GLTF::VERSION Message: Version not supported" << std::endl;
-		return result;
+		return nullptr;
 	}
 
 	if (!json.HasMember("buffers") || !json["buffers"].IsArray() || json["buffers"].Empty())
 	{
 		std::cout << "LOADER::GLTF::BUFFERS Message: Could not find buffers array." << std::endl;
-		return result;
+		return nullptr;
 	}
 	if (!json.HasMember("bufferViews") || !json["bufferViews"].IsArray() || json["bufferViews"].Empty())
 	{
 		std::cout << "LOADER::GLTF::BUFFER_VIEWS Message: Could not find buffer views array." << std::endl;
-		return result;
+		return nullptr;
 	}
 	if (!json.HasMember("meshes") || !json["meshes"].IsArray() || json["meshes"].Empty())
 	{
 		std::cout << "LOADER::GLTF::MESHES Message: Could not find meshes array." << std::endl;
-		return result;
+		return nullptr;
 	}
 	if (!json.HasMember("accessors") || !json["accessors"].IsArray() || json["accessors"].Empty())
 	{
 		std::cout << "LOADER::GLTF::MESHES Message: Could not find meshes array." << std::endl;
-		return result;
+		return nullptr;
 	}
 	if (!json.HasMember("nodes") || !json["nodes"].IsArray() || json["nodes"].Empty())
 	{
 		std::cout << "LOADER::GLTF::NODES Message: Could not find nodes array." << std::endl;
-		return result;
+		return nullptr;
 	}
 	if (!json.HasMember("scenes") || !json["scenes"].IsArray() || json["scenes"].Empty())
 	{
 		std::cout << "LOADER::GLTF::SCENES Message: Could not find scenes array." << std::endl;
-		return result;
+		return nullptr;
 	}
 
-	value = json["buffers"];
-	buffersCount = value.Size();
-	buffers = new Buffer[buffersCount];
-	for (GLuint i = 0; i < buffersCount; i++)
-	{
-		GLuint size = value[i]["byteLength"].GetUint();
-		fileStream.open(fileDir + "\\" + value[i]["uri"].GetString(), std::ios::in | std::ios::binary);
-		buffers[i].data = new GLubyte[size];
-		buffers[i].size = size;
-
-		fileStream.read((char *)buffers[i].data, buffers[i].size);
-
-		fileStream.close();
-	}
+	//Only what the selected nodes reach is decoded and read from the buffers
+	std::vector<GLboolean> &usedNodes = pending->usedNodes;
+	std::vector<GLboolean> usedMeshes, usedAccessors, usedMaterials;
+	selectMeshes(json, options, usedNodes, usedMeshes, usedAccessors, usedMaterials);
 
 	value = json["bufferViews"];
 	viewsCount = value.Size();
-	views = new BufferView[viewsCount];
+	if (viewsCount > this->mViewsCapacity)
+	{
+		delete[] this->mViews;
+		this->mViews = new BufferView[viewsCount];
+		this->mViewsCapacity = viewsCount;
+	}
+	views = this->mViews;
 	for (GLuint i = 0; i < viewsCount; i++)
 	{
 		views[i].buffer = value[i]["buffer"].GetUint();
-		views[i].size = value[i]["byteLength"].GetUint();
-		views[i].offset = value[i].HasMember("byteOffset") ? value[i]["byteOffset"].GetUint() : 0;
+		views[i].size = value[i]["byteLength"].GetUint64();
+		views[i].offset = value[i].HasMember("byteOffset") ? value[i]["byteOffset"].GetUint64() : 0;
+		views[i].stride = value[i].HasMember("byteStride") ? value[i]["byteStride"].GetUint() : 0;
 	}
 
 	value = json["accessors"];
 	accessorsCount = value.Size();
-	accessors = new Accessor[accessorsCount];
+	if (accessorsCount > this->mAccessorsCapacity)
+	{
+		delete[] this->mAccessors;
+		this->mAccessors = new Accessor[accessorsCount];
+		this->mAccessorsCapacity = accessorsCount;
+	}
+	accessors = this->mAccessors;
 	for (GLuint i = 0; i < accessorsCount; i++)
 	{
 		accessors[i].view = value[i]["bufferView"].GetUint();
+		accessors[i].offset = value[i].HasMember("byteOffset") ? value[i]["byteOffset"].GetUint64() : 0;
 		accessors[i].componentType = value[i]["componentType"].GetUint();
+		accessors[i].normalized = value[i].HasMember("normalized") && value[i]["normalized"].GetBool();
 		accessors[i].count = value[i]["count"].GetUint();
 		accessors[i].type = value[i]["type"].GetString();
 		GLuint componentCount = this->GetComponentCount(accessors[i].type);
 		GLuint componentSize = this->GetComponentSize(accessors[i].componentType);
 		accessors[i].size = componentCount * componentSize;
-		accessors[i].min = new GLchar[accessors[i].size];
-		accessors[i].max = new GLchar[accessors[i].size];
+		if (accessors[i].size > accessors[i].capacity)
+		{
+			delete[] accessors[i].min;
+			delete[] accessors[i].max;
+			accessors[i].min = new GLchar[accessors[i].size];
+			accessors[i].max = new GLchar[accessors[i].size];
+			accessors[i].capacity = accessors[i].size;
+		}
 		for (GLuint j = 0; j < componentCount; j++)
 		{
 			GLboolean hasMin = value[i].HasMember("min");
@@ -171,31 +628,196 @@ glTFFile* Loader::LoadFile(const char *filePath)
 		}
 	}
 
+	if (json.HasMember("samplers") && json["samplers"].IsArray())
+	{
+		value = json["samplers"];
+		result->samplersCount = value.Size();
+		result->samplers = new Sampler[result->samplersCount];
+		for (GLuint i = 0; i < result->samplersCount; i++)
+		{
+			Sampler *sampler = &result->samplers[i];
+			if (value[i].HasMember("magFilter"))
+				sampler->magFilter = value[i]["magFilter"].GetInt();
+			if (value[i].HasMember("minFilter"))
+				sampler->minFilter = value[i]["minFilter"].GetInt();
+			if (value[i].HasMember("wrapS"))
+				sampler->wrapS = value[i]["wrapS"].GetInt();
+			if (value[i].HasMember("wrapT"))
+				sampler->wrapT = value[i]["wrapT"].GetInt();
+		}
+	}
+
+	if (json.HasMember("images") && json["images"].IsArray())
+	{
+		value = json["images"];
+		result->imagesCount = value.Size();
+		result->images = new Image[result->imagesCount];
+		for (GLuint i = 0; i < result->imagesCount; i++)
+		{
+			Image *image = &result->images[i];
+			if (value[i].HasMember("uri"))
+			{
+				image->uri = value[i]["uri"].GetString();
+				if (0 != image->uri.compare(0, 5, "data:"))
+					result->dependencies.push_back(uriPath(fileDir, image->uri));
+			}
+			if (value[i].HasMember("mimeType"))
+				image->mimeType = value[i]["mimeType"].GetString();
+			if (value[i].HasMember("bufferView"))
+				image->view = value[i]["bufferView"].GetInt();
+		}
+	}
+
+	if (json.HasMember("textures") && json["textures"].IsArray())
+	{
+		value = json["textures"];
+		result->texturesCount = value.Size();
+		result->textures = new Texture[result->texturesCount];
+		for (GLuint i = 0; i < result->texturesCount; i++)
+		{
+			Texture *texture = &result->textures[i];
+			if (value[i].HasMember("source"))
+				texture->source = value[i]["source"].GetInt();
+			//Basis universal images take precedence, the plain source is only a fallback for other loaders
+			if (value[i].HasMember("extensions") && value[i]["extensions"].HasMember("KHR_texture_basisu"))
+			{
+				texture->fallbackSource = texture->source;
+				texture->source = value[i]["extensions"]["KHR_texture_basisu"]["source"].GetInt();
+				texture->basisu = GL_TRUE;
+			}
+			if (value[i].HasMember("sampler"))
+				texture->sampler = value[i]["sampler"].GetInt();
+		}
+	}
+
 	value = json["materials"];
 	result->materialsCount = value.Size();
 	materials = new Material[result->materialsCount];
 	result->materials = materials;
 	for (GLuint i = 0; i < result->materialsCount; i++)
 	{
-		materials[i].color = glm::vec4(1.0f);
-		if (value[i]["pbrMetallicRoughness"].HasMember("baseColorFactor"))
+		if (value[i].HasMember("pbrMetallicRoughness"))
+		{
+			rapidjson::Value& pbr = value[i]["pbrMetallicRoughness"];
+			if (pbr.HasMember("baseColorFactor"))
+			{
+				rapidjson::Value& baseColor = pbr["baseColorFactor"];
+				materials[i].color.r = baseColor[0].GetFloat();
+				materials[i].color.g = baseColor[1].GetFloat();
+				materials[i].color.b = baseColor[2].GetFloat();
+				materials[i].color.a = baseColor[3].GetFloat();
+			}
+			if (pbr.HasMember("metallicFactor"))
+				materials[i].metallic = pbr["metallicFactor"].GetFloat();
+			if (pbr.HasMember("roughnessFactor"))
+				materials[i].roughness = pbr["roughnessFactor"].GetFloat();
+			if (pbr.HasMember("baseColorTexture"))
+				materials[i].baseColorTexture = pbr["baseColorTexture"]["index"].GetInt();
+			if (pbr.HasMember("metallicRoughnessTexture"))
+				materials[i].metallicRoughnessTexture = pbr["metallicRoughnessTexture"]["index"].GetInt();
+		}
+		if (value[i].HasMember("emissiveFactor"))
+		{
+			rapidjson::Value& emissive = value[i]["emissiveFactor"];
+			materials[i].emissive.r = emissive[0].GetFloat();
+			materials[i].emissive.g = emissive[1].GetFloat();
+			materials[i].emissive.b = emissive[2].GetFloat();
+		}
+		if (value[i].HasMember("normalTexture"))
+			materials[i].normalTexture = value[i]["normalTexture"]["index"].GetInt();
+		if (value[i].HasMember("occlusionTexture"))
+			materials[i].occlusionTexture = value[i]["occlusionTexture"]["index"].GetInt();
+		if (value[i].HasMember("emissiveTexture"))
+			materials[i].emissiveTexture = value[i]["emissiveTexture"]["index"].GetInt();
+		//MASK is drawn as opaque
+		if (value[i].HasMember("alphaMode") && value[i]["alphaMode"].IsString())
+			materials[i].blend = 0 == std::strcmp("BLEND", value[i]["alphaMode"].GetString());
+
+		//Color textures are stored in sRGB, the rest hold linear data
+		if (0 <= materials[i].baseColorTexture && (GLuint)materials[i].baseColorTexture < result->texturesCount)
+			result->textures[materials[i].baseColorTexture].sRGB = GL_TRUE;
+		if (0 <= materials[i].emissiveTexture && (GLuint)materials[i].emissiveTexture < result->texturesCount)
+			result->textures[materials[i].emissiveTexture].sRGB = GL_TRUE;
+	}
+
+	std::vector<GLboolean> &usedTextures = pending->usedTextures;
+	usedTextures.assign(result->texturesCount, GL_FALSE);
+	std::vector<GLboolean> usedViews(viewsCount, GL_FALSE);
+	for (GLuint i = 0; i < result->materialsCount; i++)
+	{
+		if (!usedMaterials[i])
+			continue;
+		GLint materialTextures[] = { materials[i].baseColorTexture, materials[i].metallicRoughnessTexture, materials[i].normalTexture, materials[i].occlusionTexture, materials[i].emissiveTexture };
+		for (GLuint j = 0; j < 5; j++)
 		{
-			rapidjson::Value& baseColor = value[i]["pbrMetallicRoughness"]["baseColorFactor"];
-			materials[i].color.r = baseColor[0].GetFloat();
-			materials[i].color.g = baseColor[1].GetFloat();
-			materials[i].color.b = baseColor[2].GetFloat();
-			materials[i].color.a = baseColor[3].GetFloat();
+			if (0 <= materialTextures[j] && (GLuint)materialTextures[j] < result->texturesCount)
+				usedTextures[materialTextures[j]] = GL_TRUE;
 		}
-		materials[i].metallic = value[i]["pbrMetallicRoughness"]["metallicFactor"].GetFloat();
+	}
+	for (GLuint i = 0; i < result->texturesCount; i++)
+	{
+		GLint source = result->textures[i].source;
+		if (usedTextures[i] && 0 <= source && (GLuint)source < result->imagesCount && 0 <= result->images[source].view && (GLuint)result->images[source].view < viewsCount)
+			usedViews[result->images[source].view] = GL_TRUE;
+	}
+	//Loads without upload keep every embedded image, the GlbWriter writes them all
+	for (GLuint i = 0; i < result->imagesCount && !options.upload; i++)
+	{
+		if (0 <= result->images[i].view && (GLuint)result->images[i].view < viewsCount)
+			usedViews[result->images[i].view] = GL_TRUE;
+	}
+	for (GLuint i = 0; i < accessorsCount; i++)
+	{
+		if (usedAccessors[i] && accessors[i].view < viewsCount)
+			usedViews[accessors[i].view] = GL_TRUE;
 	}
 
-	Mesh* meshes = nullptr;
+	//Buffer ranges and images are only queued here, they are all read in one batch once the primitives are known
+	std::vector<FileRead> reads;
+	std::vector<GLint> readTargets;
+	value = json["buffers"];
+	buffersCount = value.Size();
+	buffers = new Buffer[buffersCount];
+	for (GLuint i = 0; i < buffersCount; i++)
+	{
+		//Only the first buffer of a .glb may leave out its uri, it is the BIN chunk
+		if (!value[i].HasMember("uri"))
+		{
+			GLuint64 byteLength = value[i].HasMember("byteLength") ? value[i]["byteLength"].GetUint64() : 0;
+			if (0 != i || nullptr == binChunk || byteLength > binChunkSize)
+			{
+				std::cout << "LOADER::GLTF::BUFFERS Message: Buffer " << i << " has no uri and no binary chunk holds it." << std::endl;
+				delete[] buffers;
+				return nullptr;
+			}
+			buffers[i].data = (GLubyte*)binChunk;
+			buffers[i].size = byteLength;
+			buffers[i].mapped = GL_TRUE;
+			continue;
+		}
+		result->dependencies.push_back(uriPath(fileDir, value[i]["uri"].GetString()));
+		if (!this->ReadBuffer(result->dependencies.back(), i, views, viewsCount, usedViews, options, &buffers[i], reads))
+		{
+			//Nothing was read yet, the queued reads all point into the buffers
+			delete[] buffers;
+			return nullptr;
+		}
+		readTargets.resize(reads.size(), (GLint)i);
+	}
+
+	//Buffer view bytes go straight to the GPU when nothing needs the decoded vertices on the CPU
+	GLboolean &viewUpload = pending->viewUpload;
+	viewUpload = options.upload && !options.deferUpload && options.viewUpload && !options.weld && !Endian::IsBigEndian();
+	std::vector<PrimitiveSource> &sources = pending->sources;
+	Mesh *&meshes = pending->meshes;
 	value = json["meshes"]; 
 	result->meshesCount = value.Size();
 	meshes = new Mesh[result->meshesCount];
 	result->meshes = meshes;
 	for (GLuint i = 0; i < result->meshesCount; i++)
 	{
+		if (!usedMeshes[i])
+			continue;
 		if (!value[i].HasMember("primitives") || !value[i]["primitives"].IsArray() || value[i]["primitives"].Empty())
 		{
 			std::cout << "LOADER::GLTF::MESHES::PRIMITIVES Message: Could not find meshes' primitives array." << std::endl;
@@ -210,10 +832,16 @@ glTFFile* Loader::LoadFile(const char *filePath)
 			if (!primitives[j].HasMember("attributes"))
 			{
 				std::cout << "LOADER::GLTF::MESHES::PRIMITIVES::ATTRIBUTES Message: Could not find meshes.primitives.attributtes." << std::endl;
+				for (GLuint k = 0; k < reads.size(); k++)
+				{
+					if (0 > readTargets[k])
+						delete[] reads[k].destination;
+				}
 				delete[] buffers;
-				delete[] views;
 				delete[] meshes;
-				return result;
+				result->meshes = nullptr;
+				result->meshesCount = 0;
+				return nullptr;
 			}
 
 			rapidjson::Value& attributes = primitives[j]["attributes"];
@@ -225,77 +853,282 @@ glTFFile* Loader::LoadFile(const char *filePath)
 			GLuint indicesAccess = primitives[j]["indices"].GetUint();
 
 			GLuint material = primitives[j]["material"].GetUint();
-			GLuint indicesCount = accessors[indicesAccess].count;
-			GLuint verticesCount = accessors[positions].count;
-			GLuint *indices = new GLuint[indicesCount];
-			Vertex *vertices = new Vertex[verticesCount];
-
-			for (GLuint k = 0; k < indicesCount; k++)
+			Box *boundingBox = &meshes[i].boundingBoxes[j];
+			Accessor *positionsAccessor = &accessors[positions];
+			for (GLuint c = 0; c < 3; c++)
 			{
-				BufferView* view = &views[indicesAccess];
-				Buffer* buffer = &buffers[view->buffer];
-				switch (accessors[indicesAccess].componentType)
+				GLfloat min, max;
+				switch (positionsAccessor->componentType)
 				{
 				case GL_BYTE:
-					indices[k] = *(GLbyte*)&buffer->data[view->offset + (accessors[indicesAccess].size * k)];
+					min = ((GLbyte*)positionsAccessor->min)[c];
+					max = ((GLbyte*)positionsAccessor->max)[c];
 					break;
 				case GL_UNSIGNED_BYTE:
-					indices[k] = *(GLubyte*)&buffer->data[view->offset + (accessors[indicesAccess].size * k)];
+					min = ((GLubyte*)positionsAccessor->min)[c];
+					max = ((GLubyte*)positionsAccessor->max)[c];
 					break;
 				case GL_SHORT:
-					indices[k] = *(GLshort*)&buffer->data[view->offset + (accessors[indicesAccess].size * k)];
+					min = ((GLshort*)positionsAccessor->min)[c];
+					max = ((GLshort*)positionsAccessor->max)[c];
 					break;
 				case GL_UNSIGNED_SHORT:
-					indices[k] = *(GLushort*)&buffer->data[view->offset + (accessors[indicesAccess].size * k)];
+					min = ((GLushort*)positionsAccessor->min)[c];
+					max = ((GLushort*)positionsAccessor->max)[c];
 					break;
-				case GL_UNSIGNED_INT:
-					indices[k] = *(GLuint*)&buffer->data[view->offset + (accessors[indicesAccess].size * k)];
+				default:
+					min = ((GLfloat*)positionsAccessor->min)[c];
+					max = ((GLfloat*)positionsAccessor->max)[c];
 					break;
 				}
+				boundingBox->bounds[0][c] = componentValue(min, positionsAccessor->componentType, positionsAccessor->normalized);
+				boundingBox->bounds[1][c] = componentValue(max, positionsAccessor->componentType, positionsAccessor->normalized);
+			}
+
+			PrimitiveSource source = { &meshes[i].primitives[j], { positions, normals, texCoords0, tangents }, indicesAccess, material, 0 };
+			sources.push_back(source);
+		}
+	}
+
+	//Images go in the same batch, each one is handed to the TextureQueue as soon as it's read
+	if (options.upload)
+	{
+		std::vector<GLuint> textures;
+		this->QueueImageReads(result, fileDir, usedTextures, reads, textures);
+		for (GLuint i = 0; i < textures.size(); i++)
+			readTargets.push_back(-(GLint)textures[i] - 1);
+	}
+
+	//Primitives are independent once the accessors are parsed, each one is decoded into its own arrays so the
+	//result doesn't depend on the order. A primitive is decoded as soon as the buffers it reads from have landed,
+	//while the rest of the batch is still being read. Streamed buffers slide a single window and are decoded in order at the end
+	GLboolean &streamed = pending->streamed;
+	for (GLuint i = 0; i < buffersCount; i++)
+		streamed = streamed || nullptr != buffers[i].stream;
+	std::vector<GLuint> pendingReads(buffersCount, 0);
+	//Buffers with a short or failed read, their primitives are never decoded and the load fails
+	std::vector<GLboolean> failedBuffers(buffersCount, GL_FALSE);
+	for (GLuint i = 0; i < readTargets.size(); i++)
+	{
+		if (0 <= readTargets[i])
+			pendingReads[readTargets[i]]++;
+	}
+	//Primitives waiting on each buffer
+	std::vector<std::vector<GLuint>> waiting(buffersCount);
+	for (GLuint i = 0; i < sources.size(); i++)
+	{
+		std::vector<GLuint> used;
+		for (GLuint k = 0; k < 5; k++)
+		{
+			GLuint accessor = k < 4 ? sources[i].attributes[k] : sources[i].indices;
+			if (accessor < accessorsCount && accessors[accessor].view < viewsCount && views[accessors[accessor].view].buffer < buffersCount)
+				used.push_back(views[accessors[accessor].view].buffer);
+		}
+		std::sort(used.begin(), used.end());
+		used.erase(std::unique(used.begin(), used.end()), used.end());
+		for (GLuint k = 0; k < used.size(); k++)
+		{
+			if (0 == pendingReads[used[k]])
+				continue;
+			waiting[used[k]].push_back(i);
+			sources[i].pending++;
+		}
+	}
+
+	//Decodes are claimed once, either by a worker as soon as the data lands or by FinishLoad after the batch.
+	//Early decodes can still run while the load waits between its stages, they only use what pending owns
+	std::shared_ptr<DecodeBatch> &batch = pending->batch;
+	batch = std::make_shared<DecodeBatch>();
+	batch->claimed.assign(sources.size(), GL_FALSE);
+	batch->finished = 0;
+	PendingLoad *context = pending.get();
+	std::function<void(GLuint)> &decodeClaimed = pending->decodeClaimed;
+	decodeClaimed = [this, context](GLuint i)
+	{
+		PrimitiveSource *source = &context->sources[i];
+		if (!context->options.cancellation.IsCancelled())
+			this->DecodePrimitive(source->primitive, context->buffers, context->views, context->accessors, source->attributes, source->indices, source->material);
+		if (nullptr != context->options.progress)
+			context->options.progress->done[LOAD_STAGE_DECODE]++;
+		{
+			std::lock_guard<std::mutex> lock(context->batch->mutex);
+			context->batch->finished++;
+		}
+		context->batch->done.notify_all();
+	};
+	pending->decode = [context](GLuint i)
+	{
+		{
+			std::lock_guard<std::mutex> lock(context->batch->mutex);
+			if (context->batch->claimed[i])
+				return;
+			context->batch->claimed[i] = GL_TRUE;
+		}
+		context->decodeClaimed(i);
+	};
+	ThreadPool *pool = ThreadPool::GetPointerInstance();
+	GLboolean early = !streamed && !viewUpload && nullptr != pool;
+
+	if (nullptr != options.progress)
+	{
+		options.progress->total[LOAD_STAGE_DECODE] = (GLuint)sources.size();
+		options.progress->Begin(LOAD_STAGE_READ, (GLuint)reads.size());
+	}
+	this->mReader.Read(reads, [&](GLuint i)
+	{
+		FileRead *read = &reads[i];
+		if (nullptr != options.progress)
+			options.progress->done[LOAD_STAGE_READ]++;
+		if (0 > readTargets[i])
+		{
+			GLuint texture = (GLuint)(-readTargets[i] - 1);
+			if (read->read != read->size)
+				std::cout << "LOADER::GLTF::IMAGES Message: Could not read " << read->path << std::endl;
+			if (read->read == read->size && !options.cancellation.IsCancelled())
+				TextureQueue::GetInstance().Request(result, texture, read->destination, (GLuint)read->size);
+			else
+				delete[] read->destination;
+			return;
+		}
+		if (read->read != read->size)
+		{
+			std::cout << "LOADER::GLTF::BUFFERS Message: Could not read " << read->path << std::endl;
+			failedBuffers[readTargets[i]] = GL_TRUE;
+		}
+		if (0 != --pendingReads[readTargets[i]] || failedBuffers[readTargets[i]])
+			return;
+		std::vector<GLuint> &ready = waiting[readTargets[i]];
+		for (GLuint k = 0; k < ready.size(); k++)
+		{
+			//The job may only run after loading ended, it must find the batch alive and touch nothing else
+			//unless it claims the primitive, loading waits for every claimed decode
+			if (0 == --sources[ready[k]].pending && early)
+			{
+				std::function<void(GLuint)> *job = &decodeClaimed;
+				GLuint index = ready[k];
+				pool->Enqueue([batch, job, index]()
+				{
+					{
+						std::lock_guard<std::mutex> lock(batch->mutex);
+						if (batch->claimed[index])
+							return;
+						batch->claimed[index] = GL_TRUE;
+					}
+					(*job)(index);
+				});
 			}
+		}
+	});
 
-			for (GLuint k = 0; k < verticesCount; k++)
+	if (failedBuffers.end() != std::find(failedBuffers.begin(), failedBuffers.end(), GL_TRUE))
+	{
+		//Decodes already running finish before the buffers are freed, the rest are never started
+		{
+			std::unique_lock<std::mutex> lock(batch->mutex);
+			GLuint started = 0;
+			for (GLuint i = 0; i < sources.size(); i++)
 			{
-				BufferView* viewPos = &views[accessors[positions].view];
-				BufferView* viewNor = &views[accessors[normals].view];
-				BufferView* viewTan = &views[accessors[tangents].view];
-				BufferView* viewTCo = &views[accessors[texCoords0].view];
-				Buffer* bufferPos = &buffers[viewPos->buffer];
-				Buffer* bufferNor = &buffers[viewNor->buffer];
-				Buffer* bufferTan = &buffers[viewTan->buffer];
-				Buffer* bufferTCo = &buffers[viewTCo->buffer];
-
-				GLuint dataStride = this->GetComponentSize(accessors[positions].componentType);
-				vertices[k].position.x = endian.littleFloat(*(GLfloat*)&bufferPos->data[viewPos->offset + (accessors[positions].size * k)]);
-				vertices[k].position.y = endian.littleFloat(*(GLfloat*)&bufferPos->data[viewPos->offset + (accessors[positions].size * k) + dataStride]);
-				vertices[k].position.z = endian.littleFloat(*(GLfloat*)&bufferPos->data[viewPos->offset + (accessors[positions].size * k) + (dataStride * 2)]);
-
-				dataStride = this->GetComponentSize(accessors[normals].componentType);
-				vertices[k].normal.x = endian.littleFloat(*(GLfloat*)&bufferNor->data[viewNor->offset + (accessors[normals].size * k)]);
-				vertices[k].normal.y = endian.littleFloat(*(GLfloat*)&bufferNor->data[viewNor->offset + (accessors[normals].size * k) + dataStride]);
-				vertices[k].normal.z = endian.littleFloat(*(GLfloat*)&bufferNor->data[viewNor->offset + (accessors[normals].size * k) + (dataStride * 2)]);
-
-				dataStride = this->GetComponentSize(accessors[normals].componentType);
-				vertices[k].tangent.x = endian.littleFloat(*(GLfloat*)&bufferTan->data[viewTan->offset + (accessors[tangents].size * k)]);
-				vertices[k].tangent.y = endian.littleFloat(*(GLfloat*)&bufferTan->data[viewTan->offset + (accessors[tangents].size * k) + dataStride]);
-				vertices[k].tangent.z = endian.littleFloat(*(GLfloat*)&bufferTan->data[viewTan->offset + (accessors[tangents].size * k) + (dataStride * 2)]);
-
-				dataStride = this->GetComponentSize(accessors[texCoords0].componentType);
-				vertices[k].texCoord0.x = endian.littleFloat(*(GLfloat*)&bufferPos->data[viewTan->offset + (accessors[texCoords0].size * k)]);
-				vertices[k].texCoord0.y = endian.littleFloat(*(GLfloat*)&bufferPos->data[viewTan->offset + (accessors[texCoords0].size * k) + dataStride]);
+				started += batch->claimed[i] ? 1 : 0;
+				batch->claimed[i] = GL_TRUE;
 			}
+			batch->done.wait(lock, [&batch, started] { return started == batch->finished; });
+		}
+		std::cout << "LOADER::GLTF::BUFFERS Message: " << filePath << " is missing buffer data and was not loaded." << std::endl;
+		delete[] buffers;
+		delete[] meshes;
+		result->meshes = nullptr;
+		result->meshesCount = 0;
+		return nullptr;
+	}
+	return pending.release();
+}
 
-			Box *boundingBox = &meshes[i].boundingBoxes[j];
-			boundingBox->bounds[1].x = ((GLfloat*)accessors[positions].max)[0];
-			boundingBox->bounds[1].y = ((GLfloat*)accessors[positions].max)[1];
-			boundingBox->bounds[1].z = ((GLfloat*)accessors[positions].max)[2];
-			boundingBox->bounds[0].x = ((GLfloat*)accessors[positions].min)[0];
-			boundingBox->bounds[0].y = ((GLfloat*)accessors[positions].min)[1];
-			boundingBox->bounds[0].z = ((GLfloat*)accessors[positions].min)[2];
-			meshes[i].primitives[j].setup(vertices, verticesCount, indices, indicesCount, material);
+GLboolean Loader::FinishLoad(PendingLoad *pendingLoad)
+{
+	std::unique_ptr<PendingLoad> pending(pendingLoad);
+	GeometryRegistry *registry = GeometryRegistry::GetPointerInstance();
+	const LoadOptions &options = pending->options;
+	glTFFile *result = pending->result;
+	Buffer *buffers = pending->buffers;
+	BufferView *views = pending->views;
+	Accessor *accessors = pending->accessors;
+	GLuint viewsCount = pending->viewsCount;
+	Mesh *meshes = pending->meshes;
+	std::vector<PrimitiveSource> &sources = pending->sources;
+	std::shared_ptr<DecodeBatch> batch = pending->batch;
+	std::function<void(GLuint)> &decode = pending->decode;
+	rapidjson::Document &json = *pending->json;
+	rapidjson::Value &value = json["asset"];
+	ThreadPool *pool = ThreadPool::GetPointerInstance();
+	const std::string &fileDir = pending->fileDir;
+	const std::vector<GLboolean> &usedNodes = pending->usedNodes;
+	const std::vector<GLboolean> &usedTextures = pending->usedTextures;
+	GLboolean streamed = pending->streamed;
+	GLboolean viewUpload = pending->viewUpload;
+	GeometryRetention viewRetention = GEOMETRY_KEEP_ALL == options.retention ? GEOMETRY_KEEP_POSITIONS_ONLY : options.retention;
+
+	if (nullptr != options.progress)
+		options.progress->Begin(LOAD_STAGE_DECODE, (GLuint)sources.size());
+	if (options.upload && !options.cancellation.IsCancelled())
+		this->RequestTextures(result, fileDir, buffers, views, viewsCount, usedTextures);
+	for (GLuint i = 0; i < result->imagesCount && !options.upload; i++)
+	{
+		Image *image = &result->images[i];
+		if (0 > image->view || (GLuint)image->view >= viewsCount)
+			continue;
+		image->data.resize((size_t)views[image->view].size);
+		if (copyView(buffers, &views[image->view], image->data.data()) != views[image->view].size)
+		{
+			std::cout << "LOADER::GLTF::IMAGES Message: Embedded image " << i << " reads past the end of its buffer." << std::endl;
+			image->data.clear();
 		}
 	}
 
+	//View uploads run here, on the render thread, the primitives that can't be drawn from their views are decoded
+	std::vector<GLuint> decodes;
+	for (GLuint i = 0; i < sources.size(); i++)
+	{
+		if (viewUpload && this->UploadViews(sources[i].primitive, buffers, views, accessors, sources[i].attributes, sources[i].indices, sources[i].material, viewRetention))
+			continue;
+		decodes.push_back(i);
+	}
+	std::function<void(GLuint)> decodeRemaining = [&](GLuint i) { decode(decodes[i]); };
+	if (!streamed && nullptr != pool)
+		pool->ParallelFor((GLuint)decodes.size(), decodeRemaining);
+	else
+	{
+		for (GLuint i = 0; i < decodes.size(); i++)
+			decode(decodes[i]);
+	}
+	{
+		std::unique_lock<std::mutex> lock(batch->mutex);
+		GLuint expected = (GLuint)decodes.size();
+		batch->done.wait(lock, [&batch, expected] { return expected == batch->finished; });
+	}
+
+	//Primitives decoded into Vertex arrays, the ones uploaded from their views are already on the GPU
+	std::vector<Primitive*> decoded;
+	for (GLuint i = 0; i < result->meshesCount; i++)
+	{
+		for (GLuint j = 0; j < meshes[i].primitivesCount; j++)
+		{
+			if (nullptr != meshes[i].primitives[j].vertices)
+				decoded.push_back(&meshes[i].primitives[j]);
+		}
+	}
+
+	if (options.weld)
+		this->WeldPrimitives(result, decoded, options.weldTolerances);
+
+	for (GLuint i = 0; i < decoded.size() && !options.deferUpload; i++)
+	{
+		if (options.share && nullptr != registry)
+			registry->Share(decoded[i], options.upload);
+		else if (options.upload)
+			decoded[i]->upload();
+		if (options.upload)
+			decoded[i]->retain(options.retention);
+	}
 
 	Node* nodes;
 	value = json["nodes"];
@@ -308,7 +1141,10 @@ glTFFile* Loader::LoadFile(const char *filePath)
 		Box boundingBox;
 		boundingBox.bounds[1] = glm::vec3(-std::numeric_limits<GLfloat>::max());
 		boundingBox.bounds[0] = glm::vec3(std::numeric_limits<GLfloat>::max());
-		if (value[i].HasMember("mesh"))
+		if (value[i].HasMember("name"))
+			node->name = value[i]["name"].GetString();
+		//A mesh is shared by every node using it, nodes outside the selection keep their transform but draw nothing
+		if (value[i].HasMember("mesh") && usedNodes[i])
 		{
 			node->mesh = value[i]["mesh"].GetUint();
 			node->hasMesh = GL_TRUE;
@@ -338,7 +1174,7 @@ glTFFile* Loader::LoadFile(const char *filePath)
 		}
 		node->translation = glm::vec3(0.0);
 		node->scale = glm::vec3(1.0);
-		node->boundingBox = boundingBox;
+		node->localBoundingBox = boundingBox;
 		if (value[i].HasMember("translation") && value[i]["translation"].IsArray() && !value[i]["translation"].Empty())
 		{
 			node->translation.x = value[i]["translation"][0].GetFloat();
@@ -351,6 +1187,19 @@ glTFFile* Loader::LoadFile(const char *filePath)
 			node->scale.y = value[i]["scale"][1].GetFloat();
 			node->scale.z = value[i]["scale"][2].GetFloat();
 		}
+		//glTF stores rotations as x, y, z, w
+		if (value[i].HasMember("rotation") && value[i]["rotation"].IsArray() && 4 == value[i]["rotation"].Size())
+		{
+			node->rotation = glm::normalize(glm::quat(value[i]["rotation"][3].GetFloat(), value[i]["rotation"][0].GetFloat(), value[i]["rotation"][1].GetFloat(), value[i]["rotation"][2].GetFloat()));
+		}
+		if (value[i].HasMember("matrix") && value[i]["matrix"].IsArray() && 16 == value[i]["matrix"].Size())
+		{
+			//Column major, as glm
+			GLfloat *matrix = (GLfloat*)&node->matrix[0];
+			for (GLuint j = 0; j < 16; j++)
+				matrix[j] = value[i]["matrix"][j].GetFloat();
+			node->hasMatrix = GL_TRUE;
+		}
 	}
 
 	Scene* scenes;
@@ -373,7 +1222,513 @@ glTFFile* Loader::LoadFile(const char *filePath)
 	result->setup();
 
 	delete[] buffers;
-	delete[] views;
-	delete[] accessors;
-	return result;
+	return GL_TRUE;
+}
+
+GLboolean Loader::ReadBuffer(const std::string &path, GLuint index, BufferView *views, GLuint viewsCount, const std::vector<GLboolean> &used, const LoadOptions &options, Buffer *buffer, std::vector<FileRead> &reads)
+{
+	std::vector<GLuint> bufferViews;
+	for (GLuint i = 0; i < viewsCount; i++)
+	{
+		if (used[i] && index == views[i].buffer)
+			bufferViews.push_back(i);
+	}
+	if (bufferViews.empty())
+		return GL_TRUE;
+
+	//Archived buffers are used in place, compressed ones are decompressed whole. The views keep their offsets
+	AssetArchive *archive;
+	std::string entry;
+	const GLubyte *archived;
+	GLuint64 archivedSize;
+	if (this->findInArchives(path, &archive, &entry, &archived, &archivedSize))
+	{
+		buffer->size = archivedSize;
+		buffer->mapped = nullptr != archived;
+		buffer->data = (GLubyte*)archived;
+		if (!buffer->mapped)
+		{
+			buffer->data = new GLubyte[(size_t)archivedSize];
+			if (!archive->Read(entry, buffer->data))
+			{
+				std::cout << "LOADER::GLTF::ARCHIVE Message: Could not read " << path << " from its archive." << std::endl;
+				return GL_FALSE;
+			}
+		}
+		return GL_TRUE;
+	}
+	std::sort(bufferViews.begin(), bufferViews.end(), [views](GLuint a, GLuint b) { return views[a].offset < views[b].offset; });
+
+	//Overlapping and touching views are read as one range
+	std::vector<std::pair<GLuint64, GLuint64>> ranges;
+	GLuint64 size = 0;
+	for (GLuint i = 0; i < bufferViews.size(); i++)
+	{
+		BufferView *view = &views[bufferViews[i]];
+		if (ranges.empty() || view->offset > ranges.back().second)
+			ranges.push_back(std::make_pair(view->offset, view->offset + view->size));
+		else if (view->offset + view->size > ranges.back().second)
+			ranges.back().second = view->offset + view->size;
+	}
+	for (GLuint i = 0; i < ranges.size(); i++)
+		size += ranges[i].second - ranges[i].first;
+
+	if (size > options.streamThreshold)
+	{
+		std::ifstream *fileStream = new std::ifstream(path, std::ios::in | std::ios::binary);
+		if (!fileStream->is_open())
+		{
+			std::cout << "LOADER::GLTF::BUFFERS Message: Could not open " << path << std::endl;
+			delete fileStream;
+			return GL_FALSE;
+		}
+		//The views keep their offsets in the file, the window is filled on the first Map
+		fileStream->seekg(0, std::ios::end);
+		buffer->size = (GLuint64)fileStream->tellg();
+		buffer->stream = fileStream;
+		buffer->windowCapacity = options.streamWindow;
+		buffer->data = new GLubyte[(size_t)options.streamWindow];
+		return GL_TRUE;
+	}
+
+	buffer->data = new GLubyte[(size_t)size];
+	buffer->size = size;
+
+	//The ranges are packed one after the other and the views moved to their new offsets
+	GLuint64 packed = 0;
+	for (GLuint i = 0; i < ranges.size(); i++)
+	{
+		reads.push_back(FileRead(path, ranges[i].first, ranges[i].second - ranges[i].first, &buffer->data[packed]));
+		packed += ranges[i].second - ranges[i].first;
+	}
+
+	GLuint range = 0;
+	packed = 0;
+	for (GLuint i = 0; i < bufferViews.size(); i++)
+	{
+		BufferView *view = &views[bufferViews[i]];
+		while (view->offset >= ranges[range].second)
+		{
+			packed += ranges[range].second - ranges[range].first;
+			range++;
+		}
+		view->offset = packed + view->offset - ranges[range].first;
+	}
+	return GL_TRUE;
+}
+
+void Loader::RequestTextures(glTFFile *file, const std::string &fileDir, Buffer *buffers, BufferView *views, GLuint viewsCount, const std::vector<GLboolean> &used)
+{
+	if (nullptr == TextureQueue::GetPointerInstance())
+		return;
+
+	for (GLuint i = 0; i < file->texturesCount; i++)
+	{
+		if (!used[i])
+			continue;
+		Texture *texture = &file->textures[i];
+		if (0 > texture->source || (GLuint)texture->source >= file->imagesCount)
+		{
+			std::cout << "LOADER::GLTF::TEXTURES Message: Texture " << i << " has no valid source." << std::endl;
+			continue;
+		}
+
+		Image *image = &file->images[texture->source];
+		if (0 <= image->view && (GLuint)image->view < viewsCount)
+		{
+			//Buffers are freed when loading ends, the decoder gets its own copy of the encoded bytes
+			BufferView *view = &views[image->view];
+			GLubyte *data = new GLubyte[(size_t)view->size];
+			copyView(buffers, view, data);
+			TextureQueue::GetInstance().Request(file, i, data, (GLuint)view->size);
+		}
+		else if (0 == image->uri.compare(0, 5, "data:"))
+		{
+			std::cout << "LOADER::GLTF::IMAGES Message: Data uris are not supported." << std::endl;
+		}
+		else
+		{
+			//Images on disk were read with the buffers by QueueImageReads
+			std::string path = uriPath(fileDir, image->uri);
+			AssetArchive *archive;
+			std::string entry;
+			const GLubyte *archived;
+			GLuint64 archivedSize;
+			if (this->findInArchives(path, &archive, &entry, &archived, &archivedSize))
+			{
+				GLubyte *data = new GLubyte[(size_t)archivedSize];
+				if (nullptr != archived)
+					std::memcpy(data, archived, (size_t)archivedSize);
+				else if (!archive->Read(entry, data))
+				{
+					std::cout << "LOADER::GLTF::ARCHIVE Message: Could not read " << path << " from its archive, texture " << i << " is skipped." << std::endl;
+					delete[] data;
+					continue;
+				}
+				TextureQueue::GetInstance().Request(file, i, data, (GLuint)archivedSize);
+			}
+		}
+	}
+}
+
+void Loader::QueueImageReads(glTFFile *file, const std::string &fileDir, const std::vector<GLboolean> &used, std::vector<FileRead> &reads, std::vector<GLuint> &textures)
+{
+	if (nullptr == TextureQueue::GetPointerInstance())
+		return;
+
+	for (GLuint i = 0; i < file->texturesCount; i++)
+	{
+		Texture *texture = &file->textures[i];
+		if (!used[i] || 0 > texture->source || (GLuint)texture->source >= file->imagesCount)
+			continue;
+		Image *image = &file->images[texture->source];
+		if (0 <= image->view || image->uri.empty() || 0 == image->uri.compare(0, 5, "data:"))
+			continue;
+		std::string path = uriPath(fileDir, image->uri);
+		AssetArchive *archive;
+		std::string entry;
+		const GLubyte *archived;
+		GLuint64 archivedSize;
+		if (this->findInArchives(path, &archive, &entry, &archived, &archivedSize))
+			continue;
+		struct stat status;
+		if (0 != stat(path.c_str(), &status))
+		{
+			std::cout << "LOADER::GLTF::IMAGES Message: Could not open " << path << std::endl;
+			continue;
+		}
+		//The TextureQueue takes ownership of the bytes once they are read
+		reads.push_back(FileRead(path, 0, (GLuint64)status.st_size, new GLubyte[(size_t)status.st_size]));
+		textures.push_back(i);
+	}
+}
+
+void Loader::Mount(AssetArchive *archive, const std::string &root)
+{
+	MountedArchive mounted = { archive, AssetArchive::Normalize(root) };
+	this->mArchives.push_back(mounted);
+}
+
+void Loader::Unmount(AssetArchive *archive)
+{
+	this->mArchives.erase(std::remove_if(this->mArchives.begin(), this->mArchives.end(), [archive](const MountedArchive &mounted) { return archive == mounted.archive; }), this->mArchives.end());
+}
+
+GLboolean Loader::findInArchives(const std::string &path, AssetArchive **archive, std::string *entry, const GLubyte **data, GLuint64 *size)
+{
+	std::string normalized = AssetArchive::Normalize(path);
+	for (GLuint i = (GLuint)this->mArchives.size(); i > 0; i--)
+	{
+		const MountedArchive *mounted = &this->mArchives[i - 1];
+		*archive = mounted->archive;
+		*entry = normalized;
+		if (!mounted->root.empty())
+		{
+			//Only paths inside the root are in the archive
+			if (normalized.size() <= mounted->root.size() || 0 != normalized.compare(0, mounted->root.size(), mounted->root) || '\\' != normalized[mounted->root.size()])
+				continue;
+			*entry = normalized.substr(mounted->root.size() + 1);
+		}
+		if ((*archive)->Find(*entry, data, size))
+			return GL_TRUE;
+	}
+	return GL_FALSE;
+}
+
+GLboolean Loader::Reload(glTFFile *file)
+{
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+	LoadOptions loadOptions = nullptr != file->loadOptions ? *file->loadOptions : LoadOptions();
+	LoadOptions options = loadOptions;
+	options.upload = GL_FALSE;
+	options.share = GL_FALSE;
+	glTFFile fresh;
+	if (!this->load(file->path.c_str(), options, &fresh))
+	{
+		std::cout << "LOADER::RELOAD Message: " << file->path << " could not be parsed, keeping the loaded version." << std::endl;
+		return GL_FALSE;
+	}
+
+	if (!this->SameStructure(file, &fresh))
+	{
+		//The fresh copy has no GL objects or textures, the file is loaded again in place with uploads on
+		file->clear();
+		if (!this->load(fresh.path.c_str(), loadOptions, file))
+		{
+			std::cout << "LOADER::RELOAD Message: " << fresh.path << " changed structure and could not be loaded again." << std::endl;
+			return GL_FALSE;
+		}
+		std::cout << "LOADER::RELOAD Message: " << file->path << " changed structure, reloaded completely." << std::endl;
+		return GL_TRUE;
+	}
+
+	GLuint uploaded = 0, patched = 0;
+	for (GLuint i = 0; i < file->meshesCount; i++)
+	{
+		Mesh *mesh = &file->meshes[i];
+		Mesh *freshMesh = &fresh.meshes[i];
+		for (GLuint j = 0; j < mesh->primitivesCount; j++)
+		{
+			Primitive *primitive = &mesh->primitives[j];
+			Primitive *freshPrimitive = &freshMesh->primitives[j];
+			mesh->boundingBoxes[j] = freshMesh->boundingBoxes[j];
+			primitive->material = freshPrimitive->material;
+			//Without the CPU copy there's nothing to compare, the primitive is always sent again
+			if (nullptr != primitive->vertices && nullptr != primitive->indices &&
+				primitive->verticesCount == freshPrimitive->verticesCount && primitive->indicesCount == freshPrimitive->indicesCount &&
+				0 == std::memcmp(primitive->vertices, freshPrimitive->vertices, primitive->verticesCount * sizeof(Vertex)) &&
+				0 == std::memcmp(primitive->indices, freshPrimitive->indices, primitive->indicesCount * sizeof(GLuint)))
+				continue;
+
+			//Shared data may still be used by other files, the changed primitive gets its own copy
+			if (0 != primitive->hash)
+				GeometryRegistry::GetInstance().Release(primitive);
+			//Buffers laid out as the file had them can't take the decoded arrays
+			else if (primitive->IsViewLayout())
+				primitive->releaseBuffers();
+			//Take the freshly decoded arrays and send them through the existing buffers
+			std::swap(primitive->vertices, freshPrimitive->vertices);
+			std::swap(primitive->indices, freshPrimitive->indices);
+			std::swap(primitive->verticesCount, freshPrimitive->verticesCount);
+			std::swap(primitive->indicesCount, freshPrimitive->indicesCount);
+			if (nullptr != GeometryRegistry::GetPointerInstance())
+				GeometryRegistry::GetInstance().Share(primitive, GL_TRUE);
+			else
+				primitive->upload();
+			delete[] primitive->positions;
+			primitive->positions = nullptr;
+			primitive->retain(file->retention);
+			uploaded++;
+		}
+	}
+
+	for (GLuint i = 0; i < file->materialsCount; i++)
+	{
+		Material *material = &file->materials[i];
+		Material *freshMaterial = &fresh.materials[i];
+		material->color = freshMaterial->color;
+		material->metallic = freshMaterial->metallic;
+		material->roughness = freshMaterial->roughness;
+		material->emissive = freshMaterial->emissive;
+		material->blend = freshMaterial->blend;
+	}
+
+	for (GLuint i = 0; i < file->nodesCount; i++)
+	{
+		Node *node = &file->nodes[i];
+		Node *freshNode = &fresh.nodes[i];
+		GLboolean moved = node->translation != freshNode->translation || node->rotation != freshNode->rotation || node->scale != freshNode->scale ||
+			node->hasMatrix != freshNode->hasMatrix || (freshNode->hasMatrix && node->matrix != freshNode->matrix);
+		GLboolean resized = node->localBoundingBox.bounds[0] != freshNode->localBoundingBox.bounds[0] || node->localBoundingBox.bounds[1] != freshNode->localBoundingBox.bounds[1];
+		if (moved)
+			patched++;
+		if (!moved && !resized)
+			continue;
+		node->translation = freshNode->translation;
+		node->rotation = freshNode->rotation;
+		node->scale = freshNode->scale;
+		node->matrix = freshNode->matrix;
+		node->hasMatrix = freshNode->hasMatrix;
+		node->localBoundingBox = freshNode->localBoundingBox;
+		//Only the changed subtrees are computed again
+		file->MarkDirty(i);
+	}
+	file->UpdateTransforms();
+
+	std::chrono::duration<GLdouble, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+	std::cout << "LOADER::RELOAD Message: " << file->path << " " << uploaded << " primitives uploaded, " << patched << " nodes patched in " << elapsed.count() << "ms." << std::endl;
+	return GL_TRUE;
+}
+
+GLboolean Loader::SameStructure(glTFFile *a, glTFFile *b)
+{
+	if (a->meshesCount != b->meshesCount || a->nodesCount != b->nodesCount || a->scenesCount != b->scenesCount ||
+		a->materialsCount != b->materialsCount || a->texturesCount != b->texturesCount || a->imagesCount != b->imagesCount)
+		return GL_FALSE;
+	for (GLuint i = 0; i < a->meshesCount; i++)
+	{
+		if (a->meshes[i].primitivesCount != b->meshes[i].primitivesCount)
+			return GL_FALSE;
+	}
+	for (GLuint i = 0; i < a->nodesCount; i++)
+	{
+		Node *nodeA = &a->nodes[i], *nodeB = &b->nodes[i];
+		if (nodeA->hasMesh != nodeB->hasMesh || (nodeA->hasMesh && nodeA->mesh != nodeB->mesh) || nodeA->childrenCount != nodeB->childrenCount)
+			return GL_FALSE;
+		for (GLuint j = 0; j < nodeA->childrenCount; j++)
+		{
+			if (nodeA->children[j] != nodeB->children[j])
+				return GL_FALSE;
+		}
+	}
+	for (GLuint i = 0; i < a->scenesCount; i++)
+	{
+		if (a->scenes[i].nodesCount != b->scenes[i].nodesCount || 0 != std::memcmp(a->scenes[i].nodes, b->scenes[i].nodes, a->scenes[i].nodesCount * sizeof(GLuint)))
+			return GL_FALSE;
+	}
+	//Texture changes need new decodes, those go through a full reload
+	for (GLuint i = 0; i < a->imagesCount; i++)
+	{
+		if (a->images[i].uri != b->images[i].uri || a->images[i].view != b->images[i].view)
+			return GL_FALSE;
+	}
+	for (GLuint i = 0; i < a->texturesCount; i++)
+	{
+		if (a->textures[i].source != b->textures[i].source || a->textures[i].sampler != b->textures[i].sampler)
+			return GL_FALSE;
+	}
+	return GL_TRUE;
+}
+
+GLboolean Loader::UploadViews(Primitive *primitive, Buffer *buffers, BufferView *views, Accessor *accessors, const GLuint *attributes, GLuint indicesAccess, GLuint material, GeometryRetention retention)
+{
+	//Float components of the position, normal, texture coordinates and tangent locations
+	static const GLint components[] = { 3, 3, 2, 4 };
+	Accessor *index = &accessors[indicesAccess];
+	Buffer *indexBuffer = &buffers[views[index->view].buffer];
+	if ((GL_UNSIGNED_BYTE != index->componentType && GL_UNSIGNED_SHORT != index->componentType && GL_UNSIGNED_INT != index->componentType) || nullptr != indexBuffer->stream)
+		return GL_FALSE;
+
+	GLuint buffer = views[accessors[attributes[0]].view].buffer;
+	GLuint count = accessors[attributes[0]].count;
+	GLuint64 start = std::numeric_limits<GLuint64>::max(), end = 0, used = 0;
+	AttributeLayout layout[4];
+	for (GLuint i = 0; i < 4; i++)
+	{
+		Accessor *accessor = &accessors[attributes[i]];
+		BufferView *view = &views[accessor->view];
+		if (GL_FLOAT != accessor->componentType || components[i] != (GLint)this->GetComponentCount(accessor->type) || buffer != view->buffer || count != accessor->count)
+			return GL_FALSE;
+		layout[i].components = components[i];
+		layout[i].stride = 0 != view->stride ? view->stride : accessor->size;
+		layout[i].offset = view->offset + accessor->offset;
+		GLuint64 last = layout[i].offset + (GLuint64)layout[i].stride * (count - 1) + accessor->size;
+		start = std::min(start, layout[i].offset);
+		end = std::max(end, last);
+		used += last - layout[i].offset;
+	}
+	//Other data lying between the attributes would be uploaded along with them
+	if (nullptr != buffers[buffer].stream || end - start > 2 * used)
+		return GL_FALSE;
+	for (GLuint i = 0; i < 4; i++)
+		layout[i].offset -= start;
+
+	const GLubyte *indexData = &indexBuffer->data[views[index->view].offset + index->offset];
+	primitive->uploadView(&buffers[buffer].data[start], end - start, layout, 4, indexData, (GLuint64)index->count * index->size, index->componentType);
+
+	//Picking and collision still need positions and indices
+	GLuint *indices = nullptr;
+	if (GEOMETRY_KEEP_POSITIONS_ONLY == retention)
+	{
+		indices = new GLuint[index->count];
+		primitive->positions = new glm::vec3[count];
+		GLenum type = index->componentType;
+		forEachElement(buffers, views, index, index->count, [&](const GLubyte *element, GLuint k)
+		{
+			indices[k] = GL_UNSIGNED_BYTE == type ? *(GLubyte*)element : (GL_UNSIGNED_SHORT == type ? *(GLushort*)element : *(GLuint*)element);
+		});
+		forEachElement(buffers, views, &accessors[attributes[0]], count, [&](const GLubyte *element, GLuint k)
+		{
+			std::memcpy(&primitive->positions[k], element, sizeof(glm::vec3));
+		});
+	}
+	primitive->setup(nullptr, count, indices, index->count, material);
+	return GL_TRUE;
+}
+
+WeldResult Loader::WeldPrimitives(glTFFile *file, const std::vector<Primitive*> &primitives, const WeldTolerances &tolerances)
+{
+	std::vector<WeldResult> results(primitives.size());
+	std::function<void(GLuint)> weld = [&](GLuint i) { results[i] = WeldVertices(primitives[i], tolerances); };
+	if (nullptr != ThreadPool::GetPointerInstance())
+		ThreadPool::GetInstance().ParallelFor((GLuint)primitives.size(), weld);
+	else
+	{
+		for (GLuint i = 0; i < primitives.size(); i++)
+			weld(i);
+	}
+
+	WeldResult total;
+	for (GLuint i = 0; i < results.size(); i++)
+	{
+		total.verticesBefore += results[i].verticesBefore;
+		total.verticesAfter += results[i].verticesAfter;
+	}
+	if (total.verticesAfter < total.verticesBefore)
+	{
+		std::cout << "LOADER::WELD Message: " << file->path << " " << total.verticesBefore << " -> " << total.verticesAfter << " vertices, "
+			<< (GLuint64)(total.verticesBefore - total.verticesAfter) * sizeof(Vertex) << " bytes saved." << std::endl;
+	}
+	return total;
+}
+
+void Loader::DecodePrimitive(Primitive *primitive, Buffer *buffers, BufferView *views, Accessor *accessors, const GLuint *attributes, GLuint indicesAccess, GLuint material)
+{
+	GLuint positions = attributes[0], normals = attributes[1], texCoords0 = attributes[2], tangents = attributes[3];
+	GLuint indicesCount = accessors[indicesAccess].count;
+	GLuint verticesCount = accessors[positions].count;
+	GLuint *indices = new GLuint[indicesCount];
+	Vertex *vertices = new Vertex[verticesCount];
+
+	GLuint indexType = accessors[indicesAccess].componentType;
+	forEachElement(buffers, views, &accessors[indicesAccess], indicesCount, [&](const GLubyte *element, GLuint k)
+	{
+		switch (indexType)
+		{
+		case GL_BYTE:
+			indices[k] = *(GLbyte*)element;
+			break;
+		case GL_UNSIGNED_BYTE:
+			indices[k] = *(GLubyte*)element;
+			break;
+		case GL_SHORT:
+			indices[k] = Endian::Little(*(GLshort*)element);
+			break;
+		case GL_UNSIGNED_SHORT:
+			indices[k] = Endian::Little(*(GLushort*)element);
+			break;
+		case GL_UNSIGNED_INT:
+			indices[k] = *(GLuint*)element;
+			break;
+		}
+	});
+	if (GL_UNSIGNED_INT == indexType)
+		Endian::ConvertLittle(std::span<GLuint>(indices, indicesCount));
+
+	//Components are copied in file order and converted in one pass over the whole array afterwards.
+	//Quantized ones are widened to floats on the way, see readComponents
+	Accessor *positionsAccessor = &accessors[positions];
+	forEachElement(buffers, views, positionsAccessor, verticesCount, [&](const GLubyte *element, GLuint k)
+	{
+		readComponents(element, positionsAccessor, 3, &vertices[k].position.x);
+		//Every byte is set so identical primitives hash and compare equal
+		vertices[k].bitangent = glm::vec3(0.0f);
+	});
+
+	Accessor *normalsAccessor = &accessors[normals];
+	forEachElement(buffers, views, normalsAccessor, verticesCount, [&](const GLubyte *element, GLuint k)
+	{
+		readComponents(element, normalsAccessor, 3, &vertices[k].normal.x);
+	});
+
+	//Handedness of the bitangent, used to build the normal map basis
+	Accessor *tangentsAccessor = &accessors[tangents];
+	GLboolean hasHandedness = 4 == this->GetComponentCount(tangentsAccessor->type);
+	GLuint tangentComponents = hasHandedness ? 4 : 3;
+	forEachElement(buffers, views, tangentsAccessor, verticesCount, [&](const GLubyte *element, GLuint k)
+	{
+		readComponents(element, tangentsAccessor, tangentComponents, &vertices[k].tangent.x);
+	});
+
+	Accessor *texCoordsAccessor = &accessors[texCoords0];
+	forEachElement(buffers, views, texCoordsAccessor, verticesCount, [&](const GLubyte *element, GLuint k)
+	{
+		readComponents(element, texCoordsAccessor, 2, &vertices[k].texCoord0.x);
+	});
+
+	Endian::ConvertLittle(std::span<GLfloat>((GLfloat*)vertices, verticesCount * (sizeof(Vertex) / sizeof(GLfloat))));
+	for (GLuint k = 0; k < verticesCount && !hasHandedness; k++)
+		vertices[k].tangent.w = 1.0f;
+
+	primitive->setup(vertices, verticesCount, indices, indicesCount, material);
 }
\ No newline at end of file
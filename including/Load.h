@@ -1,14 +1,175 @@
 #pragma once
 #include "Types.h"
+#include "VertexWeld.h"
+#include "Endian.h"
+#include "AssetArchive.h"
+#include "AsyncReader.h"
 #include <string>
+#include <vector>
+#include <functional>
+#include <atomic>
+#include <memory>
+
+//Shared flag telling a load its result isn't wanted anymore, copies share the flag
+class CancellationToken
+{
+public:
+	CancellationToken() : mCancelled(std::make_shared<std::atomic<bool>>(false)) {}
+	void Cancel() { *this->mCancelled = true; }
+	GLboolean IsCancelled() const { return *this->mCancelled ? GL_TRUE : GL_FALSE; }
+
+private:
+	std::shared_ptr<std::atomic<bool>> mCancelled;
+};
+
+enum LoadStage
+{
+	LOAD_STAGE_READ,
+	LOAD_STAGE_DECODE,
+	LOAD_STAGE_UPLOAD,
+	LOAD_STAGES_COUNT
+};
+
+//Written by the stages of a load and readable from any thread. The stages overlap, decoding starts while reads are in flight
+struct LoadProgress
+{
+	//Latest stage started, LOAD_STAGES_COUNT once the load ended
+	std::atomic<GLuint> stage;
+	//Units of each stage: reads landed, primitives decoded and primitives uploaded
+	std::atomic<GLuint> done[LOAD_STAGES_COUNT];
+	std::atomic<GLuint> total[LOAD_STAGES_COUNT];
+	LoadProgress() : stage(LOAD_STAGE_READ)
+	{
+		for (GLuint i = 0; i < LOAD_STAGES_COUNT; i++)
+		{
+			done[i] = 0;
+			total[i] = 0;
+		}
+	}
+	void Begin(LoadStage started, GLuint units) { total[started] = units; stage = started; }
+	GLfloat GetFraction(LoadStage of) const { return 0 == total[of] ? (stage > (GLuint)of ? 1.0f : 0.0f) : done[of] / (GLfloat)total[of]; }
+};
+
+struct LoadOptions
+{
+	//Create the GL buffers and request the textures, off when only the CPU side is wanted
+	GLboolean upload;
+	//Share identical primitives with the other loaded files through the GeometryRegistry, when it's started
+	GLboolean share;
+	//CPU copy kept after the upload, everything is kept when upload is off
+	GeometryRetention retention;
+
+	//Partial loading: only the meshes, textures and buffer ranges reachable from the selected nodes are read,
+	//the arrays keep every entry of the file so indices stay valid. Scene to load, -1 for every scene
+	GLint scene;
+	//Nodes loaded with their children, matched by index, by name or by nodeFilter. When all are empty every node of the scene is loaded
+	std::vector<GLuint> nodeIndices;
+	std::vector<std::string> nodeNames;
+	std::function<GLboolean(GLuint index, const std::string &name)> nodeFilter;
+	//Buffers needing more bytes than streamThreshold are not read whole, accessors are decoded through a sliding window of streamWindow bytes
+	GLuint64 streamThreshold;
+	GLuint64 streamWindow;
+	//Upload float attributes straight from the buffer views when their layout allows it, skipping the decode into Vertex.
+	//Off by default. Those primitives aren't shared and keep at most positions and indices, GEOMETRY_KEEP_ALL keeps positions only.
+	//Not used with weld or deferUpload
+	GLboolean viewUpload;
+	//Merge duplicated vertices and drop the unused ones before the upload
+	GLboolean weld;
+	WeldTolerances weldTolerances;
+	//Decode without touching GL, the primitives are shared, uploaded and retained later on the render thread by a LoadTask.
+	//Textures are still requested when upload is on
+	GLboolean deferUpload;
+	//Checked as the stages go, a cancelled load skips the decodes and texture requests left
+	CancellationToken cancellation;
+	LoadProgress *progress;
+	LoadOptions() : upload(GL_TRUE), share(GL_TRUE), retention(GEOMETRY_KEEP_ALL), scene(-1), streamThreshold(512ull * 1024 * 1024), streamWindow(64ull * 1024 * 1024), viewUpload(GL_FALSE), weld(GL_FALSE), deferUpload(GL_FALSE), progress(nullptr) {}
+};
+
+//A load stopped between its read and decode stages, see Loader::BeginLoad
+struct PendingLoad;
+
+struct MountedArchive
+{
+	AssetArchive *archive;
+	//Normalized with AssetArchive::Normalize
+	std::string root;
+};
 
 class Loader
 {
 public:
+	Loader();
+	~Loader();
+
+	glTFFile* LoadFile(const char *filePath, const LoadOptions &options = LoadOptions());
+
+	//LoadFile in two stages a caller can suspend between: BeginLoad parses the file and reads its buffers and images,
+	//decoding what's ready while the rest is read, and FinishLoad decodes the rest and builds the nodes into result.
+	//BeginLoad returns nullptr when the file can't be loaded. Every pending load has to be finished, with no other
+	//load on this Loader in between since the document lives in its scratch storage
+	PendingLoad *BeginLoad(const char *filePath, const LoadOptions &options, glTFFile *result);
+	GLboolean FinishLoad(PendingLoad *pending);
 
-	glTFFile* LoadFile(const char *filePath);
+	//Parses file->path again with the options it was loaded with and patches the loaded file: only primitives whose data
+	//changed are uploaded and node transforms are updated in place. Structural changes reload the whole file into the same object.
+	//Returns GL_FALSE when the file can't be loaded, a failed structural reload leaves the file empty
+	GLboolean Reload(glTFFile *file);
+
+	//Paths are looked up in the mounted archives, latest mounted first, before going to the filesystem.
+	//root is the directory the archive was built from, paths under it are looked up relative to it, an empty root looks up paths as they are.
+	//The archive must stay open while files are loaded from it
+	void Mount(AssetArchive *archive, const std::string &root = "");
+	void Unmount(AssetArchive *archive);
+	const std::vector<MountedArchive> &GetMounted() { return this->mArchives; }
+
+	//Frees the scratch storage kept between loads, it's allocated again by the next load
+	void Trim();
+	GLuint64 GetScratchBytes();
 
 private:
+	std::vector<MountedArchive> mArchives;
+	//Scratch storage reused by every load so loading many small files doesn't churn the allocator:
+	//the JSON text, parsed in place, the pool the JSON values are allocated from and the view and accessor tables.
+	//A Loader runs one load at a time, batches use one Loader per thread
+	std::string mText;
+	std::vector<GLchar> mJsonPool;
+	//Bytes the biggest document parsed so far needed, the pool grows to it before the next parse
+	GLuint64 mJsonPoolWanted;
+	BufferView *mViews;
+	GLuint mViewsCapacity;
+	Accessor *mAccessors;
+	GLuint mAccessorsCapacity;
+	//Reads the buffers and images of a file in one batch
+	AsyncReader mReader;
+
+	//data is null when the entry is compressed and has to be read through archive with the name given in entry
+	GLboolean findInArchives(const std::string &path, AssetArchive **archive, std::string *entry, const GLubyte **data, GLuint64 *size);
+
+	GLboolean load(const char *filePath, const LoadOptions &options, glTFFile *result);
+
+	GLboolean SameStructure(glTFFile *a, glTFFile *b);
+
+	//Queues the decode of every used texture in file whose image is embedded or archived, the images are uploaded later on the render thread
+	void RequestTextures(glTFFile *file, const std::string &fileDir, Buffer *buffers, BufferView *views, GLuint viewsCount, const std::vector<GLboolean> &used);
+
+	//Adds a read for every used image file on disk, textures gets the texture each read belongs to
+	void QueueImageReads(glTFFile *file, const std::string &fileDir, const std::vector<GLboolean> &used, std::vector<FileRead> &reads, std::vector<GLuint> &textures);
+
+	//Uploads primitive from the bytes of its buffer views, returns GL_FALSE when the layout can't be drawn as it is.
+	//attributes holds the position, normal, texture coordinates and tangent accessors
+	GLboolean UploadViews(Primitive *primitive, Buffer *buffers, BufferView *views, Accessor *accessors, const GLuint *attributes, GLuint indicesAccess, GLuint material, GeometryRetention retention);
+
+	//Decodes the indices and the position, normal, texture coordinates and tangent accessors into primitive. Thread safe when no buffer is streamed
+	void DecodePrimitive(Primitive *primitive, Buffer *buffers, BufferView *views, Accessor *accessors, const GLuint *attributes, GLuint indicesAccess, GLuint material);
+
+	//Welds primitives on the ThreadPool and reports the vertices saved
+	WeldResult WeldPrimitives(glTFFile *file, const std::vector<Primitive*> &primitives, const WeldTolerances &tolerances);
+
+	//Queues reads of only the byte ranges of the used views of buffer index, packed together, and moves the views to their packed offsets.
+	//When the ranges add up to more than options.streamThreshold the buffer is streamed instead.
+	//Returns GL_FALSE when an archived buffer can't be read or a streamed one can't be opened
+	GLboolean ReadBuffer(const std::string &path, GLuint index, BufferView *views, GLuint viewsCount, const std::vector<GLboolean> &used, const LoadOptions &options, Buffer *buffer, std::vector<FileRead> &reads);
+
 	GLuint GetComponentCount(std::string component)
 	{
 		if ("SCALAR" == component) return 1;
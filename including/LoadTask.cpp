@@ -0,0 +1,212 @@
+#include "LoadTask.h"
+#include <iostream>
+#include <exception>
+
+#include "ThreadPool.h"
+#include "GeometryRegistry.h"
+
+//Fire and forget coroutine, the frame lives until the load ends and the State outlives it through the handles
+struct LoadCoroutine
+{
+	struct promise_type
+	{
+		LoadCoroutine get_return_object() { return LoadCoroutine(); }
+		std::suspend_never initial_suspend() noexcept { return {}; }
+		std::suspend_never final_suspend() noexcept { return {}; }
+		void return_void() {}
+		void unhandled_exception() { std::terminate(); }
+	};
+};
+
+void WorkerExecutor::Post(std::function<void()> job)
+{
+	ThreadPool *pool = ThreadPool::GetPointerInstance();
+	if (nullptr == pool)
+		job();
+	else
+		pool->Enqueue(std::move(job));
+}
+
+void RenderThreadExecutor::Post(std::function<void()> job)
+{
+	std::lock_guard<std::mutex> lock(this->mMutex);
+	this->mJobs.push_back(std::move(job));
+}
+
+GLuint RenderThreadExecutor::Process()
+{
+	std::deque<std::function<void()>> jobs;
+	{
+		std::lock_guard<std::mutex> lock(this->mMutex);
+		jobs.swap(this->mJobs);
+	}
+	for (GLuint i = 0; i < jobs.size(); i++)
+		jobs[i]();
+	return (GLuint)jobs.size();
+}
+
+//Coroutines started and not ended yet
+static std::atomic<GLuint> &runningCount()
+{
+	static std::atomic<GLuint> count(0);
+	return count;
+}
+
+//Counts the coroutine while its frame is alive, it ends with the frame whichever way the coroutine returns
+struct RunningGuard
+{
+	RunningGuard() { runningCount()++; }
+	~RunningGuard() { runningCount()--; }
+};
+
+GLuint LoadTask::GetRunningCount()
+{
+	return runningCount().load();
+}
+
+LoadTask::State::~State()
+{
+	//Textures requested by the load may still be pending, the file goes on the render thread
+	if (nullptr == this->result)
+		return;
+	glTFFile *file = this->result;
+	this->renderThread->Post([file]() { delete file; });
+}
+
+const LoadProgress &LoadTask::GetProgress()
+{
+	static const LoadProgress none;
+	return nullptr == this->mState ? none : this->mState->progress;
+}
+
+void LoadTask::Cancel()
+{
+	if (nullptr != this->mState)
+		this->mState->cancellation.Cancel();
+}
+
+glTFFile *LoadTask::Take()
+{
+	if (LOAD_TASK_DONE != this->GetStatus())
+		return nullptr;
+	glTFFile *result = this->mState->result;
+	this->mState->result = nullptr;
+	return result;
+}
+
+//A load suspended between its stages keeps its Loader, the scratch storage holds its document. Loaders are
+//borrowed for a whole task and given back for the next one, so their scratch is still reused across loads
+static std::mutex loadersMutex;
+static std::vector<std::unique_ptr<Loader>> freeLoaders;
+
+static Loader *borrowLoader()
+{
+	std::lock_guard<std::mutex> lock(loadersMutex);
+	if (freeLoaders.empty())
+		return new Loader();
+	Loader *loader = freeLoaders.back().release();
+	freeLoaders.pop_back();
+	return loader;
+}
+
+static void returnLoader(Loader *loader)
+{
+	std::lock_guard<std::mutex> lock(loadersMutex);
+	freeLoaders.push_back(std::unique_ptr<Loader>(loader));
+}
+
+LoadCoroutine LoadTask::run(std::shared_ptr<State> state, std::vector<MountedArchive> archives, std::string path, LoadOptions options, Executor &workers, Executor &renderThread, GLuint64 uploadBudget)
+{
+	RunningGuard running;
+
+	//Read stage: the document is parsed and its buffers and images read, decodes start as their buffers land
+	co_await workers.Schedule();
+	if (state->cancellation.IsCancelled())
+	{
+		state->progress.stage = LOAD_STAGES_COUNT;
+		state->status = LOAD_TASK_CANCELLED;
+		co_return;
+	}
+	GLboolean upload = options.upload;
+	options.deferUpload = upload;
+	options.progress = &state->progress;
+	options.cancellation = state->cancellation;
+	Loader *loader = borrowLoader();
+	std::vector<MountedArchive> mounted = loader->GetMounted();
+	for (GLuint i = 0; i < mounted.size(); i++)
+		loader->Unmount(mounted[i].archive);
+	for (GLuint i = 0; i < archives.size(); i++)
+		loader->Mount(archives[i].archive, archives[i].root);
+	glTFFile *file = new glTFFile();
+	PendingLoad *pending = loader->BeginLoad(path.c_str(), options, file);
+
+	//Decode stage: back in the workers' queue behind the work queued meanwhile. A cancelled load still finishes,
+	//skipping its decodes, so its buffers and Loader are released
+	GLboolean loaded = GL_FALSE;
+	if (nullptr != pending)
+	{
+		co_await workers.Schedule();
+		loaded = loader->FinishLoad(pending);
+	}
+	returnLoader(loader);
+
+	//Upload stage: textures requested by the load may be pending, the file is discarded and deleted on the render thread
+	co_await renderThread.Schedule();
+	if (state->cancellation.IsCancelled() || !loaded)
+	{
+		if (!loaded)
+			std::cout << "LOADTASK::LOAD Message: Could not load " << path << std::endl;
+		delete file;
+		state->progress.stage = LOAD_STAGES_COUNT;
+		state->status = state->cancellation.IsCancelled() ? LOAD_TASK_CANCELLED : LOAD_TASK_FAILED;
+		co_return;
+	}
+	std::vector<Primitive*> decoded;
+	for (GLuint i = 0; i < file->meshesCount && upload; i++)
+	{
+		for (GLuint j = 0; j < file->meshes[i].primitivesCount; j++)
+		{
+			if (nullptr != file->meshes[i].primitives[j].vertices)
+				decoded.push_back(&file->meshes[i].primitives[j]);
+		}
+	}
+	state->progress.Begin(LOAD_STAGE_UPLOAD, (GLuint)decoded.size());
+	GeometryRegistry *registry = GeometryRegistry::GetPointerInstance();
+	GLuint64 sliceBytes = 0;
+	for (GLuint i = 0; i < decoded.size(); i++)
+	{
+		if (sliceBytes >= uploadBudget)
+		{
+			sliceBytes = 0;
+			co_await renderThread.Schedule();
+			if (state->cancellation.IsCancelled())
+			{
+				delete file;
+				state->progress.stage = LOAD_STAGES_COUNT;
+				state->status = LOAD_TASK_CANCELLED;
+				co_return;
+			}
+		}
+		sliceBytes += decoded[i]->verticesCount * sizeof(Vertex) + decoded[i]->indicesCount * sizeof(GLuint);
+		if (options.share && nullptr != registry)
+			registry->Share(decoded[i], GL_TRUE);
+		else
+			decoded[i]->upload();
+		decoded[i]->retain(options.retention);
+		state->progress.done[LOAD_STAGE_UPLOAD]++;
+	}
+
+	state->result = file;
+	state->progress.stage = LOAD_STAGES_COUNT;
+	state->status = LOAD_TASK_DONE;
+}
+
+LoadTask LoadAsync(Loader *loader, const std::string &path, const LoadOptions &options, Executor &workers, Executor &renderThread, GLuint64 uploadBudget)
+{
+	LoadTask task;
+	task.mState = std::make_shared<LoadTask::State>();
+	task.mState->cancellation = options.cancellation;
+	task.mState->renderThread = &renderThread;
+	LoadTask::run(task.mState, loader->GetMounted(), path, options, workers, renderThread, uploadBudget);
+	return task;
+}
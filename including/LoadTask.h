@@ -0,0 +1,101 @@
+#pragma once
+#include <glad\glad.h>
+#include <coroutine>
+#include <functional>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <string>
+
+#include "Load.h"
+
+/*Thread a coroutine continues on, co_await executor.Schedule() moves the coroutine to it*/
+class Executor
+{
+public:
+	virtual ~Executor() {}
+	virtual void Post(std::function<void()> job) = 0;
+
+	struct Awaiter
+	{
+		Executor *executor;
+		bool await_ready() { return false; }
+		void await_suspend(std::coroutine_handle<> handle) { this->executor->Post([handle]() { handle.resume(); }); }
+		void await_resume() {}
+	};
+	Awaiter Schedule() { return Awaiter{ this }; }
+};
+
+//Continues on the ThreadPool, or inline when the pool isn't started
+class WorkerExecutor : public Executor
+{
+public:
+	void Post(std::function<void()> job) override;
+};
+
+//Continues on whichever thread calls Process, the render thread since continuations touch GL
+class RenderThreadExecutor : public Executor
+{
+public:
+	void Post(std::function<void()> job) override;
+	//Runs the jobs posted before the call, the ones they post run on the next call. Returns the amount of jobs run
+	GLuint Process();
+
+private:
+	std::deque<std::function<void()>> mJobs;
+	std::mutex mMutex;
+};
+
+enum LoadTaskStatus
+{
+	LOAD_TASK_PENDING,
+	LOAD_TASK_DONE,
+	LOAD_TASK_CANCELLED,
+	LOAD_TASK_FAILED
+};
+
+struct LoadCoroutine;
+
+/*Handle to a load running as a coroutine, one stage per resumption: reads on a worker, decoding on a worker again,
+then sharing, uploads and retention on the render thread in slices of uploadBudget bytes per frame*/
+class LoadTask
+{
+public:
+	LoadTask() {}
+
+	//A default constructed handle has no load, it reports LOAD_TASK_FAILED
+	GLboolean IsValid() { return nullptr != this->mState; }
+	LoadTaskStatus GetStatus() { return nullptr == this->mState ? LOAD_TASK_FAILED : (LoadTaskStatus)this->mState->status.load(); }
+	GLboolean IsDone() { return LOAD_TASK_PENDING != this->GetStatus(); }
+	const LoadProgress &GetProgress();
+	//The task stops at the next stage boundary, whatever it loaded is deleted on the render thread
+	void Cancel();
+	//Hands the loaded file over once the task is done, nullptr before that or when it was cancelled or failed.
+	//A file never taken is deleted on the render thread once the last handle goes
+	glTFFile *Take();
+
+	//Coroutines that haven't ended yet, the render thread executor has to be processed until there are none
+	//before the modules they use are closed
+	static GLuint GetRunningCount();
+
+private:
+	struct State
+	{
+		LoadProgress progress;
+		CancellationToken cancellation;
+		std::atomic<GLuint> status;
+		glTFFile *result;
+		Executor *renderThread;
+		State() : status(LOAD_TASK_PENDING), result(nullptr), renderThread(nullptr) {}
+		~State();
+	};
+	std::shared_ptr<State> mState;
+
+	friend LoadTask LoadAsync(Loader *loader, const std::string &path, const LoadOptions &options, Executor &workers, Executor &renderThread, GLuint64 uploadBudget);
+	static LoadCoroutine run(std::shared_ptr<State> state, std::vector<MountedArchive> archives, std::string path, LoadOptions options, Executor &workers, Executor &renderThread, GLuint64 uploadBudget);
+};
+
+//Starts loading path on a Loader borrowed for the whole task, with the archives mounted on loader.
+//options.progress is replaced by the task's, options.cancellation is shared with it
+LoadTask LoadAsync(Loader *loader, const std::string &path, const LoadOptions &options, Executor &workers, Executor &renderThread, GLuint64 uploadBudget = 16ull * 1024 * 1024);
@@ -0,0 +1,259 @@
+#include "MeshOptimize.h"
+#include <cmath>
+#include <algorithm>
+#include <unordered_map>
+
+#define CACHE_DECAY_POWER 1.5f
+#define LAST_TRIANGLE_SCORE 0.75f
+#define VALENCE_BOOST_SCALE 2.0f
+#define VALENCE_BOOST_POWER 0.5f
+
+GLfloat GetACMR(const Primitive *primitive, GLuint cacheSize)
+{
+	if (nullptr == primitive->indices || primitive->indicesCount < 3)
+		return 0.0f;
+	std::vector<GLuint> stamps(primitive->verticesCount, 0);
+	GLuint misses = 0;
+	for (GLuint i = 0; i < primitive->indicesCount; i++)
+	{
+		GLuint index = primitive->indices[i];
+		if (index >= primitive->verticesCount)
+			continue;
+		//A vertex is still cached when fewer than cacheSize misses happened since it was loaded
+		if (0 == stamps[index] || misses - stamps[index] >= cacheSize)
+			stamps[index] = ++misses;
+	}
+	return misses / (GLfloat)(primitive->indicesCount / 3);
+}
+
+static GLfloat vertexScore(GLint cachePosition, GLuint remaining, GLuint cacheSize)
+{
+	if (0 == remaining)
+		return -1.0f;
+	GLfloat score = 0.0f;
+	if (0 <= cachePosition)
+	{
+		//The vertices of the last triangle get a fixed score so it isn't favoured over its neighbours
+		if (cachePosition < 3)
+			score = LAST_TRIANGLE_SCORE;
+		else
+			score = std::pow(1.0f - (cachePosition - 3) / (GLfloat)(cacheSize - 3), CACHE_DECAY_POWER);
+	}
+	return score + VALENCE_BOOST_SCALE * std::pow((GLfloat)remaining, -VALENCE_BOOST_POWER);
+}
+
+void OptimizeVertexCache(Primitive *primitive, GLuint cacheSize)
+{
+	if (nullptr == primitive->indices || primitive->indicesCount < 6 || 0 != primitive->hash || cacheSize <= 3)
+		return;
+	GLuint trianglesCount = primitive->indicesCount / 3;
+	GLuint verticesCount = primitive->verticesCount;
+	const GLuint *indices = primitive->indices;
+	for (GLuint i = 0; i < trianglesCount * 3; i++)
+	{
+		if (indices[i] >= verticesCount)
+			return;
+	}
+
+	//Triangles using each vertex, packed by vertex
+	std::vector<GLuint> offsets(verticesCount + 1, 0);
+	for (GLuint i = 0; i < trianglesCount * 3; i++)
+		offsets[indices[i] + 1]++;
+	for (GLuint i = 0; i < verticesCount; i++)
+		offsets[i + 1] += offsets[i];
+	std::vector<GLuint> adjacency(trianglesCount * 3);
+	std::vector<GLuint> remaining(verticesCount, 0);
+	for (GLuint i = 0; i < trianglesCount * 3; i++)
+		adjacency[offsets[indices[i]] + remaining[indices[i]]++] = i / 3;
+
+	std::vector<GLint> cachePositions(verticesCount, -1);
+	std::vector<GLfloat> vertexScores(verticesCount);
+	for (GLuint i = 0; i < verticesCount; i++)
+		vertexScores[i] = vertexScore(-1, remaining[i], cacheSize);
+	std::vector<GLfloat> triangleScores(trianglesCount);
+	for (GLuint i = 0; i < trianglesCount; i++)
+		triangleScores[i] = vertexScores[indices[i * 3]] + vertexScores[indices[i * 3 + 1]] + vertexScores[indices[i * 3 + 2]];
+	std::vector<GLboolean> emitted(trianglesCount, GL_FALSE);
+
+	std::vector<GLuint> result(trianglesCount * 3);
+	std::vector<GLuint> cache, nextCache;
+	cache.reserve(cacheSize + 3);
+	nextCache.reserve(cacheSize + 3);
+	GLuint cursor = 0;
+	GLint best = 0;
+	for (GLuint emittedCount = 0; emittedCount < trianglesCount; emittedCount++)
+	{
+		if (0 > best)
+		{
+			//Nothing in the cache can be continued, the next triangle not emitted yet starts a new strip
+			while (emitted[cursor])
+				cursor++;
+			best = (GLint)cursor;
+		}
+		const GLuint *triangle = &indices[best * 3];
+		result[emittedCount * 3] = triangle[0];
+		result[emittedCount * 3 + 1] = triangle[1];
+		result[emittedCount * 3 + 2] = triangle[2];
+		emitted[best] = GL_TRUE;
+
+		//The vertices of the triangle go to the front of the cache, removing the triangle from their adjacency
+		nextCache.clear();
+		for (GLuint k = 0; k < 3; k++)
+		{
+			GLuint vertex = triangle[k];
+			nextCache.push_back(vertex);
+			GLuint *begin = &adjacency[offsets[vertex]];
+			GLuint *end = begin + remaining[vertex];
+			*std::find(begin, end, (GLuint)best) = *(end - 1);
+			remaining[vertex]--;
+		}
+		for (GLuint k = 0; k < cache.size(); k++)
+		{
+			if (cache[k] != triangle[0] && cache[k] != triangle[1] && cache[k] != triangle[2])
+				nextCache.push_back(cache[k]);
+		}
+		std::swap(cache, nextCache);
+
+		//Rescore the vertices whose cache position changed and the triangles still using them
+		best = -1;
+		GLfloat bestScore = -1.0f;
+		for (GLuint k = 0; k < cache.size(); k++)
+		{
+			GLuint vertex = cache[k];
+			cachePositions[vertex] = k < cacheSize ? (GLint)k : -1;
+			GLfloat score = vertexScore(cachePositions[vertex], remaining[vertex], cacheSize);
+			GLfloat delta = score - vertexScores[vertex];
+			vertexScores[vertex] = score;
+			for (GLuint t = 0; t < remaining[vertex]; t++)
+			{
+				GLuint neighbour = adjacency[offsets[vertex] + t];
+				triangleScores[neighbour] += delta;
+				if (triangleScores[neighbour] > bestScore)
+				{
+					bestScore = triangleScores[neighbour];
+					best = (GLint)neighbour;
+				}
+			}
+		}
+		if (cache.size() > cacheSize)
+			cache.resize(cacheSize);
+	}
+	std::copy(result.begin(), result.end(), primitive->indices);
+}
+
+void OptimizeVertexFetch(Primitive *primitive)
+{
+	if (nullptr == primitive->vertices || nullptr == primitive->indices || 0 != primitive->hash)
+		return;
+	std::vector<GLint> remap(primitive->verticesCount, -1);
+	GLuint count = 0;
+	for (GLuint i = 0; i < primitive->indicesCount; i++)
+	{
+		GLuint index = primitive->indices[i];
+		if (index >= primitive->verticesCount)
+			continue;
+		if (0 > remap[index])
+			remap[index] = (GLint)count++;
+		primitive->indices[i] = (GLuint)remap[index];
+	}
+	Vertex *vertices = new Vertex[count];
+	for (GLuint i = 0; i < primitive->verticesCount; i++)
+	{
+		if (0 <= remap[i])
+			vertices[remap[i]] = primitive->vertices[i];
+	}
+	delete[] primitive->vertices;
+	primitive->vertices = vertices;
+	primitive->verticesCount = count;
+}
+
+std::vector<GLuint> SimplifyClustered(const Primitive *primitive, GLuint gridSize)
+{
+	std::vector<GLuint> result;
+	if (nullptr == primitive->vertices || nullptr == primitive->indices || 0 == gridSize)
+		return result;
+	glm::vec3 min(std::numeric_limits<GLfloat>::max()), max(-std::numeric_limits<GLfloat>::max());
+	for (GLuint i = 0; i < primitive->verticesCount; i++)
+	{
+		min = glm::min(min, primitive->vertices[i].position);
+		max = glm::max(max, primitive->vertices[i].position);
+	}
+	glm::vec3 extent = glm::max(max - min, glm::vec3(1e-6f));
+	glm::vec3 scale = glm::vec3((GLfloat)gridSize) / extent;
+
+	//The first vertex reaching a cell represents it
+	std::unordered_map<GLuint64, GLuint> cells;
+	std::vector<GLuint> representative(primitive->verticesCount);
+	for (GLuint i = 0; i < primitive->verticesCount; i++)
+	{
+		glm::vec3 cell = glm::min((primitive->vertices[i].position - min) * scale, glm::vec3((GLfloat)(gridSize - 1)));
+		GLuint64 key = ((GLuint64)cell.x << 42) | ((GLuint64)cell.y << 21) | (GLuint64)cell.z;
+		representative[i] = cells.insert(std::make_pair(key, i)).first->second;
+	}
+
+	result.reserve(primitive->indicesCount);
+	for (GLuint i = 0; i + 2 < primitive->indicesCount; i += 3)
+	{
+		if (primitive->indices[i] >= primitive->verticesCount || primitive->indices[i + 1] >= primitive->verticesCount || primitive->indices[i + 2] >= primitive->verticesCount)
+			continue;
+		GLuint a = representative[primitive->indices[i]];
+		GLuint b = representative[primitive->indices[i + 1]];
+		GLuint c = representative[primitive->indices[i + 2]];
+		if (a == b || b == c || a == c)
+			continue;
+		result.push_back(a);
+		result.push_back(b);
+		result.push_back(c);
+	}
+	return result;
+}
+
+void BuildMeshlets(const Primitive *primitive, GLuint maxVertices, GLuint maxTriangles, std::vector<Meshlet> &meshlets, std::vector<GLuint> &vertices, std::vector<GLubyte> &triangles)
+{
+	meshlets.clear();
+	vertices.clear();
+	triangles.clear();
+	if (nullptr == primitive->indices || maxVertices < 3 || maxVertices > 256 || 0 == maxTriangles)
+		return;
+	//Position of each vertex inside the current meshlet, valid while its stamp matches the meshlet
+	std::vector<GLubyte> local(primitive->verticesCount);
+	std::vector<GLuint> stamps(primitive->verticesCount, 0);
+	Meshlet current;
+	for (GLuint i = 0; i + 2 < primitive->indicesCount; i += 3)
+	{
+		const GLuint *triangle = &primitive->indices[i];
+		if (triangle[0] >= primitive->verticesCount || triangle[1] >= primitive->verticesCount || triangle[2] >= primitive->verticesCount)
+			continue;
+		GLuint stamp = (GLuint)meshlets.size() + 1;
+		GLuint added = 0;
+		for (GLuint k = 0; k < 3; k++)
+			added += stamps[triangle[k]] != stamp && (k < 1 || triangle[k] != triangle[0]) && (k < 2 || triangle[k] != triangle[1]) ? 1 : 0;
+		if (current.verticesCount + added > maxVertices || current.trianglesCount + 1 > maxTriangles)
+		{
+			meshlets.push_back(current);
+			current = Meshlet();
+			current.vertexOffset = (GLuint)vertices.size();
+			current.triangleOffset = (GLuint)triangles.size() / 3;
+			stamp++;
+		}
+		for (GLuint k = 0; k < 3; k++)
+		{
+			GLuint vertex = triangle[k];
+			if (stamps[vertex] != stamp)
+			{
+				stamps[vertex] = stamp;
+				local[vertex] = (GLubyte)current.verticesCount++;
+				vertices.push_back(vertex);
+				if (nullptr != primitive->vertices)
+				{
+					current.bounds.bounds[0] = glm::min(current.bounds.bounds[0], primitive->vertices[vertex].position);
+					current.bounds.bounds[1] = glm::max(current.bounds.bounds[1], primitive->vertices[vertex].position);
+				}
+			}
+			triangles.push_back(local[vertex]);
+		}
+		current.trianglesCount++;
+	}
+	if (current.trianglesCount > 0)
+		meshlets.push_back(current);
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include <glad\glad.h>
+#include <vector>
+
+#include "Types.h"
+
+//Group of triangles small enough to be culled or processed as a unit
+struct Meshlet
+{
+	//First entry of the meshlet in the vertices and triangles arrays of BuildMeshlets
+	GLuint vertexOffset;
+	GLuint triangleOffset;
+	GLuint verticesCount;
+	GLuint trianglesCount;
+	Box bounds;
+	Meshlet() : vertexOffset(0), triangleOffset(0), verticesCount(0), trianglesCount(0) {}
+};
+
+//Average vertex shader invocations per triangle of primitive through a FIFO post transform cache of cacheSize entries
+GLfloat GetACMR(const Primitive *primitive, GLuint cacheSize = 16);
+
+//Reorders the triangles of primitive so consecutive triangles reuse the vertices still in the post transform cache (Forsyth's algorithm)
+void OptimizeVertexCache(Primitive *primitive, GLuint cacheSize = 32);
+
+//Stores the vertices of primitive in the order the indices first reach them and drops the unused ones
+void OptimizeVertexFetch(Primitive *primitive);
+
+//Simplified indices of primitive, built by merging the vertices falling in the same cell of a gridSize^3 grid over its bounds
+//and dropping the collapsed triangles. The vertices are left as they are
+std::vector<GLuint> SimplifyClustered(const Primitive *primitive, GLuint gridSize);
+
+//Splits the triangles of primitive, in index order, into meshlets of at most maxVertices vertices and maxTriangles triangles.
+//vertices holds the vertex indices of every meshlet and triangles 3 bytes per triangle indexing into the vertices of its meshlet
+void BuildMeshlets(const Primitive *primitive, GLuint maxVertices, GLuint maxTriangles, std::vector<Meshlet> &meshlets, std::vector<GLuint> &vertices, std::vector<GLubyte> &triangles);
@@ -0,0 +1,206 @@
+#include "Mipmap.h"
+#include <cmath>
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define MIPMAP_SSE
+#include <xmmintrin.h>
+#endif
+
+#define KAISER_TAPS 8
+#define KAISER_BETA 4.0
+#define LINEAR_TO_SRGB_STEPS 4096
+
+struct Kernel
+{
+	GLint taps;
+	GLint offset;
+	GLfloat weights[KAISER_TAPS];
+};
+
+//Zeroth order modified Bessel function of the first kind, used by the Kaiser window
+static GLdouble bessel0(GLdouble x)
+{
+	GLdouble sum = 1.0, term = 1.0;
+	for (GLint k = 1; k < 32; k++)
+	{
+		term *= (x / (2.0 * k)) * (x / (2.0 * k));
+		sum += term;
+	}
+	return sum;
+}
+
+static const Kernel &boxKernel()
+{
+	static const Kernel kernel = { 2, 0, { 0.5f, 0.5f } };
+	return kernel;
+}
+
+static const Kernel &kaiserKernel()
+{
+	static Kernel kernel = []()
+	{
+		Kernel result;
+		result.taps = KAISER_TAPS;
+		result.offset = KAISER_TAPS / 2 - 1;
+		GLdouble sum = 0.0;
+		for (GLint i = 0; i < KAISER_TAPS; i++)
+		{
+			//Distance from the source texel center to the destination texel center, in destination texels
+			GLdouble d = ((i - result.offset) - 0.5) / 2.0;
+			GLdouble sinc = 0.0 == d ? 1.0 : std::sin(3.14159265358979 * d) / (3.14159265358979 * d);
+			GLdouble t = d / (KAISER_TAPS / 4.0);
+			GLdouble window = bessel0(KAISER_BETA * std::sqrt(1.0 - t * t)) / bessel0(KAISER_BETA);
+			result.weights[i] = (GLfloat)(sinc * window);
+			sum += result.weights[i];
+		}
+		for (GLint i = 0; i < KAISER_TAPS; i++)
+			result.weights[i] = (GLfloat)(result.weights[i] / sum);
+		return result;
+	}();
+	return kernel;
+}
+
+static const GLfloat *srgbToLinearTable()
+{
+	static GLfloat table[256];
+	static bool ready = [&]()
+	{
+		for (GLint i = 0; i < 256; i++)
+		{
+			GLfloat c = i / 255.0f;
+			table[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+		}
+		return true;
+	}();
+	(void)ready;
+	return table;
+}
+
+static const GLubyte *linearToSrgbTable()
+{
+	static GLubyte table[LINEAR_TO_SRGB_STEPS];
+	static bool ready = [&]()
+	{
+		for (GLint i = 0; i < LINEAR_TO_SRGB_STEPS; i++)
+		{
+			GLfloat c = i / (GLfloat)(LINEAR_TO_SRGB_STEPS - 1);
+			c = c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+			table[i] = (GLubyte)(c * 255.0f + 0.5f);
+		}
+		return true;
+	}();
+	(void)ready;
+	return table;
+}
+
+static inline GLint clampIndex(GLint index, GLuint size)
+{
+	return index < 0 ? 0 : (index >= (GLint)size ? (GLint)size - 1 : index);
+}
+
+static void linearizeRow(const GLubyte *src, GLuint width, GLboolean sRGB, GLfloat *dst)
+{
+	const GLfloat *table = srgbToLinearTable();
+	for (GLuint i = 0; i < width * 4; i += 4)
+	{
+		dst[i + 0] = sRGB ? table[src[i + 0]] : src[i + 0] / 255.0f;
+		dst[i + 1] = sRGB ? table[src[i + 1]] : src[i + 1] / 255.0f;
+		dst[i + 2] = sRGB ? table[src[i + 2]] : src[i + 2] / 255.0f;
+		dst[i + 3] = src[i + 3] / 255.0f;
+	}
+}
+
+static void encodeRow(const GLfloat *src, GLuint width, GLboolean sRGB, GLubyte *dst)
+{
+	const GLubyte *table = linearToSrgbTable();
+	for (GLuint i = 0; i < width * 4; i++)
+	{
+		GLfloat c = src[i];
+		c = c < 0.0f ? 0.0f : (c > 1.0f ? 1.0f : c);
+		if (sRGB && 3 != (i & 3))
+			dst[i] = table[(GLint)(c * (LINEAR_TO_SRGB_STEPS - 1) + 0.5f)];
+		else
+			dst[i] = (GLubyte)(c * 255.0f + 0.5f);
+	}
+}
+
+//dst[x] = sum(weights[t] * rows[t][x]) over RGBA pixels
+static void accumulate(const GLfloat *const *rows, const GLint *columns, const Kernel &kernel, GLuint width, GLfloat *dst)
+{
+	for (GLuint x = 0; x < width; x++)
+	{
+#ifdef MIPMAP_SSE
+		__m128 acc = _mm_setzero_ps();
+		for (GLint t = 0; t < kernel.taps; t++)
+		{
+			const GLfloat *pixel = rows[t] + (nullptr == columns ? x : columns[x * kernel.taps + t]) * 4;
+			acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(kernel.weights[t]), _mm_loadu_ps(pixel)));
+		}
+		_mm_storeu_ps(dst + x * 4, acc);
+#else
+		GLfloat acc[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		for (GLint t = 0; t < kernel.taps; t++)
+		{
+			const GLfloat *pixel = rows[t] + (nullptr == columns ? x : columns[x * kernel.taps + t]) * 4;
+			for (GLint c = 0; c < 4; c++)
+				acc[c] += kernel.weights[t] * pixel[c];
+		}
+		for (GLint c = 0; c < 4; c++)
+			dst[x * 4 + c] = acc[c];
+#endif
+	}
+}
+
+static void downsample(const MipLevel &src, MipLevel &dst, GLboolean sRGB, const Kernel &kernel)
+{
+	GLuint taps = (GLuint)kernel.taps;
+	std::vector<GLint> columns(dst.width * taps);
+	for (GLuint x = 0; x < dst.width; x++)
+		for (GLuint t = 0; t < taps; t++)
+			columns[x * taps + t] = clampIndex((GLint)(2 * x + t) - kernel.offset, src.width);
+
+	//Ring of source rows already linearized and filtered horizontally, indexed by row % taps
+	std::vector<GLfloat> linear(src.width * 4);
+	std::vector<GLfloat> ring(taps * dst.width * 4);
+	std::vector<GLint> ringRows(taps, -1);
+	std::vector<GLfloat> result(dst.width * 4);
+	std::vector<const GLfloat*> rows(taps);
+	std::vector<const GLfloat*> sameRow(taps, linear.data());
+
+	dst.data.resize(dst.width * dst.height * 4);
+	for (GLuint y = 0; y < dst.height; y++)
+	{
+		for (GLuint t = 0; t < taps; t++)
+		{
+			GLint row = clampIndex((GLint)(2 * y + t) - kernel.offset, src.height);
+			GLuint slot = row % taps;
+			GLfloat *filtered = &ring[slot * dst.width * 4];
+			if (ringRows[slot] != row)
+			{
+				linearizeRow(&src.data[row * src.width * 4], src.width, sRGB, linear.data());
+				accumulate(sameRow.data(), columns.data(), kernel, dst.width, filtered);
+				ringRows[slot] = row;
+			}
+			rows[t] = filtered;
+		}
+		accumulate(rows.data(), nullptr, kernel, dst.width, result.data());
+		encodeRow(result.data(), dst.width, sRGB, &dst.data[y * dst.width * 4]);
+	}
+}
+
+void GenerateMipChain(std::vector<MipLevel> &levels, GLboolean sRGB, MipFilter filter)
+{
+	if (levels.empty())
+		return;
+	const Kernel &kernel = MIP_FILTER_KAISER == filter ? kaiserKernel() : boxKernel();
+
+	levels.resize(1);
+	while (levels.back().width > 1 || levels.back().height > 1)
+	{
+		MipLevel level;
+		level.width = levels.back().width > 1 ? levels.back().width / 2 : 1;
+		level.height = levels.back().height > 1 ? levels.back().height / 2 : 1;
+		levels.push_back(std::move(level));
+		downsample(levels[levels.size() - 2], levels.back(), sRGB, kernel);
+	}
+}
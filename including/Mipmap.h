@@ -0,0 +1,21 @@
+#pragma once
+#include <glad\glad.h>
+#include <vector>
+
+enum MipFilter
+{
+	MIP_FILTER_BOX,
+	MIP_FILTER_KAISER
+};
+
+struct MipLevel
+{
+	GLuint width;
+	GLuint height;
+	std::vector<GLubyte> data;
+	MipLevel() : width(0), height(0) {}
+};
+
+//levels[0] must hold the RGBA8 base image, the rest of the chain down to 1x1 is appended.
+//sRGB images are filtered in linear space and encoded back to sRGB.
+void GenerateMipChain(std::vector<MipLevel> &levels, GLboolean sRGB, MipFilter filter);
@@ -0,0 +1,161 @@
+#include "RenderQueue.h"
+#include "Types.h"
+#include <algorithm>
+#include <numeric>
+#include <limits>
+
+#define RENDER_DEPTH_BITS 22
+#define RENDER_DEPTH_MAX ((1ull << RENDER_DEPTH_BITS) - 1)
+
+void RenderQueue::Add(const DrawCommand &command)
+{
+	const Material *material = &command.file->materials[command.material];
+	this->mMaterialIds.push_back(this->mMaterials.try_emplace(material, (GLuint)this->mMaterials.size()).first->second);
+	this->mCommands.push_back(command);
+}
+
+void RenderQueue::Clear()
+{
+	this->mCommands.clear();
+	this->mMaterialIds.clear();
+	this->mMaterials.clear();
+}
+
+void RenderQueue::sort()
+{
+	GLuint count = (GLuint)this->mKeys.size();
+	this->mOrder.resize(count);
+	std::iota(this->mOrder.begin(), this->mOrder.end(), 0);
+	this->mSortedKeys.resize(count);
+	this->mSortedOrder.resize(count);
+	for (GLuint shift = 0; shift < 64; shift += 8)
+	{
+		GLuint offsets[256] = {};
+		for (GLuint i = 0; i < count; i++)
+			offsets[(this->mKeys[i] >> shift) & 0xFF]++;
+		//Every key has the same byte here, the pass would leave the order as it is
+		if (count == offsets[(this->mKeys[0] >> shift) & 0xFF])
+			continue;
+		GLuint sum = 0;
+		for (GLuint i = 0; i < 256; i++)
+		{
+			GLuint bucket = offsets[i];
+			offsets[i] = sum;
+			sum += bucket;
+		}
+		for (GLuint i = 0; i < count; i++)
+		{
+			GLuint position = offsets[(this->mKeys[i] >> shift) & 0xFF]++;
+			this->mSortedKeys[position] = this->mKeys[i];
+			this->mSortedOrder[position] = this->mOrder[i];
+		}
+		this->mKeys.swap(this->mSortedKeys);
+		this->mOrder.swap(this->mSortedOrder);
+	}
+}
+
+void RenderQueue::Flush(const glm::vec3 &eye)
+{
+	GLuint count = (GLuint)this->mCommands.size();
+	this->mDrawsCount = count;
+	this->mStateChanges = 0;
+	this->mStateChangesAvoided = 0;
+	if (0 == count)
+	{
+		this->Clear();
+		return;
+	}
+
+	//Depth is quantized over the range of this frame's draws
+	this->mDepths.resize(count);
+	GLfloat nearest = std::numeric_limits<GLfloat>::max(), farthest = 0.0f;
+	for (GLuint i = 0; i < count; i++)
+	{
+		this->mDepths[i] = glm::length(this->mCommands[i].center - eye);
+		nearest = std::min(nearest, this->mDepths[i]);
+		farthest = std::max(farthest, this->mDepths[i]);
+	}
+	GLfloat depthScale = farthest > nearest ? (GLfloat)RENDER_DEPTH_MAX / (farthest - nearest) : 0.0f;
+
+	this->mKeys.resize(count);
+	for (GLuint i = 0; i < count; i++)
+	{
+		DrawCommand *command = &this->mCommands[i];
+		GLuint64 depth = std::min<GLuint64>((GLuint64)((this->mDepths[i] - nearest) * depthScale), RENDER_DEPTH_MAX);
+		GLuint64 shader = command->shader->ID & 0xFF;
+		GLuint64 material = this->mMaterialIds[i] & 0xFFFF;
+		GLuint64 vao = command->primitive->VAO & 0xFFFF;
+		GLuint64 key = (GLuint64)command->pass << 62;
+		if (RENDER_PASS_OPAQUE == command->pass)
+			key |= shader << 54 | material << 38 | vao << 22 | depth;
+		else
+			key |= (RENDER_DEPTH_MAX - depth) << 40 | shader << 32 | material << 16 | vao;
+		this->mKeys[i] = key;
+	}
+	this->sort();
+
+	Shader *shader = nullptr;
+	const Material *material = nullptr;
+	const glm::mat4 *model = nullptr;
+	GLuint vao = 0;
+	RenderPass pass = RENDER_PASS_OPAQUE;
+	for (GLuint i = 0; i < count; i++)
+	{
+		DrawCommand *command = &this->mCommands[this->mOrder[i]];
+		if (command->pass != pass)
+		{
+			pass = command->pass;
+			glEnable(GL_BLEND);
+			glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+			glDepthMask(GL_FALSE);
+		}
+		if (command->shader != shader)
+		{
+			shader = command->shader;
+			shader->use();
+			//Constant for every material, set once per program
+			shader->setFloat("ao", 1.0f);
+			shader->setVec3("albedo", glm::vec3(1.0f));
+			//Uniforms belong to the program, the new one has to get them again
+			material = nullptr;
+			model = nullptr;
+			this->mStateChanges++;
+		}
+		else
+			this->mStateChangesAvoided++;
+		const Material *drawMaterial = &command->file->materials[command->material];
+		if (drawMaterial != material)
+		{
+			material = drawMaterial;
+			command->file->bindMaterial(command->material, shader);
+			this->mStateChanges++;
+		}
+		else
+			this->mStateChangesAvoided++;
+		if (command->model != model)
+		{
+			model = command->model;
+			shader->setMat4("model", *model);
+			this->mStateChanges++;
+		}
+		else
+			this->mStateChangesAvoided++;
+		if (command->primitive->VAO != vao)
+		{
+			vao = command->primitive->VAO;
+			glBindVertexArray(vao);
+			this->mStateChanges++;
+		}
+		else
+			this->mStateChangesAvoided++;
+		glDrawElements(GL_TRIANGLES, command->primitive->indicesCount, command->primitive->indexType, 0);
+	}
+	glBindVertexArray(0);
+	if (RENDER_PASS_TRANSPARENT == pass)
+	{
+		glDepthMask(GL_TRUE);
+		glDisable(GL_BLEND);
+	}
+	this->mTotalStateChangesAvoided += this->mStateChangesAvoided;
+	this->Clear();
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include <glad\glad.h>
+#include <glm\glm.hpp>
+#include <vector>
+#include <unordered_map>
+
+class glTFFile;
+class Primitive;
+class Shader;
+struct Material;
+
+enum RenderPass
+{
+	RENDER_PASS_OPAQUE,
+	//Blended materials, drawn after the opaque ones from back to front without writing depth
+	RENDER_PASS_TRANSPARENT
+};
+
+//One primitive to draw, the sort key is built from it
+struct DrawCommand
+{
+	glTFFile *file;
+	Primitive *primitive;
+	//Index into file->materials
+	GLuint material;
+	Shader *shader;
+	const glm::mat4 *model;
+	//World position the depth is measured to
+	glm::vec3 center;
+	RenderPass pass;
+};
+
+/*Draws collected during the frame and sorted by a 64 bit key, so draws sharing a shader, material and VAO are issued together.
+From the top bit: pass (2 bits), then for opaque draws shader (8), material (16), VAO (16) and depth front to back (22),
+and for transparent draws depth back to front (22) before shader, material and VAO.
+Ids wider than their field only sort worse, the state is compared as it is when drawing*/
+class RenderQueue
+{
+public:
+	RenderQueue() : mDrawsCount(0), mStateChanges(0), mStateChangesAvoided(0), mTotalStateChangesAvoided(0) {}
+
+	void Add(const DrawCommand &command);
+	//Sorts the draws for eye and issues them, binding only what changed since the previous draw. The queue is left empty
+	void Flush(const glm::vec3 &eye);
+	//Drops the draws added since the last Flush
+	void Clear();
+
+	GLuint GetDrawsCount() { return this->mDrawsCount; }
+	//Shader, material, model and VAO binds issued and skipped by the last Flush
+	GLuint GetStateChanges() { return this->mStateChanges; }
+	GLuint GetStateChangesAvoided() { return this->mStateChangesAvoided; }
+	GLuint64 GetTotalStateChangesAvoided() { return this->mTotalStateChangesAvoided; }
+
+private:
+	std::vector<DrawCommand> mCommands;
+	std::vector<GLuint> mMaterialIds;
+	std::vector<GLfloat> mDepths;
+	//Keys and command indices, sorted between the two pairs of arrays
+	std::vector<GLuint64> mKeys, mSortedKeys;
+	std::vector<GLuint> mOrder, mSortedOrder;
+	//Dense ids of the materials seen since the last Flush
+	std::unordered_map<const Material*, GLuint> mMaterials;
+	GLuint mDrawsCount;
+	GLuint mStateChanges;
+	GLuint mStateChangesAvoided;
+	GLuint64 mTotalStateChangesAvoided;
+
+	//LSD radix sort of mKeys carrying mOrder, a byte every key shares is skipped
+	void sort();
+};
@@ -0,0 +1,469 @@
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+#include <basisu_transcoder.h>
+
+#include <iostream>
+#include <fstream>
+#include <iterator>
+#include <cstring>
+#include <algorithm>
+#include <limits>
+
+#include "TextureQueue.h"
+#include "ThreadPool.h"
+
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef GL_COMPRESSED_SRGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_SRGB_S3TC_DXT1_EXT 0x8C4C
+#endif
+#ifndef GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT 0x8C4F
+#endif
+#ifndef GL_COMPRESSED_RGBA_BPTC_UNORM
+#define GL_COMPRESSED_RGBA_BPTC_UNORM 0x8E8C
+#endif
+#ifndef GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM
+#define GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM 0x8E8D
+#endif
+
+static const GLubyte KTX2_IDENTIFIER[12] = { 0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A };
+
+TextureQueue::TextureQueue() :
+	filter(MIP_FILTER_BOX),
+	residencyBudget(256 * 1024 * 1024),
+	initialResidentSize(64),
+	mHasS3TC(GL_FALSE),
+	mHasBPTC(GL_FALSE),
+	mResidentBytes(0)
+{
+}
+
+TextureQueue::~TextureQueue()
+{
+}
+
+ErrorCalls TextureQueue::init(void* /*_init*/)
+{
+	if (nullptr == ThreadPool::GetPointerInstance())
+	{
+		std::cout << "TEXTURE_QUEUE::INIT Message: ThreadPool module must be started first." << std::endl;
+		return ErrorCalls::FAILURE;
+	}
+
+	//Started from the render thread, the GL context is current
+	GLint extensionsCount = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &extensionsCount);
+	for (GLint i = 0; i < extensionsCount; i++)
+	{
+		const char *extension = (const char*)glGetStringi(GL_EXTENSIONS, i);
+		if (0 == std::strcmp(extension, "GL_EXT_texture_compression_s3tc"))
+			this->mHasS3TC = GL_TRUE;
+		if (0 == std::strcmp(extension, "GL_ARB_texture_compression_bptc"))
+			this->mHasBPTC = GL_TRUE;
+	}
+	basist::basisu_transcoder_init();
+	return ErrorCalls::SUCCESS;
+}
+
+void TextureQueue::release()
+{
+	std::unique_lock<std::mutex> lock(this->mMutex);
+	this->mDone.wait(lock, [this] { return this->mPending.empty(); });
+	for (GLuint i = 0; i < this->mReady.size(); i++)
+		delete this->mReady[i];
+	this->mReady.clear();
+}
+
+void TextureQueue::Request(glTFFile *file, GLuint texture, const std::string &path)
+{
+	GLboolean sRGB = file->textures[texture].sRGB;
+	{
+		std::lock_guard<std::mutex> lock(this->mMutex);
+		this->mPending[file]++;
+		this->mFiles.insert(file);
+	}
+	ThreadPool::GetInstance().Enqueue([this, file, texture, sRGB, path]()
+	{
+		this->decode(file, texture, sRGB, path, nullptr, 0);
+	});
+}
+
+void TextureQueue::Request(glTFFile *file, GLuint texture, GLubyte *data, GLuint size)
+{
+	GLboolean sRGB = file->textures[texture].sRGB;
+	{
+		std::lock_guard<std::mutex> lock(this->mMutex);
+		this->mPending[file]++;
+		this->mFiles.insert(file);
+	}
+	ThreadPool::GetInstance().Enqueue([this, file, texture, sRGB, data, size]()
+	{
+		this->decode(file, texture, sRGB, std::string(), data, size);
+	});
+}
+
+void TextureQueue::decode(glTFFile *file, GLuint texture, GLboolean sRGB, const std::string &path, GLubyte *data, GLuint size)
+{
+	DecodedTexture *decoded = nullptr;
+	GLubyte *owned = data;
+	bool discarded;
+	{
+		std::lock_guard<std::mutex> lock(this->mMutex);
+		discarded = 0 != this->mDiscarded.count(file);
+	}
+
+	if (!discarded)
+	{
+		std::string encoded;
+		if (nullptr == data)
+		{
+			std::ifstream fileStream(path, std::ios::in | std::ios::binary);
+			encoded.assign(std::istreambuf_iterator<char>(fileStream), std::istreambuf_iterator<char>());
+			data = (GLubyte*)encoded.data();
+			size = (GLuint)encoded.size();
+		}
+
+		if (size >= sizeof(KTX2_IDENTIFIER) && 0 == std::memcmp(data, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)))
+			decoded = this->transcodeKTX2(data, size, sRGB, path);
+		else
+			decoded = this->decodeImage(data, size, sRGB, path);
+		if (nullptr != decoded)
+		{
+			decoded->file = file;
+			decoded->texture = texture;
+		}
+	}
+	delete[] owned;
+
+	std::lock_guard<std::mutex> lock(this->mMutex);
+	if (nullptr != decoded)
+	{
+		if (0 == this->mDiscarded.count(file))
+			this->mReady.push_back(decoded);
+		else
+			delete decoded;
+	}
+	if (0 == --this->mPending[file])
+		this->mPending.erase(file);
+	this->mDone.notify_all();
+}
+
+TextureQueue::DecodedTexture *TextureQueue::decodeImage(const GLubyte *data, GLuint size, GLboolean sRGB, const std::string &path)
+{
+	GLint width, height, channels;
+	stbi_uc *pixels = 0 == size ? nullptr : stbi_load_from_memory(data, (GLint)size, &width, &height, &channels, 4);
+	if (nullptr == pixels)
+	{
+		std::cout << "TEXTURE_QUEUE::DECODE Message: Could not decode image " << path << ". " << (0 == size ? "Empty file." : stbi_failure_reason()) << std::endl;
+		return nullptr;
+	}
+
+	DecodedTexture *decoded = new DecodedTexture;
+	decoded->format = sRGB ? GL_SRGB8_ALPHA8 : GL_RGBA8;
+	decoded->compressed = GL_FALSE;
+	decoded->levels.resize(1);
+	decoded->levels[0].width = width;
+	decoded->levels[0].height = height;
+	decoded->levels[0].data.assign(pixels, pixels + width * height * 4);
+	stbi_image_free(pixels);
+	GenerateMipChain(decoded->levels, sRGB, this->filter);
+	return decoded;
+}
+
+TextureQueue::DecodedTexture *TextureQueue::transcodeKTX2(const GLubyte *data, GLuint size, GLboolean sRGB, const std::string &path)
+{
+	basist::ktx2_transcoder transcoder;
+	if (!transcoder.init(data, size) || !transcoder.start_transcoding())
+	{
+		std::cout << "TEXTURE_QUEUE::KTX2 Message: Could not read basis universal texture " << path << "." << std::endl;
+		return nullptr;
+	}
+
+	//BC7 keeps the quality of both ETC1S and UASTC sources, BC1/BC3 are the fallback for drivers without BPTC
+	basist::transcoder_texture_format target = basist::transcoder_texture_format::cTFRGBA32;
+	DecodedTexture *decoded = new DecodedTexture;
+	decoded->format = sRGB ? GL_SRGB8_ALPHA8 : GL_RGBA8;
+	if (this->mHasBPTC)
+	{
+		target = basist::transcoder_texture_format::cTFBC7_RGBA;
+		decoded->format = sRGB ? GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM : GL_COMPRESSED_RGBA_BPTC_UNORM;
+	}
+	else if (this->mHasS3TC && transcoder.get_has_alpha())
+	{
+		target = basist::transcoder_texture_format::cTFBC3_RGBA;
+		decoded->format = sRGB ? GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+	}
+	else if (this->mHasS3TC)
+	{
+		target = basist::transcoder_texture_format::cTFBC1_RGB;
+		decoded->format = sRGB ? GL_COMPRESSED_SRGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+	}
+	decoded->compressed = basist::transcoder_texture_format::cTFRGBA32 != target;
+
+	GLuint bytesPerBlock = basist::basis_get_bytes_per_block_or_pixel(target);
+	decoded->levels.resize(transcoder.get_levels());
+	for (GLuint i = 0; i < decoded->levels.size(); i++)
+	{
+		basist::ktx2_image_level_info info;
+		MipLevel *level = &decoded->levels[i];
+		if (!transcoder.get_image_level_info(info, i, 0, 0))
+		{
+			decoded->levels.resize(i);
+			break;
+		}
+		//Output size is counted in blocks for compressed targets and in pixels for RGBA32
+		GLuint units = decoded->compressed ? info.m_total_blocks : info.m_orig_width * info.m_orig_height;
+		level->width = info.m_orig_width;
+		level->height = info.m_orig_height;
+		level->data.resize(units * bytesPerBlock);
+		if (!transcoder.transcode_image_level(i, 0, 0, level->data.data(), units, target))
+		{
+			std::cout << "TEXTURE_QUEUE::KTX2 Message: Could not transcode level " << i << " of " << path << "." << std::endl;
+			decoded->levels.resize(i);
+			break;
+		}
+	}
+
+	if (decoded->levels.empty())
+	{
+		delete decoded;
+		return nullptr;
+	}
+	//Uncompressed fallback without a stored mip chain gets one built like any other image
+	if (!decoded->compressed && 1 == decoded->levels.size())
+		GenerateMipChain(decoded->levels, sRGB, this->filter);
+	return decoded;
+}
+
+GLuint TextureQueue::ProcessUploads(GLuint maxBytes)
+{
+	GLuint bytes = 0;
+	while (bytes < maxBytes)
+	{
+		DecodedTexture *decoded;
+		{
+			std::lock_guard<std::mutex> lock(this->mMutex);
+			if (this->mReady.empty())
+				break;
+			decoded = this->mReady.front();
+			this->mReady.pop_front();
+		}
+		bytes += this->upload(decoded);
+		delete decoded;
+	}
+	return bytes;
+}
+
+GLuint TextureQueue::upload(DecodedTexture *decoded)
+{
+	Texture *texture = &decoded->file->textures[decoded->texture];
+	texture->format = decoded->format;
+	texture->compressed = decoded->compressed;
+	texture->levels = std::move(decoded->levels);
+	texture->levelBytes.resize(texture->levels.size());
+	for (GLuint i = 0; i < texture->levels.size(); i++)
+		texture->levelBytes[i] = (GLuint)texture->levels[i].data.size();
+	if (0 != texture->id)
+		glDeleteTextures(1, &texture->id);
+	this->mResidentBytes -= texture->residentBytes;
+	texture->residentBytes = 0;
+	//Nothing is resident yet, the base level starts past the chain
+	texture->residentLevel = (GLuint)texture->levels.size();
+	glGenTextures(1, &texture->id);
+	glBindTexture(GL_TEXTURE_2D, texture->id);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)texture->levels.size() - 1);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	//Only the low mips go up front, StreamTextures brings in the rest once the texture is seen
+	GLuint level = 0;
+	while (level + 1 < texture->levels.size() && (texture->levels[level].width > this->initialResidentSize || texture->levels[level].height > this->initialResidentSize))
+		level++;
+	return this->makeResident(decoded->file, texture, level);
+}
+
+GLuint TextureQueue::makeResident(glTFFile *file, Texture *texture, GLuint level)
+{
+	if (level >= texture->levels.size() || level == texture->residentLevel)
+		return 0;
+
+	Sampler sampler;
+	if (0 <= texture->sampler && (GLuint)texture->sampler < file->samplersCount)
+		sampler = file->samplers[texture->sampler];
+
+	//Levels of the GL texture are the levels of the chain, the base level hides the ones not resident
+	GLuint uploaded = 0;
+	glBindTexture(GL_TEXTURE_2D, texture->id);
+	for (GLuint i = level; i < texture->residentLevel; i++)
+	{
+		MipLevel *mip = &texture->levels[i];
+		if (texture->compressed)
+			glCompressedTexImage2D(GL_TEXTURE_2D, i, texture->format, mip->width, mip->height, 0, (GLsizei)mip->data.size(), mip->data.data());
+		else
+			glTexImage2D(GL_TEXTURE_2D, i, texture->format, mip->width, mip->height, 0, GL_RGBA, GL_UNSIGNED_BYTE, mip->data.data());
+		uploaded += texture->levelBytes[i];
+		std::vector<GLubyte>().swap(mip->data);
+	}
+	//Evicted levels come back to the CPU and are redefined empty, which gives their memory back
+	for (GLuint i = texture->residentLevel; i < level; i++)
+	{
+		MipLevel *mip = &texture->levels[i];
+		mip->data.resize(texture->levelBytes[i]);
+		if (texture->compressed)
+		{
+			glGetCompressedTexImage(GL_TEXTURE_2D, i, mip->data.data());
+			glCompressedTexImage2D(GL_TEXTURE_2D, i, texture->format, 0, 0, 0, 0, nullptr);
+		}
+		else
+		{
+			glGetTexImage(GL_TEXTURE_2D, i, GL_RGBA, GL_UNSIGNED_BYTE, mip->data.data());
+			glTexImage2D(GL_TEXTURE_2D, i, texture->format, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+		}
+	}
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, (GLint)level);
+	//A single level texture is incomplete with a mipmapped minification filter
+	if (level + 1 == texture->levels.size() && GL_NEAREST != sampler.minFilter && GL_LINEAR != sampler.minFilter)
+		sampler.minFilter = GL_NEAREST_MIPMAP_NEAREST == sampler.minFilter || GL_NEAREST_MIPMAP_LINEAR == sampler.minFilter ? GL_NEAREST : GL_LINEAR;
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, sampler.minFilter);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, sampler.magFilter);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, sampler.wrapS);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, sampler.wrapT);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	this->mResidentBytes -= texture->residentBytes;
+	texture->residentBytes = 0;
+	for (GLuint i = level; i < texture->levels.size(); i++)
+		texture->residentBytes += texture->levelBytes[i];
+	this->mResidentBytes += texture->residentBytes;
+	texture->residentLevel = level;
+	texture->loaded = GL_TRUE;
+	return uploaded;
+}
+
+static GLuint64 bytesFrom(const Texture *texture, GLuint level)
+{
+	GLuint64 bytes = 0;
+	for (GLuint i = level; i < texture->levelBytes.size(); i++)
+		bytes += texture->levelBytes[i];
+	return bytes;
+}
+
+void TextureQueue::StreamTextures(const glm::vec3 &eye, GLfloat projectionScale, GLuint maxBytes)
+{
+	struct Candidate
+	{
+		glTFFile *file;
+		Texture *texture;
+		GLuint level;
+		//Largest projected size in pixels of the nodes using the texture
+		GLfloat pixels;
+	};
+	std::vector<Candidate> candidates;
+
+	//Files are only added from other threads and removed on this one, the GL work below runs without the lock
+	std::vector<glTFFile*> files;
+	{
+		std::lock_guard<std::mutex> lock(this->mMutex);
+		files.assign(this->mFiles.begin(), this->mFiles.end());
+	}
+	for (GLuint f = 0; f < files.size(); f++)
+	{
+		glTFFile *file = files[f];
+		std::vector<GLfloat> pixels(file->texturesCount, 0.0f);
+		for (GLuint i = 0; i < file->nodesCount; i++)
+		{
+			Node *node = &file->nodes[i];
+			if (!node->hasMesh)
+				continue;
+			glm::vec3 center = (node->boundingBox.bounds[0] + node->boundingBox.bounds[1]) * 0.5f;
+			GLfloat radius = glm::length(node->boundingBox.bounds[1] - node->boundingBox.bounds[0]) * 0.5f;
+			GLfloat distance = glm::length(center - eye) - radius;
+			GLfloat projected = distance <= 0.0f ? std::numeric_limits<GLfloat>::max() : (2.0f * radius / distance) * projectionScale;
+
+			Mesh *mesh = &file->meshes[node->mesh];
+			for (GLuint j = 0; j < mesh->primitivesCount; j++)
+			{
+				if (mesh->primitives[j].material >= file->materialsCount)
+					continue;
+				Material *material = &file->materials[mesh->primitives[j].material];
+				GLint used[] = { material->baseColorTexture, material->metallicRoughnessTexture, material->normalTexture, material->occlusionTexture, material->emissiveTexture };
+				for (GLuint k = 0; k < sizeof(used) / sizeof(used[0]); k++)
+				{
+					if (0 <= used[k] && (GLuint)used[k] < file->texturesCount && projected > pixels[used[k]])
+						pixels[used[k]] = projected;
+				}
+			}
+		}
+
+		for (GLuint i = 0; i < file->texturesCount; i++)
+		{
+			Texture *texture = &file->textures[i];
+			if (!texture->loaded)
+				continue;
+			//Finest level that still has at least one texel per projected pixel
+			GLuint level = 0;
+			while (level + 1 < texture->levels.size() && texture->levels[level + 1].width >= pixels[i] && texture->levels[level + 1].height >= pixels[i])
+				level++;
+			Candidate candidate = { file, texture, level, pixels[i] };
+			candidates.push_back(candidate);
+		}
+	}
+
+	//Over budget the least visible textures give up their finest levels first
+	GLuint64 wanted = 0;
+	for (GLuint i = 0; i < candidates.size(); i++)
+		wanted += bytesFrom(candidates[i].texture, candidates[i].level);
+	std::sort(candidates.begin(), candidates.end(), [](const Candidate &a, const Candidate &b) { return a.pixels < b.pixels; });
+	GLboolean reduced = GL_TRUE;
+	while (wanted > this->residencyBudget && reduced)
+	{
+		reduced = GL_FALSE;
+		for (GLuint i = 0; i < candidates.size() && wanted > this->residencyBudget; i++)
+		{
+			Candidate *candidate = &candidates[i];
+			if (candidate->level + 1 >= candidate->texture->levels.size())
+				continue;
+			wanted -= candidate->texture->levelBytes[candidate->level];
+			candidate->level++;
+			reduced = GL_TRUE;
+		}
+	}
+
+	//Evictions free memory right away, new levels stream in one at a time within the frame upload budget
+	GLuint bytes = 0;
+	for (GLuint i = 0; i < candidates.size(); i++)
+	{
+		if (candidates[i].level > candidates[i].texture->residentLevel)
+			this->makeResident(candidates[i].file, candidates[i].texture, candidates[i].level);
+	}
+	for (GLint i = (GLint)candidates.size() - 1; i >= 0 && bytes < maxBytes; i--)
+	{
+		if (candidates[i].level < candidates[i].texture->residentLevel)
+			bytes += this->makeResident(candidates[i].file, candidates[i].texture, candidates[i].texture->residentLevel - 1);
+	}
+}
+
+void TextureQueue::Discard(glTFFile *file)
+{
+	std::unique_lock<std::mutex> lock(this->mMutex);
+	this->mDiscarded.insert(file);
+	this->mDone.wait(lock, [this, file] { return 0 == this->mPending.count(file); });
+	for (std::deque<DecodedTexture*>::iterator it = this->mReady.begin(); it != this->mReady.end();)
+	{
+		if ((*it)->file == file)
+		{
+			delete *it;
+			it = this->mReady.erase(it);
+		}
+		else
+			++it;
+	}
+	this->mDiscarded.erase(file);
+	this->mFiles.erase(file);
+	for (GLuint i = 0; i < file->texturesCount; i++)
+		this->mResidentBytes -= file->textures[i].residentBytes;
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include <glad\glad.h>
+#include <string>
+#include <deque>
+#include <map>
+#include <set>
+#include <mutex>
+#include <condition_variable>
+
+#include "Module.h"
+#include "Mipmap.h"
+#include "Types.h"
+
+/*Decodes images on the ThreadPool and uploads the results on the render thread*/
+class TextureQueue : public Module<TextureQueue>
+{
+public:
+	//Filter used to build the mip chains of every decoded image
+	MipFilter filter;
+	//Bytes of texture levels allowed on the GPU at the same time
+	GLuint64 residencyBudget;
+	//Newly decoded textures start with the levels up to this size resident
+	GLuint initialResidentSize;
+
+	TextureQueue();
+	~TextureQueue();
+
+	ErrorCalls init(void* _init);
+	void release();
+
+	//Decodes the image at path into file->textures[texture]
+	void Request(glTFFile *file, GLuint texture, const std::string &path);
+	//Decodes an image already in memory, takes ownership of data
+	void Request(glTFFile *file, GLuint texture, GLubyte *data, GLuint size);
+
+	//Render thread only. Uploads decoded textures until maxBytes have been sent, returns the bytes uploaded
+	GLuint ProcessUploads(GLuint maxBytes);
+
+	//Render thread only. Picks the mip level each texture needs from the projected size of the nodes using it,
+	//evicts levels to stay within residencyBudget and streams in finer levels up to maxBytes per call.
+	//maxBytes is what's left of the frame budget after ProcessUploads.
+	//projectionScale is the viewport height divided by 2 * tan(fovy / 2)
+	void StreamTextures(const glm::vec3 &eye, GLfloat projectionScale, GLuint maxBytes);
+
+	GLuint64 GetResidentBytes() { return this->mResidentBytes; }
+
+	//Drops every pending decode and upload of file, called before the file is deleted
+	void Discard(glTFFile *file);
+
+private:
+	struct DecodedTexture
+	{
+		glTFFile *file;
+		GLuint texture;
+		//GL internal format of the levels, block compressed formats are uploaded as is
+		GLenum format;
+		GLboolean compressed;
+		std::vector<MipLevel> levels;
+	};
+
+	//Block formats the driver can sample, queried on init
+	GLboolean mHasS3TC;
+	GLboolean mHasBPTC;
+
+	std::deque<DecodedTexture*> mReady;
+	std::map<glTFFile*, GLuint> mPending;
+	std::set<glTFFile*> mDiscarded;
+	//Files with textures, walked when streaming
+	std::set<glTFFile*> mFiles;
+	GLuint64 mResidentBytes;
+	std::mutex mMutex;
+	std::condition_variable mDone;
+
+	void decode(glTFFile *file, GLuint texture, GLboolean sRGB, const std::string &path, GLubyte *data, GLuint size);
+	DecodedTexture *decodeImage(const GLubyte *data, GLuint size, GLboolean sRGB, const std::string &path);
+	DecodedTexture *transcodeKTX2(const GLubyte *data, GLuint size, GLboolean sRGB, const std::string &path);
+	GLuint upload(DecodedTexture *decoded);
+	//Moves the base level of the texture to level, uploading only the finer levels it was missing or reading back
+	//the ones evicted. Returns the bytes uploaded
+	GLuint makeResident(glTFFile *file, Texture *texture, GLuint level);
+};
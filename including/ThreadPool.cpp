@@ -0,0 +1,103 @@
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool() :
+	mStopping(false)
+{
+}
+
+ThreadPool::~ThreadPool()
+{
+}
+
+ErrorCalls ThreadPool::init(void* _init)
+{
+	GLuint count = std::thread::hardware_concurrency();
+	count = count > 1 ? count - 1 : 1;
+	if (NULL != _init)
+		count = *(GLuint*)_init;
+	if (0 == count)
+		return ErrorCalls::FAILURE;
+
+	for (GLuint i = 0; i < count; i++)
+		this->mWorkers.push_back(std::thread(&ThreadPool::work, this));
+
+	return ErrorCalls::SUCCESS;
+}
+
+void ThreadPool::release()
+{
+	{
+		std::lock_guard<std::mutex> lock(this->mMutex);
+		this->mStopping = true;
+	}
+	this->mWake.notify_all();
+	for (GLuint i = 0; i < this->mWorkers.size(); i++)
+		this->mWorkers[i].join();
+	this->mWorkers.clear();
+}
+
+void ThreadPool::Enqueue(std::function<void()> job)
+{
+	{
+		std::lock_guard<std::mutex> lock(this->mMutex);
+		this->mJobs.push_back(std::move(job));
+	}
+	this->mWake.notify_one();
+}
+
+void ThreadPool::ParallelFor(GLuint count, const std::function<void(GLuint)> &job)
+{
+	struct Batch
+	{
+		std::atomic<GLuint> next;
+		std::atomic<GLuint> done;
+		std::mutex mutex;
+		std::condition_variable finished;
+	};
+	//Workers may only pick their job after the batch is over, they must find it alive
+	std::shared_ptr<Batch> batch = std::make_shared<Batch>();
+	batch->next = 0;
+	batch->done = 0;
+	const std::function<void(GLuint)> *function = &job;
+	std::function<void()> run = [batch, function, count]()
+	{
+		GLuint i;
+		while ((i = batch->next++) < count)
+		{
+			(*function)(i);
+			if (count == ++batch->done)
+			{
+				std::lock_guard<std::mutex> lock(batch->mutex);
+				batch->finished.notify_all();
+			}
+		}
+	};
+
+	GLuint helpers = count > 1 ? count - 1 : 0;
+	if (helpers > this->mWorkers.size())
+		helpers = (GLuint)this->mWorkers.size();
+	for (GLuint i = 0; i < helpers; i++)
+		this->Enqueue(run);
+	//The caller works too, so nested calls from a worker can't starve the pool
+	run();
+	std::unique_lock<std::mutex> lock(batch->mutex);
+	batch->finished.wait(lock, [&batch, count] { return count == batch->done; });
+}
+
+void ThreadPool::work()
+{
+	while (true)
+	{
+		std::function<void()> job;
+		{
+			std::unique_lock<std::mutex> lock(this->mMutex);
+			this->mWake.wait(lock, [this] { return this->mStopping || !this->mJobs.empty(); });
+			//Pending jobs are still run on release so nobody waits on work that never happens
+			if (this->mJobs.empty())
+				return;
+			job = std::move(this->mJobs.front());
+			this->mJobs.pop_front();
+		}
+		job();
+	}
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <glad\glad.h>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <atomic>
+#include <memory>
+
+#include "Module.h"
+
+/*Worker threads shared by the loader and the texture pipeline*/
+class ThreadPool : public Module<ThreadPool>
+{
+public:
+	ThreadPool();
+	~ThreadPool();
+
+	//_init: optional GLuint* with the amount of workers, defaults to the hardware threads minus the render thread
+	ErrorCalls init(void* _init);
+	void release();
+
+	void Enqueue(std::function<void()> job);
+	//Runs job(0) to job(count - 1) on the workers and the calling thread, returns once every call finished
+	void ParallelFor(GLuint count, const std::function<void(GLuint)> &job);
+
+	GLuint GetWorkersCount() { return (GLuint)this->mWorkers.size(); }
+
+private:
+	std::vector<std::thread> mWorkers;
+	std::deque<std::function<void()>> mJobs;
+	std::mutex mMutex;
+	std::condition_variable mWake;
+	bool mStopping;
+
+	void work();
+};
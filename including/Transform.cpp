@@ -0,0 +1,406 @@
+#include "Transform.h"
+#include <cmath>
+#include <algorithm>
+#include <cstdlib>
+#include <chrono>
+#include <random>
+#include <functional>
+#include <iostream>
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define TRANSFORM_SSE
+#include <xmmintrin.h>
+#endif
+//The AVX2 kernels live in TransformAvx2.cpp and are picked when the CPU runs them, the rest of the program keeps the baseline
+#ifdef TRANSFORM_AVX2_DISPATCH
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+void TRSBatch::Clear()
+{
+	this->tx.clear();
+	this->ty.clear();
+	this->tz.clear();
+	this->rx.clear();
+	this->ry.clear();
+	this->rz.clear();
+	this->rw.clear();
+	this->sx.clear();
+	this->sy.clear();
+	this->sz.clear();
+	this->targets.clear();
+}
+
+void TRSBatch::Add(const glm::vec3 &translation, const glm::quat &rotation, const glm::vec3 &scale, GLuint target)
+{
+	this->tx.push_back(translation.x);
+	this->ty.push_back(translation.y);
+	this->tz.push_back(translation.z);
+	this->rx.push_back(rotation.x);
+	this->ry.push_back(rotation.y);
+	this->rz.push_back(rotation.z);
+	this->rw.push_back(rotation.w);
+	this->sx.push_back(scale.x);
+	this->sy.push_back(scale.y);
+	this->sz.push_back(scale.z);
+	this->targets.push_back(target);
+}
+
+//Column major matrix of one transform, columns are the rotation axes times the scale and the translation
+static void composeOne(GLfloat tx, GLfloat ty, GLfloat tz, GLfloat x, GLfloat y, GLfloat z, GLfloat w, GLfloat sx, GLfloat sy, GLfloat sz, GLfloat *m)
+{
+	GLfloat xx = x * x, yy = y * y, zz = z * z;
+	GLfloat xy = x * y, xz = x * z, yz = y * z;
+	GLfloat wx = w * x, wy = w * y, wz = w * z;
+	m[0] = (1.0f - 2.0f * (yy + zz)) * sx;
+	m[1] = 2.0f * (xy + wz) * sx;
+	m[2] = 2.0f * (xz - wy) * sx;
+	m[3] = 0.0f;
+	m[4] = 2.0f * (xy - wz) * sy;
+	m[5] = (1.0f - 2.0f * (xx + zz)) * sy;
+	m[6] = 2.0f * (yz + wx) * sy;
+	m[7] = 0.0f;
+	m[8] = 2.0f * (xz + wy) * sz;
+	m[9] = 2.0f * (yz - wx) * sz;
+	m[10] = (1.0f - 2.0f * (xx + yy)) * sz;
+	m[11] = 0.0f;
+	m[12] = tx;
+	m[13] = ty;
+	m[14] = tz;
+	m[15] = 1.0f;
+}
+
+glm::mat4 ComposeTRS(const glm::vec3 &translation, const glm::quat &rotation, const glm::vec3 &scale)
+{
+	glm::mat4 result;
+	composeOne(translation.x, translation.y, translation.z, rotation.x, rotation.y, rotation.z, rotation.w, scale.x, scale.y, scale.z, (GLfloat*)&result[0]);
+	return result;
+}
+
+void ComposeTransforms(TRSBatch &batch, glm::mat4 *matrices)
+{
+	GLuint count = batch.Size();
+	GLuint i = 0;
+#ifdef TRANSFORM_SSE
+	//Each lane holds a transform, the 16 values of 4 matrices are computed with vertical operations
+	//and transposed into the 4 columns of each matrix
+	const __m128 one = _mm_set1_ps(1.0f), two = _mm_set1_ps(2.0f), zero = _mm_setzero_ps();
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 x = _mm_loadu_ps(&batch.rx[i]), y = _mm_loadu_ps(&batch.ry[i]), z = _mm_loadu_ps(&batch.rz[i]), w = _mm_loadu_ps(&batch.rw[i]);
+		__m128 sx = _mm_loadu_ps(&batch.sx[i]), sy = _mm_loadu_ps(&batch.sy[i]), sz = _mm_loadu_ps(&batch.sz[i]);
+		__m128 x2 = _mm_mul_ps(x, two), y2 = _mm_mul_ps(y, two), z2 = _mm_mul_ps(z, two);
+		__m128 xx = _mm_mul_ps(x, x2), yy = _mm_mul_ps(y, y2), zz = _mm_mul_ps(z, z2);
+		__m128 xy = _mm_mul_ps(x, y2), xz = _mm_mul_ps(x, z2), yz = _mm_mul_ps(y, z2);
+		__m128 wx = _mm_mul_ps(w, x2), wy = _mm_mul_ps(w, y2), wz = _mm_mul_ps(w, z2);
+
+		__m128 columns[4][4];
+		columns[0][0] = _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(yy, zz)), sx);
+		columns[0][1] = _mm_mul_ps(_mm_add_ps(xy, wz), sx);
+		columns[0][2] = _mm_mul_ps(_mm_sub_ps(xz, wy), sx);
+		columns[0][3] = zero;
+		columns[1][0] = _mm_mul_ps(_mm_sub_ps(xy, wz), sy);
+		columns[1][1] = _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(xx, zz)), sy);
+		columns[1][2] = _mm_mul_ps(_mm_add_ps(yz, wx), sy);
+		columns[1][3] = zero;
+		columns[2][0] = _mm_mul_ps(_mm_add_ps(xz, wy), sz);
+		columns[2][1] = _mm_mul_ps(_mm_sub_ps(yz, wx), sz);
+		columns[2][2] = _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(xx, yy)), sz);
+		columns[2][3] = zero;
+		columns[3][0] = _mm_loadu_ps(&batch.tx[i]);
+		columns[3][1] = _mm_loadu_ps(&batch.ty[i]);
+		columns[3][2] = _mm_loadu_ps(&batch.tz[i]);
+		columns[3][3] = one;
+		for (GLuint c = 0; c < 4; c++)
+		{
+			_MM_TRANSPOSE4_PS(columns[c][0], columns[c][1], columns[c][2], columns[c][3]);
+			for (GLuint k = 0; k < 4; k++)
+				_mm_storeu_ps((GLfloat*)&matrices[batch.targets[i + k]][c], columns[c][k]);
+		}
+	}
+#endif
+	for (; i < count; i++)
+		composeOne(batch.tx[i], batch.ty[i], batch.tz[i], batch.rx[i], batch.ry[i], batch.rz[i], batch.rw[i], batch.sx[i], batch.sy[i], batch.sz[i], (GLfloat*)&matrices[batch.targets[i]][0]);
+}
+
+//Vector operations of the baseline instruction set, see TransformKernels.h
+struct ScalarLanes
+{
+	typedef GLfloat Vector;
+	static const GLuint Width = 1;
+	static Vector Load(const GLfloat *values) { return *values; }
+	static void Store(GLfloat *values, Vector vector) { *values = vector; }
+	static Vector Mul(Vector a, Vector b) { return a * b; }
+	static Vector Add(Vector a, Vector b) { return a + b; }
+	static Vector MulAdd(Vector a, Vector b, Vector c) { return a * b + c; }
+	static void LoadColumn(const GLfloat *const *matrices, GLuint column, Vector *rows)
+	{
+		for (GLuint row = 0; row < 4; row++)
+			rows[row] = matrices[0][column * 4 + row];
+	}
+	static void StoreColumn(GLfloat *const *matrices, GLuint column, const Vector *rows)
+	{
+		for (GLuint row = 0; row < 4; row++)
+			matrices[0][column * 4 + row] = rows[row];
+	}
+};
+
+#ifdef TRANSFORM_SSE
+struct SseLanes
+{
+	typedef __m128 Vector;
+	static const GLuint Width = 4;
+	static Vector Load(const GLfloat *values) { return _mm_loadu_ps(values); }
+	static void Store(GLfloat *values, Vector vector) { _mm_storeu_ps(values, vector); }
+	static Vector Mul(Vector a, Vector b) { return _mm_mul_ps(a, b); }
+	static Vector Add(Vector a, Vector b) { return _mm_add_ps(a, b); }
+	static Vector MulAdd(Vector a, Vector b, Vector c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+	static void LoadColumn(const GLfloat *const *matrices, GLuint column, Vector *rows)
+	{
+		Vector r0 = _mm_loadu_ps(matrices[0] + column * 4), r1 = _mm_loadu_ps(matrices[1] + column * 4);
+		Vector r2 = _mm_loadu_ps(matrices[2] + column * 4), r3 = _mm_loadu_ps(matrices[3] + column * 4);
+		_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+		rows[0] = r0;
+		rows[1] = r1;
+		rows[2] = r2;
+		rows[3] = r3;
+	}
+	static void StoreColumn(GLfloat *const *matrices, GLuint column, const Vector *rows)
+	{
+		Vector r0 = rows[0], r1 = rows[1], r2 = rows[2], r3 = rows[3];
+		_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+		_mm_storeu_ps(matrices[0] + column * 4, r0);
+		_mm_storeu_ps(matrices[1] + column * 4, r1);
+		_mm_storeu_ps(matrices[2] + column * 4, r2);
+		_mm_storeu_ps(matrices[3] + column * 4, r3);
+	}
+};
+typedef SseLanes BaselineLanes;
+#else
+typedef ScalarLanes BaselineLanes;
+#endif
+
+//r = a * b for column major 4x4 matrices, every column of r is the columns of a weighted by a column of b
+static inline void multiplyOne(const GLfloat *a, const GLfloat *b, GLfloat *r)
+{
+#ifdef TRANSFORM_SSE
+	__m128 a0 = _mm_loadu_ps(a), a1 = _mm_loadu_ps(a + 4), a2 = _mm_loadu_ps(a + 8), a3 = _mm_loadu_ps(a + 12);
+	__m128 columns[4] = { _mm_loadu_ps(b), _mm_loadu_ps(b + 4), _mm_loadu_ps(b + 8), _mm_loadu_ps(b + 12) };
+	for (GLuint c = 0; c < 4; c++)
+	{
+		__m128 result = _mm_mul_ps(a0, _mm_shuffle_ps(columns[c], columns[c], 0x00));
+		result = _mm_add_ps(result, _mm_mul_ps(a1, _mm_shuffle_ps(columns[c], columns[c], 0x55)));
+		result = _mm_add_ps(result, _mm_mul_ps(a2, _mm_shuffle_ps(columns[c], columns[c], 0xAA)));
+		result = _mm_add_ps(result, _mm_mul_ps(a3, _mm_shuffle_ps(columns[c], columns[c], 0xFF)));
+		_mm_storeu_ps(r + c * 4, result);
+	}
+#else
+	GLfloat result[16];
+	for (GLuint c = 0; c < 4; c++)
+	{
+		for (GLuint row = 0; row < 4; row++)
+			result[c * 4 + row] = a[row] * b[c * 4] + a[4 + row] * b[c * 4 + 1] + a[8 + row] * b[c * 4 + 2] + a[12 + row] * b[c * 4 + 3];
+	}
+	for (GLuint i = 0; i < 16; i++)
+		r[i] = result[i];
+#endif
+}
+
+static GLuint multiplyMatricesBaseline(const GLfloat *a, const GLfloat *b, GLfloat *results, GLuint count)
+{
+	return multiplyBatches<BaselineLanes>(a, b, results, count);
+}
+
+static GLuint composeWorldMatricesBaseline(GLfloat *worlds, const GLfloat *locals, const GLint *parents, const GLuint *slots, GLuint count)
+{
+	return composeBatches<BaselineLanes>(worlds, locals, parents, slots, count);
+}
+
+static void multiplyAffineBaseline(const GLfloat *a, const GLfloat *b, GLfloat *results, GLuint blocksCount)
+{
+	multiplyBlocks<BaselineLanes>(a, b, results, blocksCount);
+}
+
+//AVX2 and FMA in the CPU, and AVX state saved by the OS
+static GLboolean cpuHasAvx2()
+{
+#if !defined(TRANSFORM_AVX2_DISPATCH)
+	return GL_FALSE;
+#elif defined(_MSC_VER)
+	GLint info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7)
+		return GL_FALSE;
+	__cpuid(info, 1);
+	GLboolean fma = 0 != (info[2] & (1 << 12)), osxsave = 0 != (info[2] & (1 << 27)), avx = 0 != (info[2] & (1 << 28));
+	if (!fma || !osxsave || !avx || 6 != (_xgetbv(0) & 6))
+		return GL_FALSE;
+	__cpuidex(info, 7, 0);
+	return 0 != (info[1] & (1 << 5));
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+}
+
+//Kernels for the CPU running the program, each batch function returns how many matrices it handled
+struct TransformKernels
+{
+	GLuint(*multiplyMatrices)(const GLfloat *a, const GLfloat *b, GLfloat *results, GLuint count);
+	GLuint(*composeWorldMatrices)(GLfloat *worlds, const GLfloat *locals, const GLint *parents, const GLuint *slots, GLuint count);
+	void(*multiplyAffine)(const GLfloat *a, const GLfloat *b, GLfloat *results, GLuint blocksCount);
+	const char *name;
+};
+
+static TransformKernels selectKernels()
+{
+#ifdef TRANSFORM_AVX2_DISPATCH
+	if (cpuHasAvx2())
+		return { MultiplyMatricesAvx2, ComposeWorldMatricesAvx2, MultiplyAffineAvx2, "AVX2" };
+#endif
+#ifdef TRANSFORM_SSE
+	return { multiplyMatricesBaseline, composeWorldMatricesBaseline, multiplyAffineBaseline, "SSE" };
+#else
+	return { multiplyMatricesBaseline, composeWorldMatricesBaseline, multiplyAffineBaseline, "scalar" };
+#endif
+}
+
+//Picked once, on first use
+static const TransformKernels &kernels()
+{
+	static const TransformKernels selected = selectKernels();
+	return selected;
+}
+
+void MultiplyMatrices(const glm::mat4 *a, const glm::mat4 *b, glm::mat4 *results, GLuint count)
+{
+	GLuint i = kernels().multiplyMatrices((const GLfloat*)a, (const GLfloat*)b, (GLfloat*)results, count);
+	for (; i < count; i++)
+		multiplyOne((const GLfloat*)&a[i][0], (const GLfloat*)&b[i][0], (GLfloat*)&results[i][0]);
+}
+
+void ComposeWorldMatrices(glm::mat4 *worlds, const glm::mat4 *locals, const GLint *parents, const GLuint *slots, GLuint count)
+{
+	GLuint i = kernels().composeWorldMatrices((GLfloat*)worlds, (const GLfloat*)locals, parents, slots, count);
+	for (; i < count; i++)
+	{
+		GLuint slot = slots[i];
+		multiplyOne((const GLfloat*)&worlds[parents[slot]][0], (const GLfloat*)&locals[slot][0], (GLfloat*)&worlds[slot][0]);
+	}
+}
+
+void PackAffine(const glm::mat4 *matrices, GLuint count, AffineBlock *blocks)
+{
+	GLuint blocksCount = AffineBlockCount(count);
+	for (GLuint i = 0; i < blocksCount * AFFINE_BLOCK_WIDTH; i++)
+	{
+		AffineBlock *block = &blocks[i / AFFINE_BLOCK_WIDTH];
+		GLuint lane = i % AFFINE_BLOCK_WIDTH;
+		for (GLuint c = 0; c < 4; c++)
+		{
+			for (GLuint row = 0; row < 3; row++)
+				block->m[c * 3 + row][lane] = i < count ? matrices[i][c][row] : (c == row ? 1.0f : 0.0f);
+		}
+	}
+}
+
+void UnpackAffine(const AffineBlock *blocks, GLuint count, glm::mat4 *matrices)
+{
+	for (GLuint i = 0; i < count; i++)
+	{
+		const AffineBlock *block = &blocks[i / AFFINE_BLOCK_WIDTH];
+		GLuint lane = i % AFFINE_BLOCK_WIDTH;
+		for (GLuint c = 0; c < 4; c++)
+		{
+			for (GLuint row = 0; row < 3; row++)
+				matrices[i][c][row] = block->m[c * 3 + row][lane];
+			matrices[i][c][3] = 3 == c ? 1.0f : 0.0f;
+		}
+	}
+}
+
+void MultiplyAffine(const AffineBlock *a, const AffineBlock *b, AffineBlock *results, GLuint blocksCount)
+{
+	kernels().multiplyAffine((const GLfloat*)a, (const GLfloat*)b, (GLfloat*)results, blocksCount);
+}
+
+int RunTransformBenchmark(int argc, char **argv)
+{
+	GLuint count = argc > 2 ? (GLuint)std::strtoul(argv[2], nullptr, 10) : 4096;
+	GLuint iterations = argc > 3 ? (GLuint)std::strtoul(argv[3], nullptr, 10) : 1000;
+	if (0 == count || 0 == iterations)
+	{
+		std::cout << "Usage: " << argv[0] << " -bench [matrices] [iterations]" << std::endl;
+		return 1;
+	}
+	//The kernel actually dispatched on this CPU
+	const char *kernel = kernels().name;
+
+	std::mt19937 random(1);
+	std::uniform_real_distribution<GLfloat> distribution(-1.0f, 1.0f);
+	std::vector<glm::mat4> a(count), b(count), expected(count), results(count), affineResults(count);
+	for (GLuint i = 0; i < count; i++)
+	{
+		glm::vec3 translation(distribution(random), distribution(random), distribution(random));
+		glm::quat rotation = glm::normalize(glm::quat(distribution(random), distribution(random), distribution(random), distribution(random)));
+		glm::vec3 scale = glm::vec3(2.0f) + glm::vec3(distribution(random), distribution(random), distribution(random));
+		a[i] = ComposeTRS(translation, rotation, scale);
+		b[i] = ComposeTRS(translation * 10.0f, glm::conjugate(rotation), glm::vec3(1.0f) / scale);
+	}
+	std::vector<AffineBlock> blocksA(AffineBlockCount(count)), blocksB(AffineBlockCount(count)), blocksResults(AffineBlockCount(count));
+	PackAffine(a.data(), count, blocksA.data());
+	PackAffine(b.data(), count, blocksB.data());
+
+	auto measure = [iterations](const std::function<void()> &job)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		for (GLuint i = 0; i < iterations; i++)
+			job();
+		std::chrono::duration<GLdouble, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+		return elapsed.count() / iterations;
+	};
+	GLdouble glmMs = measure([&]()
+	{
+		for (GLuint i = 0; i < count; i++)
+			expected[i] = a[i] * b[i];
+	});
+	GLdouble matricesMs = measure([&]() { MultiplyMatrices(a.data(), b.data(), results.data(), count); });
+	GLdouble affineMs = measure([&]() { MultiplyAffine(blocksA.data(), blocksB.data(), blocksResults.data(), (GLuint)blocksResults.size()); });
+	UnpackAffine(blocksResults.data(), count, affineResults.data());
+
+	GLfloat error = 0.0f;
+	for (GLuint i = 0; i < count; i++)
+	{
+		for (GLuint c = 0; c < 4; c++)
+		{
+			for (GLuint row = 0; row < 4; row++)
+			{
+				error = std::max(error, std::abs(results[i][c][row] - expected[i][c][row]));
+				error = std::max(error, std::abs(affineResults[i][c][row] - expected[i][c][row]));
+			}
+		}
+	}
+	std::cout << "TRANSFORM::BENCHMARK Message: " << count << " matrices, " << iterations << " iterations, " << kernel << " kernels." << std::endl;
+	std::cout << "  glm:              " << glmMs << "ms" << std::endl;
+	std::cout << "  MultiplyMatrices: " << matricesMs << "ms, " << glmMs / matricesMs << "x" << std::endl;
+	std::cout << "  MultiplyAffine:   " << affineMs << "ms, " << glmMs / affineMs << "x" << std::endl;
+	std::cout << "  Largest difference to glm: " << error << std::endl;
+	return 0;
+}
+
+Box TransformBox(const Box &box, const glm::mat4 &model)
+{
+	if (box.bounds[0].x > box.bounds[1].x)
+		return box;
+	glm::vec3 center = glm::vec3(model * glm::vec4((box.bounds[0] + box.bounds[1]) * 0.5f, 1.0f));
+	glm::vec3 extents = (box.bounds[1] - box.bounds[0]) * 0.5f;
+	glm::vec3 worldExtents;
+	for (GLint i = 0; i < 3; i++)
+		worldExtents[i] = std::abs(model[0][i]) * extents.x + std::abs(model[1][i]) * extents.y + std::abs(model[2][i]) * extents.z;
+	Box result;
+	result.bounds[0] = center - worldExtents;
+	result.bounds[1] = center + worldExtents;
+	return result;
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <glad\glad.h>
+#include <glm\glm.hpp>
+#include <glm\gtc\quaternion.hpp>
+#include <vector>
+#include <limits>
+
+#include "Box.h"
+#include "TransformKernels.h"
+
+//Translation, rotation and scale of many transforms, one array per component so they are composed 4 at a time
+struct TRSBatch
+{
+	std::vector<GLfloat> tx, ty, tz;
+	std::vector<GLfloat> rx, ry, rz, rw;
+	std::vector<GLfloat> sx, sy, sz;
+	//Index in the destination array of every transform
+	std::vector<GLuint> targets;
+
+	GLuint Size() { return (GLuint)this->targets.size(); }
+	void Clear();
+	void Add(const glm::vec3 &translation, const glm::quat &rotation, const glm::vec3 &scale, GLuint target);
+};
+
+//T * R * S as an affine matrix, rotation must be normalized
+glm::mat4 ComposeTRS(const glm::vec3 &translation, const glm::quat &rotation, const glm::vec3 &scale);
+
+//Composes every transform of batch into matrices[batch.targets[i]]. The rotations and scales are applied directly
+//to the 3x4 affine part, no matrix is multiplied, and 4 transforms are composed per SSE iteration
+void ComposeTransforms(TRSBatch &batch, glm::mat4 *matrices);
+
+//results[i] = a[i] * b[i], 8 matrices at a time with AVX2 when the CPU has it and 4 with SSE otherwise, transposed so each register holds one element
+//of every matrix. The remainder is multiplied one by one. Both inputs are read before results[i] is written, so it can be
+//one of them. For skinning and instancing arrays
+void MultiplyMatrices(const glm::mat4 *a, const glm::mat4 *b, glm::mat4 *results, GLuint count);
+
+//worlds[slots[i]] = worlds[parents[slots[i]]] * locals[slots[i]] for a batch of nodes whose parents aren't in it,
+//gathered into the same batches as MultiplyMatrices
+void ComposeWorldMatrices(glm::mat4 *worlds, const glm::mat4 *locals, const GLint *parents, const GLuint *slots, GLuint count);
+
+//AFFINE_BLOCK_WIDTH affine matrices stored element by element, m[column * 3 + row][lane], the last row is always 0 0 0 1.
+//Every element of the block is one vector of 8 lanes with AVX, or two of 4 with SSE
+struct AffineBlock
+{
+	GLfloat m[12][AFFINE_BLOCK_WIDTH];
+};
+
+inline GLuint AffineBlockCount(GLuint count) { return (count + AFFINE_BLOCK_WIDTH - 1) / AFFINE_BLOCK_WIDTH; }
+//Lanes past count are filled with the identity
+void PackAffine(const glm::mat4 *matrices, GLuint count, AffineBlock *blocks);
+void UnpackAffine(const AffineBlock *blocks, GLuint count, glm::mat4 *matrices);
+//results[i] = a[i] * b[i] for every lane of blocksCount blocks, results can be a or b
+void MultiplyAffine(const AffineBlock *a, const AffineBlock *b, AffineBlock *results, GLuint blocksCount);
+
+//Command line entry point: including -bench [matrices] [iterations]
+//Times glm against MultiplyMatrices and MultiplyAffine on the same random affine matrices and prints the speedups
+//and the kernels picked for this CPU
+int RunTransformBenchmark(int argc, char **argv);
+
+//Bounds of box after an affine transform, from its center and extents so rotations keep it tight
+Box TransformBox(const Box &box, const glm::mat4 &model);
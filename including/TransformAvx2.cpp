@@ -0,0 +1,78 @@
+//Built with /arch:AVX2 by the project, the pragmas do the same for GCC and Clang. Nothing in here runs before
+//Transform.cpp checks the CPU supports AVX2 and FMA
+#if defined(__clang__)
+#pragma clang attribute push (__attribute__((target("avx2,fma"))), apply_to = function)
+#elif defined(__GNUC__)
+#pragma GCC target("avx2,fma")
+#endif
+#include "TransformKernels.h"
+
+#ifdef TRANSFORM_AVX2_DISPATCH
+#include <immintrin.h>
+
+struct AvxLanes
+{
+	typedef __m256 Vector;
+	static const GLuint Width = 8;
+	static Vector Load(const GLfloat *values) { return _mm256_loadu_ps(values); }
+	static void Store(GLfloat *values, Vector vector) { _mm256_storeu_ps(values, vector); }
+	static Vector Mul(Vector a, Vector b) { return _mm256_mul_ps(a, b); }
+	static Vector Add(Vector a, Vector b) { return _mm256_add_ps(a, b); }
+	static Vector MulAdd(Vector a, Vector b, Vector c) { return _mm256_fmadd_ps(a, b, c); }
+	//The first 4 matrices go to the low halves and the last 4 to the high halves
+	static void LoadColumn(const GLfloat *const *matrices, GLuint column, Vector *rows)
+	{
+		__m256 r0 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(matrices[0] + column * 4)), _mm_loadu_ps(matrices[4] + column * 4), 1);
+		__m256 r1 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(matrices[1] + column * 4)), _mm_loadu_ps(matrices[5] + column * 4), 1);
+		__m256 r2 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(matrices[2] + column * 4)), _mm_loadu_ps(matrices[6] + column * 4), 1);
+		__m256 r3 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(matrices[3] + column * 4)), _mm_loadu_ps(matrices[7] + column * 4), 1);
+		//4x4 transpose within each 128 bit half
+		__m256 t0 = _mm256_unpacklo_ps(r0, r1), t1 = _mm256_unpackhi_ps(r0, r1);
+		__m256 t2 = _mm256_unpacklo_ps(r2, r3), t3 = _mm256_unpackhi_ps(r2, r3);
+		rows[0] = _mm256_shuffle_ps(t0, t2, 0x44);
+		rows[1] = _mm256_shuffle_ps(t0, t2, 0xEE);
+		rows[2] = _mm256_shuffle_ps(t1, t3, 0x44);
+		rows[3] = _mm256_shuffle_ps(t1, t3, 0xEE);
+	}
+	static void StoreColumn(GLfloat *const *matrices, GLuint column, const Vector *rows)
+	{
+		__m256 t0 = _mm256_unpacklo_ps(rows[0], rows[1]), t1 = _mm256_unpackhi_ps(rows[0], rows[1]);
+		__m256 t2 = _mm256_unpacklo_ps(rows[2], rows[3]), t3 = _mm256_unpackhi_ps(rows[2], rows[3]);
+		__m256 c0 = _mm256_shuffle_ps(t0, t2, 0x44), c1 = _mm256_shuffle_ps(t0, t2, 0xEE);
+		__m256 c2 = _mm256_shuffle_ps(t1, t3, 0x44), c3 = _mm256_shuffle_ps(t1, t3, 0xEE);
+		_mm_storeu_ps(matrices[0] + column * 4, _mm256_castps256_ps128(c0));
+		_mm_storeu_ps(matrices[1] + column * 4, _mm256_castps256_ps128(c1));
+		_mm_storeu_ps(matrices[2] + column * 4, _mm256_castps256_ps128(c2));
+		_mm_storeu_ps(matrices[3] + column * 4, _mm256_castps256_ps128(c3));
+		_mm_storeu_ps(matrices[4] + column * 4, _mm256_extractf128_ps(c0, 1));
+		_mm_storeu_ps(matrices[5] + column * 4, _mm256_extractf128_ps(c1, 1));
+		_mm_storeu_ps(matrices[6] + column * 4, _mm256_extractf128_ps(c2, 1));
+		_mm_storeu_ps(matrices[7] + column * 4, _mm256_extractf128_ps(c3, 1));
+	}
+};
+
+GLuint MultiplyMatricesAvx2(const GLfloat *a, const GLfloat *b, GLfloat *results, GLuint count)
+{
+	GLuint done = multiplyBatches<AvxLanes>(a, b, results, count);
+	//Upper halves are cleared so the SSE code the caller runs next doesn't pay for the transition
+	_mm256_zeroupper();
+	return done;
+}
+
+GLuint ComposeWorldMatricesAvx2(GLfloat *worlds, const GLfloat *locals, const GLint *parents, const GLuint *slots, GLuint count)
+{
+	GLuint done = composeBatches<AvxLanes>(worlds, locals, parents, slots, count);
+	_mm256_zeroupper();
+	return done;
+}
+
+void MultiplyAffineAvx2(const GLfloat *a, const GLfloat *b, GLfloat *results, GLuint blocksCount)
+{
+	multiplyBlocks<AvxLanes>(a, b, results, blocksCount);
+	_mm256_zeroupper();
+}
+#endif
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#endif
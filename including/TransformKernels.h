@@ -0,0 +1,117 @@
+#pragma once
+#include <glad\glad.h>
+
+//Matrix kernels shared by Transform.cpp and TransformAvx2.cpp. The AVX2 file is built for AVX2 and only runs once the CPU
+//is checked, so it can't share any inline function with the rest of the program: everything here works on plain floats
+//and the templates are static, every file gets its own copy compiled for its own instruction set
+
+#define AFFINE_BLOCK_WIDTH 8
+//Floats of one AffineBlock, 12 elements of AFFINE_BLOCK_WIDTH lanes
+#define AFFINE_BLOCK_FLOATS (12 * AFFINE_BLOCK_WIDTH)
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define TRANSFORM_AVX2_DISPATCH
+//AVX2 kernels picked at runtime, each one handles whole batches of 8 and returns how many matrices it multiplied
+GLuint MultiplyMatricesAvx2(const GLfloat *a, const GLfloat *b, GLfloat *results, GLuint count);
+GLuint ComposeWorldMatricesAvx2(GLfloat *worlds, const GLfloat *locals, const GLint *parents, const GLuint *slots, GLuint count);
+void MultiplyAffineAvx2(const GLfloat *a, const GLfloat *b, GLfloat *results, GLuint blocksCount);
+#endif
+
+//Lanes provides a Vector of Width floats with Load, Store, Mul, Add and MulAdd. LoadColumn transposes a column of Width
+//matrices into one vector per row, lane k holding matrices[k], StoreColumn undoes it
+
+//results[k] = a[k] * b[k] for the Width matrices of one batch, every element of a result is 4 multiply adds across the lanes.
+//All of a is loaded first and b is read a column before that column of the result is stored, so results can be a or b
+template<typename Lanes>
+static void multiplyLanes(const GLfloat *const *a, const GLfloat *const *b, GLfloat *const *results)
+{
+	typename Lanes::Vector left[16], right[4], column[4];
+	for (GLuint c = 0; c < 4; c++)
+		Lanes::LoadColumn(a, c, &left[c * 4]);
+	for (GLuint c = 0; c < 4; c++)
+	{
+		Lanes::LoadColumn(b, c, right);
+		for (GLuint row = 0; row < 4; row++)
+		{
+			typename Lanes::Vector value = Lanes::Mul(left[row], right[0]);
+			value = Lanes::MulAdd(left[4 + row], right[1], value);
+			value = Lanes::MulAdd(left[8 + row], right[2], value);
+			column[row] = Lanes::MulAdd(left[12 + row], right[3], value);
+		}
+		Lanes::StoreColumn(results, c, column);
+	}
+}
+
+//Whole batches of MultiplyMatrices over 16 float matrices, returns how many were multiplied
+template<typename Lanes>
+static GLuint multiplyBatches(const GLfloat *a, const GLfloat *b, GLfloat *results, GLuint count)
+{
+	const GLfloat *left[Lanes::Width], *right[Lanes::Width];
+	GLfloat *products[Lanes::Width];
+	GLuint i = 0;
+	for (; i + Lanes::Width <= count; i += Lanes::Width)
+	{
+		for (GLuint k = 0; k < Lanes::Width; k++)
+		{
+			left[k] = a + (i + k) * 16;
+			right[k] = b + (i + k) * 16;
+			products[k] = results + (i + k) * 16;
+		}
+		multiplyLanes<Lanes>(left, right, products);
+	}
+	return i;
+}
+
+//Whole batches of ComposeWorldMatrices, parents and locals are gathered through slots. Returns how many were composed
+template<typename Lanes>
+static GLuint composeBatches(GLfloat *worlds, const GLfloat *locals, const GLint *parents, const GLuint *slots, GLuint count)
+{
+	const GLfloat *left[Lanes::Width], *right[Lanes::Width];
+	GLfloat *products[Lanes::Width];
+	GLuint i = 0;
+	for (; i + Lanes::Width <= count; i += Lanes::Width)
+	{
+		for (GLuint k = 0; k < Lanes::Width; k++)
+		{
+			GLuint slot = slots[i + k];
+			left[k] = worlds + parents[slot] * 16;
+			right[k] = locals + slot * 16;
+			products[k] = worlds + slot * 16;
+		}
+		multiplyLanes<Lanes>(left, right, products);
+	}
+	return i;
+}
+
+//Vertical affine product of AffineBlocks, no shuffles: every element of the result is 3 multiplies and adds across the lanes
+template<typename Lanes>
+static void multiplyBlocks(const GLfloat *a, const GLfloat *b, GLfloat *results, GLuint blocksCount)
+{
+	for (GLuint i = 0; i < blocksCount; i++)
+	{
+		const GLfloat *blockA = a + i * AFFINE_BLOCK_FLOATS, *blockB = b + i * AFFINE_BLOCK_FLOATS;
+		GLfloat *blockResult = results + i * AFFINE_BLOCK_FLOATS;
+		for (GLuint lane = 0; lane < AFFINE_BLOCK_WIDTH; lane += Lanes::Width)
+		{
+			typename Lanes::Vector left[12], right[12];
+			for (GLuint e = 0; e < 12; e++)
+			{
+				left[e] = Lanes::Load(&blockA[e * AFFINE_BLOCK_WIDTH + lane]);
+				right[e] = Lanes::Load(&blockB[e * AFFINE_BLOCK_WIDTH + lane]);
+			}
+			for (GLuint c = 0; c < 4; c++)
+			{
+				for (GLuint row = 0; row < 3; row++)
+				{
+					typename Lanes::Vector value = Lanes::Mul(left[row], right[c * 3]);
+					value = Lanes::MulAdd(left[3 + row], right[c * 3 + 1], value);
+					value = Lanes::MulAdd(left[6 + row], right[c * 3 + 2], value);
+					//The translation column also gets the translation of a
+					if (3 == c)
+						value = Lanes::Add(value, left[9 + row]);
+					Lanes::Store(&blockResult[(c * 3 + row) * AFFINE_BLOCK_WIDTH + lane], value);
+				}
+			}
+		}
+	}
+}
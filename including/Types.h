@@ -1,13 +1,19 @@
 #pragma once
 #include <glm\glm.hpp>
+#include <glm\gtc\quaternion.hpp>
 #include <glad\glad.h>
 #include <string>
 #include <vector>
 #include <limits>
+#include <fstream>
 
 #include "Shader.h"
 #include "Ray.h"
 #include "Box.h"
+#include "Mipmap.h"
+#include "RenderQueue.h"
+
+struct LoadOptions;
 
 struct Vertex
 {
@@ -22,6 +28,74 @@ struct Material
 {
 	glm::vec4 color;
 	GLfloat metallic;
+	GLfloat roughness;
+	glm::vec3 emissive;
+	//Indices into glTFFile::textures, -1 when the material doesn't use the texture
+	GLint baseColorTexture;
+	GLint metallicRoughnessTexture;
+	GLint normalTexture;
+	GLint occlusionTexture;
+	GLint emissiveTexture;
+	//alphaMode BLEND, drawn in the transparent pass
+	GLboolean blend;
+	Material() : color(1.0f), metallic(1.0f), roughness(1.0f), emissive(0.0f), baseColorTexture(-1), metallicRoughnessTexture(-1), normalTexture(-1), occlusionTexture(-1), emissiveTexture(-1), blend(GL_FALSE) {}
+};
+
+struct Sampler
+{
+	GLint magFilter;
+	GLint minFilter;
+	GLint wrapS;
+	GLint wrapT;
+	Sampler() : magFilter(GL_LINEAR), minFilter(GL_LINEAR_MIPMAP_LINEAR), wrapS(GL_REPEAT), wrapT(GL_REPEAT) {}
+};
+
+struct Image
+{
+	std::string uri;
+	std::string mimeType;
+	//Buffer view holding the encoded image when it's embedded, -1 when it comes from uri
+	GLint view;
+	//Encoded bytes of an embedded image, kept by loads without upload so the GlbWriter can write them
+	std::vector<GLubyte> data;
+	Image() : view(-1) {}
+};
+
+struct Texture
+{
+	GLuint id;
+	GLint source;
+	//Plain image the KHR_texture_basisu source took precedence over, -1 without the extension or fallback
+	GLint fallbackSource;
+	GLboolean basisu;
+	GLint sampler;
+	GLboolean sRGB;
+	//Set on the render thread once the decoded mip chain has been uploaded
+	GLboolean loaded;
+	//Decoded mip chain, a level's data is only kept on the CPU while it isn't resident. Evicted levels are read back
+	std::vector<MipLevel> levels;
+	//Size of every level, known when its data is on the GPU
+	std::vector<GLuint> levelBytes;
+	GLenum format;
+	GLboolean compressed;
+	//Finest level of levels currently on the GPU, it's level 0 of the GL texture
+	GLuint residentLevel;
+	GLuint residentBytes;
+	Texture() : id(0), source(-1), fallbackSource(-1), basisu(GL_FALSE), sampler(-1), sRGB(GL_FALSE), loaded(GL_FALSE), format(GL_RGBA8), compressed(GL_FALSE), residentLevel(std::numeric_limits<GLuint>::max()), residentBytes(0) {}
+	~Texture()
+	{
+		if (0 != id)
+			glDeleteTextures(1, &id);
+	}
+};
+
+//What a primitive keeps on the CPU once its data is on the GPU
+enum GeometryRetention
+{
+	GEOMETRY_KEEP_ALL,
+	//Positions as float3 plus the indices, enough for picking and collision
+	GEOMETRY_KEEP_POSITIONS_ONLY,
+	GEOMETRY_DROP_AFTER_UPLOAD
 };
 
 struct Line
@@ -30,26 +104,51 @@ struct Line
 	glm::vec3 end;
 };
 
+//Where a float attribute sits in the data given to Primitive::uploadView
+struct AttributeLayout
+{
+	GLint components;
+	GLuint64 offset;
+	GLuint stride;
+};
+
 class Primitive
 {
 public:
 	Vertex *vertices;
 	GLuint *indices;
+	//Only set with GEOMETRY_KEEP_POSITIONS_ONLY, vertices is freed then
+	glm::vec3 *positions;
 	GLuint material;
 	GLuint verticesCount;
 	GLuint indicesCount;
 	GLint intersectID;
-	Primitive() :vertices(nullptr), indices(nullptr), material(0), verticesCount(0), indicesCount(0), intersectID(-1) {}
-	~Primitive()
-	{
-		delete[] this->vertices;
-		delete[] this->indices;
-	}
+	//Key of the data shared through the GeometryRegistry, 0 when the primitive owns its arrays
+	GLuint64 hash;
+	Primitive() :vertices(nullptr), indices(nullptr), positions(nullptr), material(0), verticesCount(0), indicesCount(0), intersectID(-1), hash(0), VAO(0), VBO(0), EBO(0), indexType(GL_UNSIGNED_INT), viewLayout(GL_FALSE) {}
+	~Primitive();
 	void setup(Vertex *_vertices, GLuint _verticesCount, GLuint *_indices, GLuint _indicesCount, GLuint _material);
+	//Sends vertices and indices to the GPU, reuses the buffers when they already exist
+	void upload();
+	//Uploads buffer view bytes as they are, attributes[i] goes to location i. Used instead of upload when the file's layout can be drawn directly
+	void uploadView(const GLubyte *vertexData, GLuint64 vertexBytes, const AttributeLayout *attributes, GLuint attributesCount, const GLubyte *indexData, GLuint64 indexBytes, GLenum type);
+	//Frees the CPU arrays not needed by retention, the counts are kept for drawing
+	void retain(GeometryRetention retention);
+	//Deletes the VAO and buffers the primitive created itself, before it's set up with a different layout or takes shared ones
+	void releaseBuffers();
+	GLboolean IsViewLayout() { return this->viewLayout; }
+	//Bytes of vertex data owned by the primitive, shared data is accounted by the GeometryRegistry
+	GLuint64 GetMemoryBytes();
 
-	void draw();
 private:
+	friend class GeometryRegistry;
+	friend class RenderQueue;
 	GLuint VAO, VBO, EBO;
+	GLenum indexType;
+	//Set when the VAO points into buffer view bytes instead of Vertex arrays
+	GLboolean viewLayout;
+
+	void uploadBuffers();
 };
 
 class Mesh
@@ -69,17 +168,23 @@ public:
 
 struct Node
 {
+	std::string name;
 	glm::vec3 translation;
+	glm::quat rotation;
 	glm::vec3 scale;
-	glm::mat4 model;
+	//Nodes given as a matrix use it as their local transform instead of translation, rotation and scale
+	glm::mat4 matrix;
+	GLboolean hasMatrix;
 	GLuint *children;
 	GLuint childrenCount;
 	GLboolean isRoot;
 	GLuint parent;
 	GLuint mesh;
 	GLboolean hasMesh;
+	//Bounds of the mesh in the node's space, boundingBox is computed from it in world space
+	Box localBoundingBox;
 	Box boundingBox;
-	Node() : children(nullptr), childrenCount(0), isRoot(GL_TRUE), hasMesh(GL_FALSE) {}
+	Node() : rotation(1.0f, 0.0f, 0.0f, 0.0f), hasMatrix(GL_FALSE), children(nullptr), childrenCount(0), isRoot(GL_TRUE), hasMesh(GL_FALSE) {}
 	~Node()
 	{
 		if(nullptr != children)
@@ -87,6 +192,15 @@ struct Node
 	}
 };
 
+//What UpdateTransforms has to recompute for a node
+enum NodeDirtyFlags
+{
+	NODE_DIRTY_LOCAL = 1,
+	NODE_DIRTY_WORLD = 2,
+	//Set on a root while it is in dirtyRoots
+	NODE_DIRTY_ROOT = 4
+};
+
 struct Scene
 {
 	GLuint *nodes;
@@ -105,56 +219,126 @@ public:
 	Mesh *meshes;
 	Node *nodes;
 	Material *materials;
+	Texture *textures;
+	Sampler *samplers;
+	Image *images;
 	GLuint scenesCount;
 	GLuint meshesCount;
 	GLuint nodesCount;
 	GLuint materialsCount;
-	glTFFile() : scenes(nullptr), meshes(nullptr), nodes(nullptr), materials(nullptr), scenesCount(0), meshesCount(0), nodesCount(0), materialsCount(0) {}
-	~glTFFile()
-	{
-		delete[] scenes;
-		delete[] meshes;
-		delete[] nodes;
-		delete[] materials;
-	}
-	void draw(GLuint sceneIndex, Shader *shader);
+	GLuint texturesCount;
+	GLuint samplersCount;
+	GLuint imagesCount;
+	//File it was loaded from and the buffers and images it references, watched for hot reload
+	std::string path;
+	std::vector<std::string> dependencies;
+	GeometryRetention retention;
+	//Options the file was loaded with, owned by the file. Reload loads it the same way
+	LoadOptions *loadOptions;
+	//Nodes reachable from the roots flattened depth first, parents come before their children so the world
+	//matrices are computed in one pass. Every subtree is a contiguous range of slots ending at flatEnds[slot]
+	GLuint *flatNodes;
+	GLint *flatParents;
+	GLuint *flatEnds;
+	glm::mat4 *localMatrices;
+	glm::mat4 *worldMatrices;
+	//World bounds of the meshes in the subtree of every root slot, other slots are unused
+	Box *subtreeBounds;
+	//NodeDirtyFlags of every slot, only the slots in the subtrees of dirtyRoots can be set
+	GLubyte *dirtyFlags;
+	//Root slots with a dirty node below them, only their subtrees are walked and their bounds merged again
+	std::vector<GLuint> dirtyRoots;
+	GLuint flatCount;
+	//Slot of every node in the flat arrays, -1 for nodes no root reaches
+	GLint *nodeSlots;
+	glTFFile() : scenes(nullptr), meshes(nullptr), nodes(nullptr), materials(nullptr), textures(nullptr), samplers(nullptr), images(nullptr), scenesCount(0), meshesCount(0), nodesCount(0), materialsCount(0), texturesCount(0), samplersCount(0), imagesCount(0), retention(GEOMETRY_KEEP_ALL), loadOptions(nullptr), flatNodes(nullptr), flatParents(nullptr), flatEnds(nullptr), localMatrices(nullptr), worldMatrices(nullptr), subtreeBounds(nullptr), dirtyFlags(nullptr), flatCount(0), nodeSlots(nullptr) {}
+	~glTFFile();
+	//Adds a draw for every primitive of the scene, the queue sorts them with the rest of the frame
+	void Submit(RenderQueue &queue, GLuint sceneIndex, Shader *shader);
 
+	//Flattens the nodes and computes their transforms, called once the nodes are loaded
 	void setup();
+	//Marks the local transform of node and the world transforms of its subtree for the next UpdateTransforms,
+	//needed after changing the node's transform or localBoundingBox directly
+	void MarkDirty(GLuint node);
+	void SetTranslation(GLuint node, const glm::vec3 &translation);
+	void SetRotation(GLuint node, const glm::quat &rotation);
+	void SetScale(GLuint node, const glm::vec3 &scale);
+	//Replaces the translation, rotation and scale of node with matrix, setting any of them switches the node back to them
+	void SetMatrix(GLuint node, const glm::mat4 &matrix);
+	//Recomputes the world matrices and bounds of the dirty nodes and returns how many nodes it touched, 0 when nothing moved.
+	//Called once per frame
+	GLuint UpdateTransforms();
+	glm::mat4 GetWorldMatrix(GLuint node);
+	//World bounds of every mesh below root node, empty for nodes that aren't roots
+	Box GetSubtreeBounds(GLuint node);
+	//Closest node to eye whose bounds the ray hits, -1 when none
+	GLint Pick(const Ray &ray, const glm::vec3 &eye);
+	//Uploads every primitive, for files loaded without upload
+	void upload();
+	//Frees everything loaded, leaving an empty file
+	void clear();
+	//Bytes of vertex data kept on the CPU by the primitives
+	GLuint64 GetGeometryBytes();
 
 private:
-	void drawNode(GLuint index, glm::mat4 parentM, Shader *shader);
+	friend class RenderQueue;
+	void bindMaterial(GLuint material, Shader *shader);
 
-	Box calculateBoundingBox(GLuint index, glm::mat4 parentModel);
+	void flatten();
+
+	void bindTexture(GLint texture, GLuint unit, const std::string &flag, Shader *shader);
 };
 
 struct Buffer
 {
 	GLubyte *data;
-	GLuint size;
-	Buffer() : data(nullptr), size(0) {}
+	GLuint64 size;
+	//Buffers over LoadOptions::streamThreshold stay on disk, data then holds a window of
+	//windowSize bytes starting at windowOffset and is read again when decoding moves past it
+	std::ifstream *stream;
+	GLuint64 windowOffset;
+	GLuint64 windowSize;
+	GLuint64 windowCapacity;
+	//data points into a mapped AssetArchive or the binary chunk of a .glb and isn't owned
+	GLboolean mapped;
+	Buffer() : data(nullptr), size(0), stream(nullptr), windowOffset(0), windowSize(0), windowCapacity(0), mapped(GL_FALSE) {}
 	~Buffer()
 	{
-		delete[] data;
+		if (!mapped)
+			delete[] data;
+		delete stream;
 	}
+	//Points result to the bytes at offset and returns how many of the size requested are readable from there
+	GLuint64 Map(GLuint64 offset, GLuint64 size, const GLubyte **result);
 };
 
 struct BufferView
 {
 	GLuint buffer;
-	GLuint offset;
-	GLuint size;
+	GLuint64 offset;
+	GLuint64 size;
+	//Bytes between elements of interleaved views, 0 when the elements are tightly packed
+	GLuint stride;
+	BufferView() : buffer(0), offset(0), size(0), stride(0) {}
 };
 
 struct Accessor
 {
 	GLuint view;
+	//Start of the first element inside the view
+	GLuint64 offset;
 	GLuint componentType;
+	//Integer components map to [0, 1] or [-1, 1] instead of their value
+	GLboolean normalized;
 	GLuint size;
 	GLuint count;
 	std::string type;
 	GLchar* min;
 	GLchar* max;
-	Accessor() : min(nullptr), max(nullptr), count(0) {}
+	//Bytes allocated for min and max, the Loader reuses its accessors between files
+	GLuint capacity;
+	Accessor() : offset(0), normalized(GL_FALSE), count(0), min(nullptr), max(nullptr), capacity(0) {}
 	~Accessor()
 	{
 		delete[] min;
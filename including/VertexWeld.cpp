@@ -0,0 +1,93 @@
+#include "VertexWeld.h"
+#include <unordered_map>
+#include <vector>
+#include <cmath>
+#include <cstring>
+
+#define WELD_KEY_SIZE 12
+
+struct WeldKey
+{
+	GLint values[WELD_KEY_SIZE];
+	bool operator==(const WeldKey &other) const { return 0 == std::memcmp(this->values, other.values, sizeof(this->values)); }
+};
+
+struct WeldKeyHash
+{
+	size_t operator()(const WeldKey &key) const
+	{
+		//FNV-1a over the quantized components
+		GLuint64 hash = 14695981039346656037ull;
+		for (GLuint i = 0; i < WELD_KEY_SIZE; i++)
+		{
+			hash ^= (GLuint)key.values[i];
+			hash *= 1099511628211ull;
+		}
+		return (size_t)hash;
+	}
+};
+
+//Index of the tolerance cell holding value, the exact bits when there's no tolerance
+static GLint quantize(GLfloat value, GLfloat tolerance)
+{
+	if (tolerance > 0.0f)
+		return (GLint)std::floor(value / tolerance + 0.5f);
+	GLint bits;
+	//-0 and 0 are the same value
+	value = 0.0f == value ? 0.0f : value;
+	std::memcpy(&bits, &value, sizeof(bits));
+	return bits;
+}
+
+static WeldKey makeKey(const Vertex &vertex, const WeldTolerances &tolerances)
+{
+	WeldKey key;
+	for (GLuint i = 0; i < 3; i++)
+	{
+		key.values[i] = quantize(vertex.position[i], tolerances.position);
+		key.values[3 + i] = quantize(vertex.normal[i], tolerances.normal);
+	}
+	for (GLuint i = 0; i < 2; i++)
+		key.values[6 + i] = quantize(vertex.texCoord0[i], tolerances.texCoord);
+	for (GLuint i = 0; i < 4; i++)
+		key.values[8 + i] = quantize(vertex.tangent[i], tolerances.tangent);
+	return key;
+}
+
+WeldResult WeldVertices(Primitive *primitive, const WeldTolerances &tolerances)
+{
+	WeldResult result;
+	result.verticesBefore = primitive->verticesCount;
+	result.verticesAfter = primitive->verticesCount;
+	if (nullptr == primitive->vertices || nullptr == primitive->indices || 0 != primitive->hash)
+		return result;
+
+	std::vector<GLint> remap(primitive->verticesCount, -1);
+	std::unordered_map<WeldKey, GLuint, WeldKeyHash> unique;
+	unique.reserve(primitive->verticesCount);
+	std::vector<GLuint> kept;
+	kept.reserve(primitive->verticesCount);
+	for (GLuint i = 0; i < primitive->indicesCount; i++)
+	{
+		GLuint index = primitive->indices[i];
+		if (index >= primitive->verticesCount)
+			continue;
+		if (0 > remap[index])
+		{
+			std::pair<std::unordered_map<WeldKey, GLuint, WeldKeyHash>::iterator, bool> found = unique.insert(std::make_pair(makeKey(primitive->vertices[index], tolerances), (GLuint)kept.size()));
+			if (found.second)
+				kept.push_back(index);
+			remap[index] = (GLint)found.first->second;
+		}
+		primitive->indices[i] = (GLuint)remap[index];
+	}
+
+	result.verticesAfter = (GLuint)kept.size();
+	Vertex *vertices = new Vertex[kept.size()];
+	for (GLuint i = 0; i < kept.size(); i++)
+		vertices[i] = primitive->vertices[kept[i]];
+	delete[] primitive->vertices;
+	primitive->vertices = vertices;
+	primitive->verticesCount = result.verticesAfter;
+	return result;
+}
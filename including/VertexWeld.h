@@ -0,0 +1,25 @@
+#pragma once
+#include <glad\glad.h>
+
+#include "Types.h"
+
+//Vertices closer than these per component are merged, 0 only merges identical values
+struct WeldTolerances
+{
+	GLfloat position;
+	GLfloat normal;
+	GLfloat texCoord;
+	GLfloat tangent;
+	WeldTolerances() : position(0.0f), normal(0.0f), texCoord(0.0f), tangent(0.0f) {}
+};
+
+struct WeldResult
+{
+	GLuint verticesBefore;
+	GLuint verticesAfter;
+	WeldResult() : verticesBefore(0), verticesAfter(0) {}
+};
+
+//Merges the vertices of primitive that fall in the same tolerance cell, drops the ones no index uses and remaps the indices.
+//Vertices are stored in the order the indices first reach them. Safe to run on different primitives in parallel
+WeldResult WeldVertices(Primitive *primitive, const WeldTolerances &tolerances);
@@ -1,6 +1,74 @@
 #include "Types.h"
+#include "TextureQueue.h"
+#include "GeometryRegistry.h"
+#include "Transform.h"
+#include "Load.h"
 #include <glm\gtc\matrix_transform.hpp>
 #include <iostream>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+glTFFile::~glTFFile()
+{
+	this->clear();
+	delete this->loadOptions;
+}
+
+void glTFFile::clear()
+{
+	if (nullptr != this->textures && nullptr != TextureQueue::GetPointerInstance())
+		TextureQueue::GetInstance().Discard(this);
+	delete[] scenes;
+	delete[] meshes;
+	delete[] nodes;
+	delete[] materials;
+	delete[] textures;
+	delete[] samplers;
+	delete[] images;
+	delete[] flatNodes;
+	delete[] flatParents;
+	delete[] flatEnds;
+	delete[] localMatrices;
+	delete[] worldMatrices;
+	delete[] subtreeBounds;
+	delete[] dirtyFlags;
+	delete[] nodeSlots;
+	flatNodes = nullptr;
+	flatParents = nullptr;
+	flatEnds = nullptr;
+	localMatrices = nullptr;
+	worldMatrices = nullptr;
+	subtreeBounds = nullptr;
+	dirtyFlags = nullptr;
+	nodeSlots = nullptr;
+	scenes = nullptr;
+	meshes = nullptr;
+	nodes = nullptr;
+	materials = nullptr;
+	textures = nullptr;
+	samplers = nullptr;
+	images = nullptr;
+	scenesCount = meshesCount = nodesCount = materialsCount = texturesCount = samplersCount = imagesCount = flatCount = 0;
+	dirtyRoots.clear();
+	dependencies.clear();
+}
+
+GLuint64 glTFFile::GetGeometryBytes()
+{
+	GLuint64 bytes = 0;
+	for (GLuint i = 0; i < this->meshesCount; i++)
+		for (GLuint j = 0; j < this->meshes[i].primitivesCount; j++)
+			bytes += this->meshes[i].primitives[j].GetMemoryBytes();
+	return bytes;
+}
+
+void glTFFile::upload()
+{
+	for (GLuint i = 0; i < this->meshesCount; i++)
+		for (GLuint j = 0; j < this->meshes[i].primitivesCount; j++)
+			this->meshes[i].primitives[j].upload();
+}
 
 void Primitive::setup(Vertex *_vertices, GLuint _verticesCount, GLuint *_indices, GLuint _indicesCount, GLuint _material)
 {
@@ -9,6 +77,98 @@ void Primitive::setup(Vertex *_vertices, GLuint _verticesCount, GLuint *_indices
 	this->indices = _indices;
 	this->indicesCount = _indicesCount;
 	this->material = _material;
+}
+
+Primitive::~Primitive()
+{
+	delete[] this->positions;
+	if (0 != this->hash)
+	{
+		GeometryRegistry::GetInstance().Release(this);
+		return;
+	}
+	delete[] this->vertices;
+	delete[] this->indices;
+	if (0 != VAO)
+	{
+		glDeleteVertexArrays(1, &VAO);
+		glDeleteBuffers(1, &VBO);
+		glDeleteBuffers(1, &EBO);
+	}
+}
+
+void Primitive::upload()
+{
+	if (0 != this->hash)
+		GeometryRegistry::GetInstance().Upload(this);
+	else
+		this->uploadBuffers();
+}
+
+void Primitive::retain(GeometryRetention retention)
+{
+	if (GEOMETRY_KEEP_ALL == retention || nullptr == this->vertices)
+		return;
+	if (GEOMETRY_KEEP_POSITIONS_ONLY == retention)
+	{
+		this->positions = new glm::vec3[this->verticesCount];
+		for (GLuint i = 0; i < this->verticesCount; i++)
+			this->positions[i] = this->vertices[i].position;
+	}
+	if (0 != this->hash)
+	{
+		GeometryRegistry::GetInstance().Retain(this, retention);
+		return;
+	}
+	delete[] this->vertices;
+	this->vertices = nullptr;
+	if (GEOMETRY_DROP_AFTER_UPLOAD == retention)
+	{
+		delete[] this->indices;
+		this->indices = nullptr;
+	}
+}
+
+GLuint64 Primitive::GetMemoryBytes()
+{
+	GLuint64 bytes = nullptr != this->positions ? this->verticesCount * sizeof(glm::vec3) : 0;
+	if (0 != this->hash)
+		return bytes;
+	if (nullptr != this->vertices)
+		bytes += this->verticesCount * sizeof(Vertex);
+	if (nullptr != this->indices)
+		bytes += this->indicesCount * sizeof(GLuint);
+	return bytes;
+}
+
+void Primitive::releaseBuffers()
+{
+	if (0 != VAO)
+	{
+		glDeleteVertexArrays(1, &VAO);
+		glDeleteBuffers(1, &VBO);
+		glDeleteBuffers(1, &EBO);
+	}
+	VAO = VBO = EBO = 0;
+	this->viewLayout = GL_FALSE;
+	this->indexType = GL_UNSIGNED_INT;
+}
+
+void Primitive::uploadBuffers()
+{
+	//Buffers laid out as the file had them can't be refilled with Vertex arrays
+	if (this->viewLayout)
+		this->releaseBuffers();
+	if (0 != VAO)
+	{
+		glBindVertexArray(VAO);
+		glBindBuffer(GL_ARRAY_BUFFER, VBO);
+		glBufferData(GL_ARRAY_BUFFER, this->verticesCount * sizeof(Vertex), this->vertices, GL_STATIC_DRAW);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, this->indicesCount * sizeof(GLuint), this->indices, GL_STATIC_DRAW);
+		glBindVertexArray(0);
+		return;
+	}
 
 	glGenVertexArrays(1, &VAO);
 	glGenBuffers(1, &VBO);
@@ -39,14 +199,31 @@ void Primitive::setup(Vertex *_vertices, GLuint _verticesCount, GLuint *_indices
 	glBindVertexArray(0);
 }
 
-void Primitive::draw()
+void Primitive::uploadView(const GLubyte *vertexData, GLuint64 vertexBytes, const AttributeLayout *attributes, GLuint attributesCount, const GLubyte *indexData, GLuint64 indexBytes, GLenum type)
 {
+	if (0 == VAO)
+	{
+		glGenVertexArrays(1, &VAO);
+		glGenBuffers(1, &VBO);
+		glGenBuffers(1, &EBO);
+	}
+	this->viewLayout = GL_TRUE;
+	this->indexType = type;
+
 	glBindVertexArray(VAO);
-	glDrawElements(GL_TRIANGLES, this->indicesCount, GL_UNSIGNED_INT, 0);
+	glBindBuffer(GL_ARRAY_BUFFER, VBO);
+	glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)vertexBytes, vertexData, GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, (GLsizeiptr)indexBytes, indexData, GL_STATIC_DRAW);
+	for (GLuint i = 0; i < attributesCount; i++)
+	{
+		glEnableVertexAttribArray(i);
+		glVertexAttribPointer(i, attributes[i].components, GL_FLOAT, GL_FALSE, attributes[i].stride, (void*)(size_t)attributes[i].offset);
+	}
 	glBindVertexArray(0);
 }
 
-void glTFFile::draw(GLuint sceneIndex, Shader *shader)
+void glTFFile::Submit(RenderQueue &queue, GLuint sceneIndex, Shader *shader)
 {
 	if (this->scenesCount <= sceneIndex)
 		return;
@@ -56,102 +233,298 @@ void glTFFile::draw(GLuint sceneIndex, Shader *shader)
 	for (GLuint i = 0; i < scene->nodesCount; i++)
 	{
 		GLuint nodeIndex = scene->nodes[i];
-		if (this->nodesCount <= nodeIndex)
+		if (this->nodesCount <= nodeIndex || 0 > this->nodeSlots[nodeIndex])
 			continue;
-		this->drawNode(nodeIndex, glm::mat4(), shader);
+		//The subtree of the node is the range of slots after it
+		GLuint slot = (GLuint)this->nodeSlots[nodeIndex];
+		for (GLuint j = slot; j < this->flatEnds[slot]; j++)
+		{
+			Node *node = &this->nodes[this->flatNodes[j]];
+			if (!node->hasMesh)
+				continue;
+			Mesh *mesh = &this->meshes[node->mesh];
+			DrawCommand command;
+			command.file = this;
+			command.shader = shader;
+			command.model = &this->worldMatrices[j];
+			//Mesh nodes hold the world bounds of their mesh
+			Box *bounds = &node->boundingBox;
+			command.center = bounds->bounds[0].x <= bounds->bounds[1].x ? (bounds->bounds[0] + bounds->bounds[1]) * 0.5f : glm::vec3(this->worldMatrices[j][3]);
+			for (GLuint k = 0; k < mesh->primitivesCount; k++)
+			{
+				command.primitive = &mesh->primitives[k];
+				command.material = mesh->primitives[k].material;
+				command.pass = this->materials[command.material].blend ? RENDER_PASS_TRANSPARENT : RENDER_PASS_OPAQUE;
+				queue.Add(command);
+			}
+		}
 	}
 }
 
-void glTFFile::drawNode(GLuint index, glm::mat4 parentM, Shader *shader)
+void glTFFile::bindMaterial(GLuint materialIndex, Shader *shader)
 {
-	Node *node = &this->nodes[index];
-	glm::mat4 model;
-	model = glm::translate(model, node->translation);
-	model = glm::scale(model, node->scale);
-	model = parentM * model;
+	Material *material = &this->materials[materialIndex];
+	shader->setVec4("baseColorFactor", material->color);
+	shader->setFloat("metallic", material->metallic);
+	shader->setFloat("roughness", material->roughness);
+	shader->setVec3("emissiveFactor", material->emissive);
+	this->bindTexture(material->baseColorTexture, 0, "hasBaseColorTexture", shader);
+	this->bindTexture(material->metallicRoughnessTexture, 1, "hasMetallicRoughnessTexture", shader);
+	this->bindTexture(material->normalTexture, 2, "hasNormalTexture", shader);
+	this->bindTexture(material->occlusionTexture, 3, "hasOcclusionTexture", shader);
+	this->bindTexture(material->emissiveTexture, 4, "hasEmissiveTexture", shader);
+}
 
-	if (node->hasMesh)
+void glTFFile::bindTexture(GLint texture, GLuint unit, const std::string &flag, Shader *shader)
+{
+	//Textures still being decoded are skipped, the material falls back to its factors
+	GLboolean bound = 0 <= texture && (GLuint)texture < this->texturesCount && this->textures[texture].loaded;
+	shader->setBool(flag, bound);
+	if (!bound)
+		return;
+	glActiveTexture(GL_TEXTURE0 + unit);
+	glBindTexture(GL_TEXTURE_2D, this->textures[texture].id);
+}
+
+void glTFFile::setup()
+{
+	this->flatten();
+	this->UpdateTransforms();
+}
+
+void glTFFile::flatten()
+{
+	delete[] this->flatNodes;
+	delete[] this->flatParents;
+	delete[] this->flatEnds;
+	delete[] this->localMatrices;
+	delete[] this->worldMatrices;
+	delete[] this->subtreeBounds;
+	delete[] this->dirtyFlags;
+	delete[] this->nodeSlots;
+	this->flatNodes = new GLuint[this->nodesCount];
+	this->flatParents = new GLint[this->nodesCount];
+	this->flatEnds = new GLuint[this->nodesCount];
+	this->localMatrices = new glm::mat4[this->nodesCount];
+	this->worldMatrices = new glm::mat4[this->nodesCount];
+	this->subtreeBounds = new Box[this->nodesCount];
+	this->dirtyFlags = new GLubyte[this->nodesCount];
+	this->nodeSlots = new GLint[this->nodesCount];
+	this->flatCount = 0;
+	for (GLuint i = 0; i < this->nodesCount; i++)
+		this->nodeSlots[i] = -1;
+
+	//Depth first from every root, nodes already placed are skipped so malformed files can't loop
+	std::vector<std::pair<GLuint, GLint>> stack;
+	for (GLuint i = 0; i < this->nodesCount; i++)
 	{
-		Mesh *mesh = &this->meshes[node->mesh];
-		shader->setMat4("model", model);
-		for (GLuint j = 0; j < mesh->primitivesCount; j++)
+		if (!this->nodes[i].isRoot)
+			continue;
+		stack.push_back(std::make_pair(i, -1));
+		while (!stack.empty())
 		{
-			Material *material = &this->materials[mesh->primitives[j].material];
-			shader->setVec4("baseColorFactor", material->color);
-			shader->setFloat("metallic", material->metallic);
-			shader->setFloat("roughness", 1.0f);
-			shader->setFloat("ao", 1.0f);
-			shader->setVec3("albedo", glm::vec3(1.0f));
-			mesh->primitives[j].draw();
+			GLuint index = stack.back().first;
+			GLint parent = stack.back().second;
+			stack.pop_back();
+			if (0 <= this->nodeSlots[index])
+				continue;
+			GLuint slot = this->flatCount++;
+			this->flatNodes[slot] = index;
+			this->flatParents[slot] = parent;
+			this->flatEnds[slot] = slot + 1;
+			this->nodeSlots[index] = (GLint)slot;
+			Node *node = &this->nodes[index];
+			//Pushed in reverse so the children keep their order
+			for (GLuint j = node->childrenCount; j > 0; j--)
+			{
+				if (node->children[j - 1] < this->nodesCount)
+					stack.push_back(std::make_pair(node->children[j - 1], (GLint)slot));
+			}
 		}
 	}
+	//Children come after their parents, walking backwards every subtree end is final before it reaches the parent
+	for (GLuint i = this->flatCount; i > 0; i--)
+	{
+		GLint parent = this->flatParents[i - 1];
+		if (0 <= parent && this->flatEnds[i - 1] > this->flatEnds[parent])
+			this->flatEnds[parent] = this->flatEnds[i - 1];
+	}
 
-	if (nullptr != node->children)
+	//Everything is computed by the first update
+	this->dirtyRoots.clear();
+	for (GLuint i = 0; i < this->flatCount; i++)
 	{
-		for (GLuint i = 0; i < node->childrenCount; i++)
+		this->dirtyFlags[i] = NODE_DIRTY_LOCAL | NODE_DIRTY_WORLD;
+		if (0 > this->flatParents[i])
 		{
-			GLuint nodeIndex = node->children[i];
-			if (this->nodesCount <= nodeIndex)
-				continue;
-			this->drawNode(nodeIndex, model, shader);
+			this->dirtyFlags[i] |= NODE_DIRTY_ROOT;
+			this->dirtyRoots.push_back(i);
 		}
 	}
 }
 
-void glTFFile::setup()
+void glTFFile::MarkDirty(GLuint node)
 {
+	if (node >= this->nodesCount || 0 > this->nodeSlots[node])
+		return;
+	GLuint slot = (GLuint)this->nodeSlots[node];
+	this->dirtyFlags[slot] |= NODE_DIRTY_LOCAL | NODE_DIRTY_WORLD;
+	for (GLuint i = slot + 1; i < this->flatEnds[slot]; i++)
+		this->dirtyFlags[i] |= NODE_DIRTY_WORLD;
 
-	for (GLuint i = 0; i < this->nodesCount; i++)
+	//The root is listed once so its subtree is walked and its bounds merged again, other roots stay as they are
+	GLuint root = slot;
+	while (0 <= this->flatParents[root])
+		root = (GLuint)this->flatParents[root];
+	if (0 == (this->dirtyFlags[root] & NODE_DIRTY_ROOT))
 	{
-		if (!this->nodes[i].isRoot)
-			continue;
-		Node *node = &this->nodes[i];
-		glm::mat4 model;
-		model = glm::translate(model, node->translation);
-		model = glm::scale(model, node->scale);
-		model = model;
-
-		node->boundingBox = calculateBoundingBox(i, glm::mat4());
+		this->dirtyFlags[root] |= NODE_DIRTY_ROOT;
+		this->dirtyRoots.push_back(root);
 	}
 }
 
-Box glTFFile::calculateBoundingBox(GLuint index, glm::mat4 parentModel)
+void glTFFile::SetTranslation(GLuint node, const glm::vec3 &translation)
 {
-	Box result;
-	Node *node = &this->nodes[index];
-	glm::mat4 model;
-	model = glm::translate(model, node->translation);
-	model = glm::scale(model, node->scale);
-	model = parentModel * model;
-	if (nullptr != node->children)
+	if (node >= this->nodesCount)
+		return;
+	this->nodes[node].translation = translation;
+	this->nodes[node].hasMatrix = GL_FALSE;
+	this->MarkDirty(node);
+}
+
+void glTFFile::SetRotation(GLuint node, const glm::quat &rotation)
+{
+	if (node >= this->nodesCount)
+		return;
+	this->nodes[node].rotation = rotation;
+	this->nodes[node].hasMatrix = GL_FALSE;
+	this->MarkDirty(node);
+}
+
+void glTFFile::SetScale(GLuint node, const glm::vec3 &scale)
+{
+	if (node >= this->nodesCount)
+		return;
+	this->nodes[node].scale = scale;
+	this->nodes[node].hasMatrix = GL_FALSE;
+	this->MarkDirty(node);
+}
+
+void glTFFile::SetMatrix(GLuint node, const glm::mat4 &matrix)
+{
+	if (node >= this->nodesCount)
+		return;
+	this->nodes[node].matrix = matrix;
+	this->nodes[node].hasMatrix = GL_TRUE;
+	this->MarkDirty(node);
+}
+
+GLuint glTFFile::UpdateTransforms()
+{
+	if (this->dirtyRoots.empty())
+		return 0;
+	//Root subtrees are disjoint ranges, in slot order the slots walked below only grow
+	std::sort(this->dirtyRoots.begin(), this->dirtyRoots.end());
+
+	//Local transforms are composed together first, reused between updates so moving nodes don't allocate
+	static thread_local TRSBatch batch;
+	batch.Clear();
+	for (GLuint root : this->dirtyRoots)
 	{
-		for (GLuint i = 0; i < node->childrenCount; i++)
+		for (GLuint i = root; i < this->flatEnds[root]; i++)
 		{
-			Box child = calculateBoundingBox(node->children[i], model);
-			result.bounds[1].x = child.bounds[1].x > result.bounds[1].x ? child.bounds[1].x : result.bounds[1].x;
-			result.bounds[1].y = child.bounds[1].y > result.bounds[1].y ? child.bounds[1].y : result.bounds[1].y;
-			result.bounds[1].z = child.bounds[1].z > result.bounds[1].z ? child.bounds[1].z : result.bounds[1].z;
-
-			result.bounds[0].x = child.bounds[0].x < result.bounds[0].x ? child.bounds[0].x : result.bounds[0].x;
-			result.bounds[0].y = child.bounds[0].y < result.bounds[0].y ? child.bounds[0].y : result.bounds[0].y;
-			result.bounds[0].z = child.bounds[0].z < result.bounds[0].z ? child.bounds[0].z : result.bounds[0].z;
+			if (0 == (this->dirtyFlags[i] & NODE_DIRTY_LOCAL))
+				continue;
+			Node *node = &this->nodes[this->flatNodes[i]];
+			if (node->hasMatrix)
+				this->localMatrices[i] = node->matrix;
+			else
+				batch.Add(node->translation, node->rotation, node->scale, i);
+		}
+	}
+	ComposeTransforms(batch, this->localMatrices);
+
+	//Parents come first, children are batched until one of them needs a parent still waiting in the batch.
+	//Siblings end up in the same batch, a chain of single children is composed one by one
+	static thread_local std::vector<GLuint> pending;
+	pending.clear();
+	for (GLuint root : this->dirtyRoots)
+	{
+		for (GLuint i = root; i < this->flatEnds[root]; i++)
+		{
+			if (0 == (this->dirtyFlags[i] & (NODE_DIRTY_LOCAL | NODE_DIRTY_WORLD)))
+				continue;
+			GLint parent = this->flatParents[i];
+			if (0 > parent)
+			{
+				this->worldMatrices[i] = this->localMatrices[i];
+				continue;
+			}
+			if (!pending.empty() && (GLuint)parent >= pending.front())
+			{
+				ComposeWorldMatrices(this->worldMatrices, this->localMatrices, this->flatParents, pending.data(), (GLuint)pending.size());
+				pending.clear();
+			}
+			pending.push_back(i);
 		}
 	}
-	if (node->hasMesh)
+	ComposeWorldMatrices(this->worldMatrices, this->localMatrices, this->flatParents, pending.data(), (GLuint)pending.size());
+
+	//Mesh nodes get their own bounds and every dirty root the bounds of its subtree
+	GLuint touched = 0;
+	for (GLuint root : this->dirtyRoots)
 	{
-		Box child = node->boundingBox;
+		Box bounds;
+		for (GLuint i = root; i < this->flatEnds[root]; i++)
+		{
+			Node *node = &this->nodes[this->flatNodes[i]];
+			if (0 != (this->dirtyFlags[i] & (NODE_DIRTY_LOCAL | NODE_DIRTY_WORLD)))
+			{
+				if (node->hasMesh)
+					node->boundingBox = TransformBox(node->localBoundingBox, this->worldMatrices[i]);
+				touched++;
+			}
+			this->dirtyFlags[i] = 0;
+			if (!node->hasMesh)
+				continue;
+			bounds.bounds[0] = glm::min(bounds.bounds[0], node->boundingBox.bounds[0]);
+			bounds.bounds[1] = glm::max(bounds.bounds[1], node->boundingBox.bounds[1]);
+		}
+		this->subtreeBounds[root] = bounds;
+	}
+	this->dirtyRoots.clear();
+	return touched;
+}
 
-		child.bounds[1] = model * glm::vec4(child.bounds[1], 1.0);
-		child.bounds[0] = model * glm::vec4(child.bounds[0], 1.0);
+glm::mat4 glTFFile::GetWorldMatrix(GLuint node)
+{
+	if (node >= this->nodesCount || 0 > this->nodeSlots[node])
+		return glm::mat4();
+	return this->worldMatrices[this->nodeSlots[node]];
+}
 
-		result.bounds[1].x = child.bounds[1].x > result.bounds[1].x ? child.bounds[1].x : result.bounds[1].x;
-		result.bounds[1].y = child.bounds[1].y > result.bounds[1].y ? child.bounds[1].y : result.bounds[1].y;
-		result.bounds[1].z = child.bounds[1].z > result.bounds[1].z ? child.bounds[1].z : result.bounds[1].z;
+Box glTFFile::GetSubtreeBounds(GLuint node)
+{
+	if (node >= this->nodesCount || 0 > this->nodeSlots[node] || 0 <= this->flatParents[this->nodeSlots[node]])
+		return Box();
+	return this->subtreeBounds[this->nodeSlots[node]];
+}
 
-		result.bounds[0].x = child.bounds[0].x < result.bounds[0].x ? child.bounds[0].x : result.bounds[0].x;
-		result.bounds[0].y = child.bounds[0].y < result.bounds[0].y ? child.bounds[0].y : result.bounds[0].y;
-		result.bounds[0].z = child.bounds[0].z < result.bounds[0].z ? child.bounds[0].z : result.bounds[0].z;
-		node->boundingBox = child;
+GLint glTFFile::Pick(const Ray &ray, const glm::vec3 &eye)
+{
+	GLint closest = -1;
+	GLfloat closestDistance = std::numeric_limits<GLfloat>::max();
+	for (GLuint i = 0; i < this->flatCount; i++)
+	{
+		Node *node = &this->nodes[this->flatNodes[i]];
+		if (!node->hasMesh)
+			continue;
+		GLfloat distance = glm::length(eye - (node->boundingBox.bounds[0] + node->boundingBox.bounds[1]) * 0.5f);
+		if (distance < closestDistance && node->boundingBox.interect(ray))
+		{
+			closest = (GLint)this->flatNodes[i];
+			closestDistance = distance;
+		}
 	}
-	return result;
+	return closest;
 }
\ No newline at end of file
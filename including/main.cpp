@@ -1,8 +1,17 @@
 #include "Game.h"
+#include "AssetProcessor.h"
+#include "Transform.h"
+#include <string>
 //#include <vld.h>
 
-int main()
+int main(int argc, char **argv)
 {
+	//Arguments run the asset processor or the benchmarks instead of the game, without opening a window
+	if (argc > 1 && std::string("-bench") == argv[1])
+		return RunTransformBenchmark(argc, argv);
+	if (argc > 1)
+		return RunAssetProcessor(argc, argv);
+
 	Game game;
 
 	if (!game.init())
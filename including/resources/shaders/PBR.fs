@@ -5,6 +5,7 @@ out vec4 FragColor;
 in vec2 TexCoords;
 in vec3 WorldPos;
 in vec3 Normal;
+in vec4 Tangent;
 
 uniform vec3 camPos;
 
@@ -13,6 +14,18 @@ uniform float metallic;
 uniform float roughness;
 uniform float ao;
 uniform vec4 baseColorFactor;
+uniform vec3 emissiveFactor;
+
+uniform sampler2D baseColorTexture;
+uniform sampler2D metallicRoughnessTexture;
+uniform sampler2D normalTexture;
+uniform sampler2D occlusionTexture;
+uniform sampler2D emissiveTexture;
+uniform bool hasBaseColorTexture;
+uniform bool hasMetallicRoughnessTexture;
+uniform bool hasNormalTexture;
+uniform bool hasOcclusionTexture;
+uniform bool hasEmissiveTexture;
 
 uniform vec3 lightPositions[4];
 uniform vec3 lightColors[4];
@@ -59,15 +72,50 @@ float GeometrySmith(vec3 N, vec3 V, vec3 L, float rougness)
 	return ggx1 * ggx2;
 }
 
-void main()
+vec3 getNormal()
 {
 	vec3 N = normalize(Normal);
+	// Without tangents there's no basis to apply the normal map
+	if (!hasNormalTexture || dot(Tangent.xyz, Tangent.xyz) < 0.0001)
+		return N;
+	vec3 T = normalize(Tangent.xyz - dot(Tangent.xyz, N) * N);
+	vec3 B = cross(N, T) * (Tangent.w < 0.0 ? -1.0 : 1.0);
+	vec3 mapped = texture(normalTexture, TexCoords).xyz * 2.0 - 1.0;
+	return normalize(mat3(T, B, N) * mapped);
+}
+
+void main()
+{
+	vec3 N = getNormal();
 	vec3 V = normalize(camPos - WorldPos);
 
+	// sRGB textures are decoded to linear by the sampler
 	vec3 baseColor = albedo * baseColorFactor.rgb;
+	float alpha = baseColorFactor.a;
+	if (hasBaseColorTexture)
+	{
+		vec4 baseColorSample = texture(baseColorTexture, TexCoords);
+		baseColor *= baseColorSample.rgb;
+		alpha *= baseColorSample.a;
+	}
+
+	float surfaceMetallic = metallic;
+	float surfaceRoughness = roughness;
+	if (hasMetallicRoughnessTexture)
+	{
+		vec4 metallicRoughness = texture(metallicRoughnessTexture, TexCoords);
+		surfaceRoughness *= metallicRoughness.g;
+		surfaceMetallic *= metallicRoughness.b;
+	}
+	float occlusion = ao;
+	if (hasOcclusionTexture)
+		occlusion *= texture(occlusionTexture, TexCoords).r;
+	vec3 emissive = emissiveFactor;
+	if (hasEmissiveTexture)
+		emissive *= texture(emissiveTexture, TexCoords).rgb;
 
 	vec3 F0 = vec3(0.04);
-	F0 = mix(F0, baseColor, metallic);
+	F0 = mix(F0, baseColor, surfaceMetallic);
 
 	vec3 Lo = vec3(0.0);
 	for(int i = 0; i < 4; ++i)
@@ -81,8 +129,8 @@ void main()
 
 		vec3 F = fresnelSchlick(max(dot(H, V), 0.0), F0);
 
-		float NDF = DistributionGGX(N, H, roughness);
-		float G = GeometrySmith(N, V, L, roughness);
+		float NDF = DistributionGGX(N, H, surfaceRoughness);
+		float G = GeometrySmith(N, V, L, surfaceRoughness);
 
 		vec3 numerator = NDF * G * F;
 		float denominator = 4.0 * max(dot(N, V), 0.0) * max(dot(N, L), 0.0);
@@ -91,17 +139,17 @@ void main()
 		vec3 kS = F;
 		vec3 kD = vec3(1.0) - kS;
 
-		kD *= 1.0 - metallic;
+		kD *= 1.0 - surfaceMetallic;
 
 		float NdotL = max(dot(N, L), 0.0);
 		Lo += (kD * baseColor / PI + specular) * radiance * NdotL;
 	}
 
-	vec3 ambient = vec3(0.25) * baseColor * ao;
-	vec3 color = ambient + Lo;
+	vec3 ambient = vec3(0.25) * baseColor * occlusion;
+	vec3 color = ambient + Lo + emissive;
 
 	color = color / (color + vec3(1.0));
 
-    FragColor = vec4(color, 1.0);
+    FragColor = vec4(color, alpha);
 	//FragColor = baseColorFactor;
 }
\ No newline at end of file
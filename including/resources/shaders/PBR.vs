@@ -2,6 +2,7 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
+layout (location = 3) in vec4 aTangent;
 
 uniform mat4 model;
 uniform mat4 projection;
@@ -10,6 +11,7 @@ uniform mat4 view;
 out vec2 TexCoords;
 out vec3 WorldPos;
 out vec3 Normal;
+out vec4 Tangent;
 
 void main()
 {
@@ -17,4 +19,5 @@ void main()
 	TexCoords = aTexCoords;
 	WorldPos = vec3(model * vec4(aPos, 1.0));
 	Normal = aNormal;
+	Tangent = aTangent;
 }
\ No newline at end of file